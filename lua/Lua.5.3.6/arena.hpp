@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/* Bump allocator, everything in it is dropped at once by reset() which keeps the memory for the next round. */
+class arena {
+    public:
+      explicit arena(const std::size_t chunk_size = 64u * 1024u) : chunk_size(chunk_size) {}
+
+      arena(const arena &) = delete;
+      arena &operator=(const arena &) = delete;
+      arena(arena &&) = default;
+      arena &operator=(arena &&) = default;
+
+      void *allocate(const std::size_t size, const std::size_t align) {
+            if (current < chunks.size()) {
+                  const auto at = aligned(chunks[current], offset, align);
+                  if (at + size <= chunks[current].size) {
+                        offset = at + size;
+                        return chunks[current].memory.get() + at;
+                  }
+            }
+            return allocate_slow(size, align);
+      }
+
+      /* Only trivially destructible types, reset() never runs destructors. */
+      template <typename T, typename... Args>
+      T *make(Args &&...args) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+      }
+
+      /* Value-initialized array. */
+      template <typename T>
+      T *make_array(const std::size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            if (count == 0u)
+                  return nullptr;
+            const auto result = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+            for (auto i = std::size_t{0u}; i < count; ++i)
+                  new (result + i) T();
+            return result;
+      }
+
+      /* O(1), chunks stay allocated and get reused in order. */
+      void reset() {
+            current = 0u;
+            offset = 0u;
+      }
+
+      /* Bytes held from the system. */
+      std::size_t capacity() const {
+            auto total = std::size_t{0u};
+            for (const auto &c : chunks)
+                  total += c.size;
+            return total;
+      }
+
+    private:
+      struct chunk {
+            std::unique_ptr<std::uint8_t[]> memory;
+            std::size_t size;
+      };
+
+      std::vector<chunk> chunks;
+      std::size_t chunk_size;
+      std::size_t current = 0u;
+      std::size_t offset = 0u;
+
+      /* First offset at or past `from` whose address is a multiple of `align`. */
+      static std::size_t aligned(const chunk &c, const std::size_t from, const std::size_t align) {
+            const auto base = reinterpret_cast<std::uintptr_t>(c.memory.get());
+            return static_cast<std::size_t>(((base + from + align - 1u) & ~static_cast<std::uintptr_t>(align - 1u)) - base);
+      }
+
+      void *allocate_slow(const std::size_t size, const std::size_t align) {
+            /* Move on to the next retained chunk when it fits, otherwise slot a new one in right here. */
+            const auto need = size + align;
+            auto next = (current < chunks.size() && offset != 0u) ? current + 1u : current;
+            if (next >= chunks.size() || chunks[next].size < need) {
+                  const auto bytes = (need > chunk_size) ? need : chunk_size;
+                  chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(next), chunk{std::unique_ptr<std::uint8_t[]>(new std::uint8_t[bytes]), bytes});
+            }
+            current = next;
+            offset = 0u;
+            const auto at = aligned(chunks[current], 0u, align);
+            offset = at + size;
+            return chunks[current].memory.get() + at;
+      }
+};
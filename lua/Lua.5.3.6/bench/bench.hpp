@@ -0,0 +1,47 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace bench {
+
+      using clock = std::chrono::steady_clock;
+
+      /* Keeps the optimizer from throwing away results. */
+      inline void keep(const std::uint64_t value) {
+            static volatile std::uint64_t sink = 0u;
+            sink = sink + value;
+      }
+
+      /* Best of `runs` in nanoseconds per `ops`. */
+      template <typename F>
+      double measure(F &&work, const std::size_t ops, const std::size_t runs = 5u) {
+            auto best = 0.0;
+            for (auto run = 0u; run < runs; ++run) {
+                  const auto start = clock::now();
+                  work();
+                  const auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count() / static_cast<double>(ops);
+                  best = (run == 0u) ? elapsed : std::min(best, elapsed);
+            }
+            return best;
+      }
+
+      /* xorshift64*, deterministic so runs are comparable. */
+      struct rng {
+            std::uint64_t state = 0x9E3779B97F4A7C15ull;
+
+            std::uint64_t next() {
+                  state ^= state >> 12u;
+                  state ^= state << 25u;
+                  state ^= state >> 27u;
+                  return state * 0x2545F4914F6CDD1Dull;
+            }
+            std::uint32_t below(const std::uint32_t bound) {
+                  return static_cast<std::uint32_t>((next() >> 32u) % bound);
+            }
+      };
+
+} // namespace bench
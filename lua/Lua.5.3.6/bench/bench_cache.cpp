@@ -0,0 +1,99 @@
+#include "../cache.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+      /* Straight-line arithmetic with a conditional skip and a short jump every few instructions. */
+      synthetic::proto_spec make_proto(bench::rng &rng, const std::uint32_t size) {
+            synthetic::proto_spec p;
+            p.max_stack_size = 16u;
+            while (p.code.size() < size) {
+                  switch (rng.below(6u)) {
+                        case 0u:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_LT, 0u, rng.below(16u), rng.below(16u)));
+                              p.code.push_back(synthetic::encode_asbx(opcodes::OP_JMP, 0u, static_cast<std::int32_t>(rng.below(4u))));
+                              break;
+                        case 1u:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_MOVE, rng.below(16u), rng.below(16u), 0u));
+                              break;
+                        default:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_ADD, rng.below(16u), rng.below(16u), rng.below(16u)));
+                              break;
+                  }
+            }
+            p.code.push_back(synthetic::encode_abc(opcodes::OP_RETURN, 0u, 1u, 0u));
+            return p;
+      }
+
+      template <typename F>
+      void each_proto(const chunk::proto &p, F &&f) {
+            f(p);
+            for (auto i = std::size_t{0u}; i < p.proto_count(); ++i)
+                  each_proto(p.child(i), f);
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const auto directory = (argc > 1) ? std::string(argv[1]) : (std::filesystem::temp_directory_path() / "bench_cache").string();
+      constexpr auto file_count = 200u;
+      constexpr auto protos_per_file = 16u;
+      constexpr auto proto_size = 512u;
+
+      bench::rng rng;
+      synthetic::chunk_writer writer;
+      std::vector<std::unique_ptr<chunk::file>> files;
+      std::vector<std::vector<std::uint8_t>> chunks;
+      for (auto f = 0u; f < file_count; ++f) {
+            auto main = make_proto(rng, proto_size);
+            for (auto i = 1u; i < protos_per_file; ++i)
+                  main.protos.push_back(make_proto(rng, proto_size));
+            chunks.push_back(writer.write(main));
+      }
+      for (const auto &bytes : chunks)
+            files.push_back(chunk::file::view(bytes.data(), bytes.size()));
+      const auto total = static_cast<std::size_t>(file_count) * protos_per_file;
+
+      dataflow::liveness solver;
+      const auto uncached = [&] {
+            for (const auto &file : files)
+                  each_proto(file->main(), [&](const chunk::proto &p) { bench::keep(cache::analyze(p, solver).blocks.size()); });
+      };
+      const auto through = [&](cache::store &store) {
+            return [&] {
+                  for (const auto &file : files)
+                        each_proto(file->main(), [&](const chunk::proto &p) { bench::keep(store.get(p)->blocks.size()); });
+            };
+      };
+
+      std::printf("%zu protos of %u instructions\n", total, proto_size);
+      const auto report = [](const char *const name, const double ns) {
+            std::printf("%-24s %10.2f us/proto\n", name, ns / 1000.0);
+      };
+      report("decode + analyze", bench::measure(uncached, total, 3u));
+
+      std::filesystem::remove_all(directory);
+      cache::store store({directory, 256u << 20u});
+      report("cold (analyze + write)", bench::measure(through(store), total, 1u));
+      report("memory tier", bench::measure(through(store), total, 3u));
+      const auto disk = [&] {
+            store.clear_memory();
+            through(store)();
+      };
+      report("disk tier", bench::measure(disk, total, 3u));
+
+      const auto stats = store.stats();
+      std::printf("hit rate %.3f, %llu bytes of bytecode skipped, lookup mean %.0f ns, p50 <= %llu ns, p99 <= %llu ns\n", stats.hit_rate(),
+                  static_cast<unsigned long long>(stats.bytes_saved), stats.mean_lookup_ns(), static_cast<unsigned long long>(stats.lookup_ns_quantile(0.5)),
+                  static_cast<unsigned long long>(stats.lookup_ns_quantile(0.99)));
+
+      std::filesystem::remove_all(directory);
+      return 0;
+}
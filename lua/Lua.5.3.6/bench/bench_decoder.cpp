@@ -0,0 +1,102 @@
+#include "../decoder.hpp"
+#include "bench.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+      constexpr decoder::kernel kernels[] = {decoder::kernel::scalar, decoder::kernel::sse4, decoder::kernel::avx2};
+
+      /*
+            Every kernel this CPU runs against decode_scalar on random words, lengths 0..70 and an unaligned start.
+            Output arrays are prefilled so a kernel writing past `count` shows up too.
+      */
+      bool check_kernels() {
+            bench::rng rng;
+            std::vector<std::uint8_t> bytes(71u * 4u + 1u);
+            decoder::decoded expected;
+            decoder::decoded actual;
+            expected.resize(71u);
+            actual.resize(71u);
+            const auto fill = [](decoder::decoded &d) {
+                  std::memset(d.op.data(), 0xA5, d.op.size());
+                  std::memset(d.a.data(), 0xA5, d.a.size());
+                  std::memset(d.b.data(), 0xA5, d.b.size() * 2u);
+                  std::memset(d.c.data(), 0xA5, d.c.size() * 2u);
+                  std::memset(d.bx.data(), 0xA5, d.bx.size() * 4u);
+                  std::memset(d.sbx.data(), 0xA5, d.sbx.size() * 4u);
+                  std::memset(d.ax.data(), 0xA5, d.ax.size() * 4u);
+                  std::memset(d.rk.data(), 0xA5, d.rk.size());
+            };
+            auto ok = true;
+            for (auto round = 0u; round < 64u; ++round) {
+                  for (auto &byte : bytes)
+                        byte = static_cast<std::uint8_t>(rng.next() >> 56u);
+                  for (auto count = std::size_t{0u}; count <= 70u; ++count) {
+                        fill(expected);
+                        decoder::decode_scalar(bytes.data() + 1u, count, expected.view());
+                        for (const auto k : kernels) {
+                              decoder::select(k);
+                              if (decoder::active() != k)
+                                    continue;
+                              fill(actual);
+                              decoder::decode(bytes.data() + 1u, count, actual.view());
+                              if (actual.op != expected.op || actual.a != expected.a || actual.b != expected.b || actual.c != expected.c || actual.bx != expected.bx ||
+                                  actual.sbx != expected.sbx || actual.ax != expected.ax || actual.rk != expected.rk) {
+                                    std::fprintf(stderr, "%s differs from scalar at count %zu\n", decoder::kernel_name(k), count);
+                                    ok = false;
+                              }
+                        }
+                  }
+            }
+            decoder::select(decoder::detect());
+            return ok;
+      }
+
+} // namespace
+
+/* `--check` only compares the kernels. */
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      if (!check_kernels())
+            return 1;
+      if (argc > 1 && std::strcmp(argv[1], "--check") == 0)
+            return 0;
+
+      constexpr auto count = 1u << 22u;
+
+      bench::rng rng;
+      std::vector<std::uint32_t> code(count);
+      for (auto &word : code)
+            word = (static_cast<std::uint32_t>(rng.next() >> 32u) & ~op_mask) | rng.below(static_cast<std::uint32_t>(opcode_count));
+
+      /* What every tool used to do, walk opencodings and shift/mask each operand. */
+      const auto baseline = [&] {
+            auto sum = 0ull;
+            for (const auto word : code) {
+                  const auto &entry = opentry(instruction_op(word));
+                  for (auto i = 0u; i < entry.operand_count; ++i)
+                        sum += static_cast<std::uint64_t>(instruction_operand(word, entry.operands[i].field));
+            }
+            bench::keep(sum);
+      };
+      std::printf("%-8s %8.3f ns/insn\n", "per-op", bench::measure(baseline, count));
+
+      decoder::decoded out;
+      out.resize(count);
+      for (const auto k : kernels) {
+            decoder::select(k);
+            if (decoder::active() != k)
+                  continue;
+            const auto run = [&] {
+                  decoder::decode(code.data(), count, out.view());
+                  bench::keep(out.rk[count - 1u]);
+            };
+            const auto ns = bench::measure(run, count);
+            std::printf("%-8s %8.3f ns/insn %10.1f Minsn/s\n", decoder::kernel_name(k), ns, 1000.0 / ns);
+      }
+
+      return 0;
+}
@@ -0,0 +1,154 @@
+#include "../diff.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+namespace {
+
+      synthetic::proto_spec make_proto(bench::rng &rng, const std::uint32_t size) {
+            synthetic::proto_spec p;
+            p.max_stack_size = 16u;
+            for (auto i = 0u; i < 4u; ++i) {
+                  synthetic::constant_spec k;
+                  k.type = chunk::constant_type::integer;
+                  k.integer = static_cast<std::int64_t>(rng.below(1000u));
+                  p.constants.push_back(k);
+            }
+            while (p.code.size() < size) {
+                  switch (rng.below(4u)) {
+                        case 0u:
+                              p.code.push_back(synthetic::encode_abx(opcodes::OP_LOADK, rng.below(16u), rng.below(4u)));
+                              break;
+                        case 1u:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_ADD, rng.below(16u), rng.below(16u), decoder::rk_bit | rng.below(4u)));
+                              break;
+                        case 2u:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_CALL, rng.below(16u), 2u, 1u));
+                              break;
+                        default:
+                              p.code.push_back(synthetic::encode_abc(opcodes::OP_MOVE, rng.below(16u), rng.below(16u), 0u));
+                              break;
+                  }
+            }
+            p.code.push_back(synthetic::encode_abc(opcodes::OP_RETURN, 0u, 1u, 0u));
+            return p;
+      }
+
+      /* One random permutation of R0..R15 applied to every register operand, make_proto's opcodes only. */
+      void rename_registers(bench::rng &rng, synthetic::proto_spec &p) {
+            std::uint32_t to[16];
+            for (auto i = 0u; i < 16u; ++i)
+                  to[i] = i;
+            for (auto i = 15u; i > 0u; --i)
+                  std::swap(to[i], to[rng.below(i + 1u)]);
+            for (auto &word : p.code) {
+                  const auto op = instruction_op(word);
+                  const auto a = to[(word >> 6u) & 0xFu];
+                  const auto b = (word >> 23u) & 0x1FFu;
+                  const auto c = (word >> 14u) & 0x1FFu;
+                  if (op == opcodes::OP_LOADK)
+                        word = synthetic::encode_abx(op, a, word >> 14u);
+                  else if (op == opcodes::OP_ADD || op == opcodes::OP_MOVE)
+                        word = synthetic::encode_abc(op, a, to[b & 0xFu], c);
+                  else
+                        word = synthetic::encode_abc(op, a, b, c);
+            }
+      }
+
+      diff::report compare(const synthetic::proto_spec &before, const synthetic::proto_spec &after) {
+            synthetic::chunk_writer writer;
+            const auto old_bytes = writer.write(before);
+            const auto new_bytes = writer.write(after);
+            return diff::compare(*chunk::file::view(old_bytes.data(), old_bytes.size()), *chunk::file::view(new_bytes.data(), new_bytes.size()));
+      }
+
+      /* Edits whose diff is known exactly. */
+      bool check() {
+            bench::rng rng;
+            auto ok = true;
+            const auto expect = [&](const char *const what, const diff::report &r, const bool pass) {
+                  if (!pass) {
+                        std::fprintf(stderr, "%s:\n%s", what, diff::render(r).c_str());
+                        ok = false;
+                  }
+            };
+            for (auto round = 0u; round < 100u; ++round) {
+                  const auto before = make_proto(rng, 64u + rng.below(64u));
+
+                  /* A single instruction at pc 0 must not shift how the rest compares. */
+                  auto inserted = before;
+                  inserted.code.insert(inserted.code.begin(), synthetic::encode_abc(opcodes::OP_LOADNIL, 9u, 0u, 0u));
+                  const auto r0 = compare(before, inserted);
+                  const auto &f0 = r0.functions[0];
+                  expect("insert at pc 0", r0, f0.inserted == 1u && f0.deleted == 0u && f0.changed == 0u && f0.renamed == 0u);
+
+                  auto renamed = before;
+                  rename_registers(rng, renamed);
+                  const auto r1 = compare(before, renamed);
+                  expect("registers renamed", r1, r1.unchanged == 1u && r1.modified == 0u);
+
+                  /* A MOVE reading another register is different dataflow. */
+                  auto moved = before;
+                  for (auto &word : moved.code) {
+                        if (instruction_op(word) == opcodes::OP_MOVE) {
+                              word = synthetic::encode_abc(opcodes::OP_MOVE, (word >> 6u) & 0xFFu, ((word >> 23u) + 1u) % 16u, 0u);
+                              break;
+                        }
+                  }
+                  const auto r2 = compare(before, moved);
+                  const auto &f2 = r2.functions[0];
+                  expect("MOVE source changed", r2, f2.changed == 1u && f2.inserted == 0u && f2.deleted == 0u);
+            }
+            return ok;
+      }
+
+      /* The next build: 1% of functions edited, 0.5% dropped, 0.5% added, every register of a further 1% renamed. */
+      synthetic::proto_spec next_build(bench::rng &rng, synthetic::proto_spec main) {
+            auto &children = main.protos;
+            const auto count = children.size();
+            for (auto i = 0u; i < count / 100u; ++i) {
+                  auto &code = children[rng.below(static_cast<std::uint32_t>(children.size()))].code;
+                  code[rng.below(static_cast<std::uint32_t>(code.size() - 1u))] = synthetic::encode_abc(opcodes::OP_SUB, 1u, 2u, 3u);
+            }
+            for (auto i = 0u; i < count / 100u; ++i)
+                  rename_registers(rng, children[rng.below(static_cast<std::uint32_t>(children.size()))]);
+            for (auto i = 0u; i < count / 200u; ++i)
+                  children.erase(children.begin() + rng.below(static_cast<std::uint32_t>(children.size())));
+            for (auto i = 0u; i < count / 200u; ++i)
+                  children.push_back(make_proto(rng, 64u + rng.below(64u)));
+            return main;
+      }
+
+} // namespace
+
+/* `--check` only runs the known edits. */
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      if (!check())
+            return 1;
+      if (argc > 1 && std::strcmp(argv[1], "--check") == 0)
+            return 0;
+
+      bench::rng rng;
+      synthetic::chunk_writer writer;
+      for (const auto count : {1000u, 4000u, 16000u}) {
+            auto before = make_proto(rng, 64u);
+            for (auto i = 0u; i < count; ++i)
+                  before.protos.push_back(make_proto(rng, 64u + rng.below(64u)));
+            const auto after = next_build(rng, before);
+            const auto old_bytes = writer.write(before);
+            const auto new_bytes = writer.write(after);
+            const auto old_file = chunk::file::view(old_bytes.data(), old_bytes.size());
+            const auto new_file = chunk::file::view(new_bytes.data(), new_bytes.size());
+
+            const auto result = diff::compare(*old_file, *new_file);
+            const auto ns = bench::measure([&] { bench::keep(diff::compare(*old_file, *new_file).modified); }, count, 3u);
+            std::printf("%6u protos: %u unchanged, %u modified, %u inserted, %u deleted  %8.2f us/proto %8.2f ms total\n", count, result.unchanged, result.modified,
+                        result.inserted, result.deleted, ns / 1000.0, ns * count / 1e6);
+      }
+      return 0;
+}
@@ -0,0 +1,78 @@
+#include "../disasm.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sstream>
+#include <string>
+
+namespace {
+
+      /* The std::cout << chain style main.cpp uses, per instruction through iostreams. */
+      void render_iostream(std::ostream &out, const chunk::proto &p) {
+            for (auto pc = 0u; pc < p.code.size(); ++pc) {
+                  const auto insn = p.code.at(pc);
+                  out << "\t" << pc << "\t[" << p.line_info[pc] << "]\t";
+                  if (!opcode_valid(insn.op())) {
+                        out << "unknown(" << static_cast<std::uint32_t>(insn.op()) << ")\n";
+                        continue;
+                  }
+                  const auto &descriptor = opdescriptor[insn.op()];
+                  const auto &encodings = opencodings[insn.op()].encodings;
+                  out << descriptor.mnemonic << "\t";
+                  for (auto i = 0u; i < encodings.size(); ++i)
+                        out << (i != 0u ? ", " : "") << descriptor.operand_encodings[i] << " " << insn.operand(encodings[i]);
+                  out << "\n";
+            }
+      }
+
+} // namespace
+
+std::int32_t main() {
+
+      constexpr auto count = 1u << 20u;
+
+      bench::rng rng;
+      synthetic::proto_spec spec;
+      spec.source = "@bench.lua";
+      for (auto pc = 0u; pc < count; ++pc) {
+            spec.code.push_back((static_cast<std::uint32_t>(rng.next()) & ~op_mask) | rng.below(static_cast<std::uint32_t>(opcode_count)));
+            spec.line_info.push_back(static_cast<std::int32_t>(pc / 4u + 1u));
+      }
+      const auto bytes = synthetic::chunk_writer().write(spec);
+      const auto file = chunk::file::view(bytes.data(), bytes.size());
+      const auto &p = file->main();
+
+#if defined(_WIN32)
+      const auto null_fd = _open("NUL", _O_WRONLY);
+#else
+      const auto null_fd = ::open("/dev/null", O_WRONLY);
+#endif
+
+      const auto iostream = [&] {
+            std::ostringstream out;
+            render_iostream(out, p);
+            bench::keep(out.tellp());
+      };
+      const auto to_string = [&] {
+            std::string out;
+            auto w = disasm::writer::to_string(out);
+            disasm::renderer().proto(w, p, "main");
+            w.flush();
+            bench::keep(out.size());
+      };
+      const auto to_fd = [&] {
+            auto w = disasm::writer::to_fd(null_fd);
+            disasm::renderer().proto(w, p, "main");
+      };
+
+      const auto report = [&](const char *const name, const double ns) {
+            std::printf("%-18s %8.2f ns/insn %8.2f Minsn/s\n", name, ns, 1000.0 / ns);
+      };
+      report("iostream", bench::measure(iostream, count, 3u));
+      report("streaming string", bench::measure(to_string, count, 3u));
+      report("streaming fd", bench::measure(to_fd, count, 3u));
+
+      return 0;
+}
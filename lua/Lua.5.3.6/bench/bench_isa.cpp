@@ -0,0 +1,34 @@
+#include "../isa.hpp"
+#include "bench.hpp"
+
+#include <cstdio>
+#include <string>
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const std::string path = (argc > 1) ? argv[1] : "lua/Lua.5.3.6/IS_Lua_5_3_6.json";
+      const io::mapped_file file(path);
+      const std::string text(reinterpret_cast<const char *>(file.data()), file.size());
+
+      const auto skip = [&] {
+            isa::json_reader in(text);
+            in.skip();
+            in.finish();
+      };
+      const auto parse = [&] {
+            const auto set = isa::instruction_set::parse(text);
+            bench::keep(set.size());
+      };
+      const auto load = [&] {
+            const auto set = isa::instruction_set::load(path);
+            bench::keep(set.size());
+      };
+
+      const auto set = isa::instruction_set::parse(text);
+      std::printf("%s: %zu bytes, %zu opcodes, pool %zu bytes / %zu strings\n", path.c_str(), text.size(), set.size(), set.strings().size(), set.strings().strings());
+      std::printf("%-12s %8.2f us\n", "json skip", bench::measure(skip, 1u, 1000u) / 1000.0);
+      std::printf("%-12s %8.2f us\n", "parse", bench::measure(parse, 1u, 1000u) / 1000.0);
+      std::printf("%-12s %8.2f us\n", "mmap + parse", bench::measure(load, 1u, 1000u) / 1000.0);
+
+      return 0;
+}
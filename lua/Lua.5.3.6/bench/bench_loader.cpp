@@ -0,0 +1,88 @@
+#include "../chunk.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+      /* What loading looked like before, every proto copied out into owning containers. */
+      struct copied_proto {
+            std::vector<std::uint32_t> code;
+            std::vector<std::string> strings;
+            std::vector<std::int32_t> line_info;
+            std::vector<copied_proto> protos;
+      };
+
+      copied_proto copy_out(const chunk::proto &p) {
+            copied_proto result;
+            result.code.assign(p.code.begin(), p.code.end());
+            for (auto i = 0u; i < p.constants.size(); ++i)
+                  result.strings.emplace_back(p.constants[i].string);
+            result.line_info.assign(p.line_info.begin(), p.line_info.end());
+            for (auto i = 0u; i < p.proto_count(); ++i)
+                  result.protos.push_back(copy_out(p.child(i)));
+            return result;
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const std::string path = (argc > 1) ? argv[1] : "bench_loader.luac";
+      constexpr auto proto_count = 20000u;
+      constexpr auto code_size = 256u;
+
+      bench::rng rng;
+      synthetic::proto_spec main;
+      main.source = "@bench.lua";
+      main.protos.resize(proto_count);
+      for (auto &p : main.protos) {
+            p.source = main.source;
+            for (auto pc = 0u; pc < code_size; ++pc) {
+                  p.code.push_back((static_cast<std::uint32_t>(rng.next()) & ~op_mask) | rng.below(static_cast<std::uint32_t>(opcode_count)));
+                  p.line_info.push_back(static_cast<std::int32_t>(pc));
+            }
+            for (auto k = 0u; k < 16u; ++k) {
+                  synthetic::constant_spec constant;
+                  constant.type = chunk::constant_type::short_string;
+                  constant.string = "constant_" + std::to_string(rng.below(1000u));
+                  p.constants.push_back(constant);
+            }
+      }
+      const auto bytes = synthetic::chunk_writer().write(main);
+      std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+      const auto megabytes = static_cast<double>(bytes.size()) / (1024.0 * 1024.0);
+
+      const auto copying = [&] {
+            std::ifstream in(path, std::ios::binary | std::ios::ate);
+            std::vector<std::uint8_t> contents(static_cast<std::size_t>(in.tellg()));
+            in.seekg(0).read(reinterpret_cast<char *>(contents.data()), static_cast<std::streamsize>(contents.size()));
+            const auto loaded = chunk::file::view(contents.data(), contents.size());
+            bench::keep(copy_out(loaded->main()).protos.size());
+      };
+      const auto eager = [&] {
+            bench::keep(chunk::file::open(path)->main().proto_count());
+      };
+      const auto lazy = [&] {
+            const auto loaded = chunk::file::open(path, chunk::load_mode::lazy);
+            auto sum = 0ull;
+            for (auto i = 0u; i < proto_count; i += 100u)
+                  sum += loaded->main().child(i).code.size();
+            bench::keep(sum);
+      };
+
+      const auto report = [&](const char *const name, const double ns) {
+            std::printf("%-22s %9.2f ms %9.1f MB/s\n", name, ns / 1e6, megabytes / (ns / 1e9));
+      };
+      std::printf("chunk %.1f MB, %u protos\n", megabytes, proto_count);
+      report("read + copy", bench::measure(copying, 1u));
+      report("mmap eager", bench::measure(eager, 1u));
+      report("mmap lazy (1% touched)", bench::measure(lazy, 1u));
+
+      std::remove(path.c_str());
+      return 0;
+}
@@ -0,0 +1,129 @@
+#include "../header.hpp"
+#include "bench.hpp"
+
+#include <cstdio>
+#include <map>
+#include <vector>
+
+/* The std::map tables header.hpp used to define, rebuilt from optable so both sides hold the same data. */
+namespace legacy {
+
+      struct optable_encoding {
+            opcodes op;
+            std::vector<operand_encoding> encodings;
+      };
+
+      struct optable_kind {
+            opcodes op;
+            std::vector<operand_kind> kinds;
+      };
+
+      struct optable_descriptor {
+            const char *const opname;
+            const char *const mnemonic;
+            const char *const hint;
+            std::vector<const char *> operand_encodings;
+      };
+
+      struct tables {
+            std::map<opcodes, optable_encoding> opencodings;
+            std::map<opcodes, optable_kind> opkinds;
+            std::map<opcodes, optable_descriptor> opdescriptor;
+      };
+
+      /* Same work every translation unit including the old header did during static init. */
+      tables build() {
+            tables result;
+            for (const auto &entry : optable) {
+                  std::vector<operand_encoding> encodings;
+                  std::vector<operand_kind> kinds;
+                  std::vector<const char *> descriptors;
+                  for (auto i = 0u; i < entry.operand_count; ++i) {
+                        encodings.push_back(entry.operands[i].encoding);
+                        kinds.push_back(entry.operands[i].kind);
+                        descriptors.push_back(entry.operands[i].descriptor);
+                  }
+                  result.opencodings.insert({entry.op, {entry.op, encodings}});
+                  result.opkinds.insert({entry.op, {entry.op, kinds}});
+                  result.opdescriptor.insert({entry.op, {entry.opname, entry.mnemonic, entry.hint, descriptors}});
+            }
+            return result;
+      }
+
+} // namespace legacy
+
+/* Everything below is usable in constant expressions, so none of it runs at startup. */
+static_assert(opentry(opcodes::OP_LOADK).operands[1].field.bits == 18u, "Bx is 18 bits.");
+static_assert(opencodings[opcodes::OP_JMP].encodings[1] == operand_encoding::sBx, "jmp takes sBx.");
+static_assert(opkinds[opcodes::OP_CALL].kinds.size() == 3u, "call takes three operands.");
+
+std::int32_t main() {
+
+      constexpr auto stream_size = 1u << 20u;
+
+      /* First use in this process, constexpr tables before anything else touches optable (legacy::build reads it too). */
+      const auto first_use = [](auto &&work) {
+            const auto start = bench::clock::now();
+            work();
+            return std::chrono::duration<double, std::nano>(bench::clock::now() - start).count();
+      };
+      const auto flat_first_ns = first_use([] {
+            auto sum = 0ull;
+            for (auto op = 0u; op < opcode_count; ++op)
+                  sum += opkinds[static_cast<opcodes>(op)].kinds.size() + opentry(static_cast<opcodes>(op)).operand_count;
+            bench::keep(sum);
+      });
+      const auto map_first_ns = first_use([] { bench::keep(legacy::build().opkinds.size()); });
+
+      bench::rng rng;
+      std::vector<opcodes> stream(stream_size);
+      for (auto &op : stream)
+            op = static_cast<opcodes>(rng.below(static_cast<std::uint32_t>(opcode_count)));
+
+      /* Startup */
+      const auto init_ns = bench::measure([] { bench::keep(legacy::build().opkinds.size()); }, 1u, 101u);
+
+      /* Lookup */
+      const auto legacy_tables = legacy::build();
+      const auto map_lookup = [&] {
+            auto sum = 0ull;
+            for (const auto op : stream) {
+                  const auto &kinds = legacy_tables.opkinds.find(op)->second.kinds;
+                  sum += kinds.size() + static_cast<std::uint64_t>(kinds.front());
+                  sum += static_cast<std::uint64_t>(legacy_tables.opencodings.find(op)->second.encodings.front());
+            }
+            bench::keep(sum);
+      };
+      const auto map_ns = bench::measure(map_lookup, stream_size);
+
+      const auto compat_lookup = [&] {
+            auto sum = 0ull;
+            for (const auto op : stream) {
+                  const auto &kinds = opkinds[op].kinds;
+                  sum += kinds.size() + static_cast<std::uint64_t>(kinds.front());
+                  sum += static_cast<std::uint64_t>(opencodings[op].encodings.front());
+            }
+            bench::keep(sum);
+      };
+      const auto compat_ns = bench::measure(compat_lookup, stream_size);
+
+      const auto flat_lookup = [&] {
+            auto sum = 0ull;
+            for (const auto op : stream) {
+                  const auto &entry = opentry(op);
+                  sum += entry.operand_count + static_cast<std::uint64_t>(entry.operands[0].kind);
+                  sum += static_cast<std::uint64_t>(entry.operands[0].encoding);
+            }
+            bench::keep(sum);
+      };
+      const auto flat_ns = bench::measure(flat_lookup, stream_size);
+
+      std::printf("first use, std::map tables    : %10.1f ns (built, cold)\n", map_first_ns);
+      std::printf("first use, constexpr tables   : %10.1f ns (every entry read, cold)\n", flat_first_ns);
+      std::printf("static init, std::map tables  : %10.1f ns per translation unit\n", init_ns);
+      std::printf("lookup, std::map              : %10.2f ns/op\n", map_ns);
+      std::printf("lookup, compat optable_map    : %10.2f ns/op\n", compat_ns);
+      std::printf("lookup, optable               : %10.2f ns/op\n", flat_ns);
+
+      return 0;
+}
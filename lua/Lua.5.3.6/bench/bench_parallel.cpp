@@ -0,0 +1,89 @@
+#include "../parallel.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+      synthetic::proto_spec make_proto(bench::rng &rng, const std::uint32_t depth) {
+            synthetic::proto_spec p;
+            p.source = "@bench.lua";
+            const auto size = 32u + rng.below(480u);
+            for (auto pc = 0u; pc < size; ++pc) {
+                  p.code.push_back((static_cast<std::uint32_t>(rng.next()) & ~op_mask) | rng.below(static_cast<std::uint32_t>(opcode_count)));
+                  p.line_info.push_back(static_cast<std::int32_t>(pc + 1u));
+            }
+            if (depth != 0u) {
+                  for (auto n = rng.below(6u); n != 0u; --n)
+                        p.protos.push_back(make_proto(rng, depth - 1u));
+            }
+            return p;
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const std::string prefix = (argc > 1) ? argv[1] : "bench_parallel_";
+      constexpr auto file_count = 64u;
+
+      bench::rng rng;
+      std::vector<std::string> paths;
+      std::vector<std::uint8_t> big;
+      for (auto i = 0u; i < file_count; ++i) {
+            const auto bytes = synthetic::chunk_writer().write(make_proto(rng, 3u));
+            paths.push_back(prefix + std::to_string(i) + ".luac");
+            std::ofstream(paths.back(), std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+      }
+      synthetic::proto_spec wide;
+      wide.source = "@wide.lua";
+      for (auto i = 0u; i < 2000u; ++i)
+            wide.protos.push_back(make_proto(rng, 0u));
+      big = synthetic::chunk_writer().write(wide);
+      const auto big_file = chunk::file::view(big.data(), big.size());
+
+      const auto hardware = (argc > 2) ? static_cast<std::uint32_t>(std::stoul(argv[2])) : std::max(1u, std::thread::hardware_concurrency());
+      std::vector<std::uint32_t> counts;
+      for (auto threads = 1u; threads < hardware; threads *= 2u)
+            counts.push_back(threads);
+      counts.push_back(hardware);
+
+      std::string reference;
+      auto files_base = 0.0;
+      auto protos_base = 0.0;
+      std::printf("%8s %14s %8s %14s %8s\n", "threads", "files ms", "speedup", "protos ms", "speedup");
+      for (const auto threads : counts) {
+            parallel::scheduler pool(threads);
+
+            std::string output;
+            const auto files = [&] {
+                  output.clear();
+                  parallel::disassemble_files(pool, paths, [&](const parallel::listing &l) { output += l.text; });
+            };
+            const auto files_ns = bench::measure(files, 1u, 3u);
+
+            const auto protos = [&] {
+                  bench::keep(parallel::disassemble_chunk(pool, *big_file).size());
+            };
+            const auto protos_ns = bench::measure(protos, 1u, 3u);
+
+            if (reference.empty())
+                  reference = output;
+            else if (output != reference)
+                  std::printf("output differs at %u threads\n", threads);
+
+            files_base = (files_base == 0.0) ? files_ns : files_base;
+            protos_base = (protos_base == 0.0) ? protos_ns : protos_base;
+            std::printf("%8u %14.2f %8.2f %14.2f %8.2f\n", threads, files_ns / 1e6, files_base / files_ns, protos_ns / 1e6, protos_base / protos_ns);
+      }
+
+      for (const auto &path : paths)
+            std::remove(path.c_str());
+      return 0;
+}
@@ -0,0 +1,82 @@
+#include "../parallel.hpp"
+#include "../profile.hpp"
+#include "bench.hpp"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+      /* What the ad-hoc scripts do: n-grams as mnemonic strings into one locked hash map. */
+      void count_naive(const std::vector<std::uint32_t> &code, std::unordered_map<std::string, std::uint64_t> &counts, std::mutex &mutex) {
+            for (auto pc = 2u; pc < code.size(); ++pc) {
+                  std::string bigram = opentry(instruction_op(code[pc - 1u])).mnemonic;
+                  bigram += ' ';
+                  bigram += opentry(instruction_op(code[pc])).mnemonic;
+                  auto trigram = std::string(opentry(instruction_op(code[pc - 2u])).mnemonic) + ' ' + bigram;
+                  std::lock_guard<std::mutex> lock(mutex);
+                  ++counts[bigram];
+                  ++counts[trigram];
+            }
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const auto threads = (argc > 1) ? static_cast<std::size_t>(std::stoul(argv[1])) : std::size_t{std::thread::hardware_concurrency()};
+      constexpr auto proto_count = 256u;
+      constexpr auto code_size = 16384u;
+
+      bench::rng rng;
+      std::vector<std::vector<std::uint32_t>> protos(proto_count);
+      for (auto &code : protos) {
+            for (auto pc = 0u; pc < code_size; ++pc)
+                  code.push_back((static_cast<std::uint32_t>(rng.next()) & ~op_mask) | rng.below(static_cast<std::uint32_t>(opcode_count)));
+      }
+      const auto total = static_cast<std::size_t>(proto_count) * code_size;
+      parallel::scheduler pool(threads);
+
+      const auto naive = [&] {
+            std::unordered_map<std::string, std::uint64_t> counts;
+            std::mutex mutex;
+            for (const auto &code : protos)
+                  pool.spawn([&] { count_naive(code, counts, mutex); });
+            pool.wait();
+            bench::keep(counts.size());
+      };
+      const auto engine = [&](const profile::options &options) {
+            return [&, options] {
+                  profile::profiler profiler(options);
+                  for (const auto &code : protos) {
+                        pool.spawn([&] {
+                              thread_local decoder::decoded scratch;
+                              decoder::decode(code.data(), code.size(), scratch);
+                              profiler.local().add(scratch.view(), code.size());
+                        });
+                  }
+                  pool.wait();
+                  bench::keep(profiler.merge().instructions);
+            };
+      };
+
+      profile::options exact;
+      profile::options sketch;
+      sketch.mode = profile::mode::sketch;
+      profile::options sketch5 = sketch;
+      sketch5.ngram_length = 5u;
+
+      std::printf("%zu instructions, %zu threads\n", total, pool.size());
+      const auto report = [&](const char *const name, const double ns) {
+            std::printf("%-22s %8.2f ns/insn %8.2f Minsn/s\n", name, ns, 1000.0 / ns);
+      };
+      report("naive strings + lock", bench::measure(naive, total, 3u));
+      report("exact 2/3-grams", bench::measure(engine(exact), total, 3u));
+      report("sketch 2..3-grams", bench::measure(engine(sketch), total, 3u));
+      report("sketch 2..5-grams", bench::measure(engine(sketch5), total, 3u));
+
+      return 0;
+}
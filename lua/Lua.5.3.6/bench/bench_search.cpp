@@ -0,0 +1,144 @@
+#include "../search.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+      synthetic::constant_spec string_constant(std::string s) {
+            synthetic::constant_spec k;
+            k.type = chunk::constant_type::short_string;
+            k.string = std::move(s);
+            return k;
+      }
+
+      /*
+            Globals called with string arguments, arithmetic on constants and a few jumps.
+            Each proto draws 8 globals out of 256 and 6 strings out of 1024, "error" and "usage" being the first of each.
+      */
+      synthetic::proto_spec make_proto(bench::rng &rng, const std::uint32_t size) {
+            using synthetic::encode_abc;
+            using synthetic::encode_abx;
+            synthetic::proto_spec p;
+            p.source = "@bench.lua";
+            p.max_stack_size = 8u;
+            p.upvalues = {{1u, 0u}};
+            p.upvalue_names = {"_ENV"};
+            for (auto i = 0u; i < 8u; ++i) {
+                  const auto name = rng.below(256u);
+                  p.constants.push_back(string_constant((name == 0u) ? "error" : "global" + std::to_string(name)));
+            }
+            for (auto i = 0u; i < 6u; ++i) {
+                  const auto s = rng.below(1024u);
+                  p.constants.push_back(string_constant((s == 0u) ? "usage" : "string" + std::to_string(s)));
+            }
+            while (p.code.size() < size) {
+                  switch (rng.below(4u)) {
+                        case 0u: {
+                              const auto s = 8u + rng.below(6u);
+                              p.code.push_back(encode_abc(opcodes::OP_GETTABUP, 1u, 0u, decoder::rk_bit | rng.below(8u)));
+                              p.code.push_back(encode_abx(opcodes::OP_LOADK, 2u, s));
+                              p.code.push_back(encode_abc(opcodes::OP_CALL, 1u, 2u, 1u));
+                              break;
+                        }
+                        case 1u:
+                              p.code.push_back(encode_abc(opcodes::OP_ADD, 3u, 3u, decoder::rk_bit | (8u + rng.below(6u))));
+                              break;
+                        case 2u:
+                              p.code.push_back(synthetic::encode_asbx(opcodes::OP_JMP, 0u, 0));
+                              break;
+                        default:
+                              p.code.push_back(encode_abc(opcodes::OP_MOVE, 4u, 3u, 0u));
+                              break;
+                  }
+            }
+            p.code.push_back(encode_abc(opcodes::OP_RETURN, 0u, 1u, 0u));
+            return p;
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      const auto directory = (argc > 1) ? std::string(argv[1]) : (std::filesystem::temp_directory_path() / "bench_search").string();
+      constexpr auto file_count = 2000u;
+      constexpr auto protos_per_file = 8u;
+      constexpr auto proto_size = 256u;
+
+      bench::rng rng;
+      synthetic::chunk_writer writer;
+      std::vector<std::vector<std::uint8_t>> chunks;
+      for (auto f = 0u; f < file_count; ++f) {
+            auto main = make_proto(rng, proto_size);
+            for (auto i = 1u; i < protos_per_file; ++i)
+                  main.protos.push_back(make_proto(rng, proto_size));
+            chunks.push_back(writer.write(main));
+      }
+      const auto total = static_cast<std::size_t>(file_count) * protos_per_file * proto_size;
+
+      const auto build = [&] {
+            std::filesystem::remove_all(directory);
+            search::writer index(directory);
+            for (auto f = 0u; f < file_count; ++f)
+                  index.add("file" + std::to_string(f) + ".luac", *chunk::file::view(chunks[f].data(), chunks[f].size()));
+            index.commit();
+      };
+      std::printf("%u files, %zu instructions\n", file_count, total);
+      std::printf("%-28s %10.2f ns/insn\n", "build index", bench::measure(build, total, 3u));
+
+      const auto index_size = [&](const char *const name) {
+            auto bytes = std::uintmax_t{0u};
+            for (const auto &entry : std::filesystem::directory_iterator(directory))
+                  bytes += entry.file_size();
+            std::printf("%-28s %10.2f bytes/insn\n", name, static_cast<double>(bytes) / static_cast<double>(total));
+      };
+      index_size("index size");
+      const auto start = bench::clock::now();
+      search::writer(directory).merge();
+      std::printf("%-28s %10.2f ns/insn\n", "merge", std::chrono::duration<double, std::nano>(bench::clock::now() - start).count() / static_cast<double>(total));
+      index_size("merged index size");
+
+      search::reader index(directory);
+
+      /* Same question answered by decoding every chunk again. */
+      const auto rescan = [&] {
+            const auto loaded = search::load_term(search::string_term("usage"));
+            const auto called = search::call_term("error");
+            search::extract_scratch scratch;
+            auto found = std::size_t{0u};
+            for (const auto &bytes : chunks) {
+                  const auto file = chunk::file::view(bytes.data(), bytes.size());
+                  const auto visit = [&](const auto &self, const chunk::proto &p) -> void {
+                        auto first = ~0u;
+                        search::extract(p, scratch, [&](const search::term t, const std::uint32_t pc) {
+                              if (t == loaded && first == ~0u)
+                                    first = pc;
+                              if (t == called && first < pc)
+                                    ++found;
+                        });
+                        for (auto i = std::size_t{0u}; i < p.proto_count(); ++i)
+                              self(self, p.child(i));
+                  };
+                  visit(visit, file->main());
+            }
+            return found;
+      };
+      const auto query = [&] {
+            bench::keep(index.calls_after_load("error", "usage").size());
+      };
+      const auto lookup = [&] {
+            bench::keep(index.find(search::global_term("error")).size());
+      };
+      std::printf("error() after a load of \"usage\": %zu calls, %zu found by rescanning\n", index.calls_after_load("error", "usage").size(), rescan());
+      std::printf("%-28s %10.2f us\n", "rescan query", bench::measure([&] { bench::keep(rescan()); }, 1u, 3u) / 1000.0);
+      std::printf("%-28s %10.2f us\n", "indexed query", bench::measure(query, 1u, 20u) / 1000.0);
+      std::printf("%-28s %10.2f us\n", "single term lookup", bench::measure(lookup, 1u, 20u) / 1000.0);
+
+      std::filesystem::remove_all(directory);
+      return 0;
+}
@@ -0,0 +1,165 @@
+#include "../cfg.hpp"
+#include "../dataflow.hpp"
+#include "../decoder.hpp"
+#include "../disasm.hpp"
+#include "bench.hpp"
+#include "synthetic.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*
+      Every decode and analysis path over one synthetic corpus, results as JSON for comparing builds:
+            bench_suite [--protos N] [--runs N] [--seed N] [--out file.json]
+      Each stage times every proto on its own for the latency percentiles, throughput is the best full pass.
+*/
+namespace {
+
+      struct stage_result {
+            const char *name;
+            double ns_per_insn;
+            std::vector<double> latencies; /* ns per proto, every run. */
+      };
+
+      void flatten(const chunk::proto &p, std::vector<const chunk::proto *> &out) {
+            out.push_back(&p);
+            for (auto i = std::size_t{0u}; i < p.proto_count(); ++i)
+                  flatten(p.child(i), out);
+      }
+
+      /* Nearest rank on sorted samples. */
+      double percentile(const std::vector<double> &sorted, const double q) {
+            if (sorted.empty())
+                  return 0.0;
+            const auto rank = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1u) + 0.5);
+            return sorted[std::min(rank, sorted.size() - 1u)];
+      }
+
+      template <typename F>
+      stage_result run(const char *const name, const std::vector<const chunk::proto *> &protos, const std::size_t instructions, const std::size_t runs, F &&work) {
+            stage_result result{name, 0.0, {}};
+            result.latencies.reserve(protos.size() * runs);
+            for (auto r = std::size_t{0u}; r < runs; ++r) {
+                  const auto pass = bench::clock::now();
+                  for (const auto p : protos) {
+                        const auto start = bench::clock::now();
+                        work(*p);
+                        result.latencies.push_back(std::chrono::duration<double, std::nano>(bench::clock::now() - start).count());
+                  }
+                  const auto ns = std::chrono::duration<double, std::nano>(bench::clock::now() - pass).count() / static_cast<double>(instructions);
+                  result.ns_per_insn = (r == 0u) ? ns : std::min(result.ns_per_insn, ns);
+            }
+            std::sort(result.latencies.begin(), result.latencies.end());
+            return result;
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      synthetic::corpus_options options;
+      options.protos = 2048u;
+      auto runs = std::size_t{5u};
+      const char *out_path = nullptr;
+      for (auto i = 1; i < argc; ++i) {
+            const auto more = i + 1 < argc;
+            if (more && std::strcmp(argv[i], "--protos") == 0)
+                  options.protos = static_cast<std::uint32_t>(std::stoul(argv[++i]));
+            else if (more && std::strcmp(argv[i], "--runs") == 0)
+                  runs = std::max<std::size_t>(std::stoul(argv[++i]), 1u);
+            else if (more && std::strcmp(argv[i], "--seed") == 0)
+                  options.seed = std::stoull(argv[++i]);
+            else if (more && std::strcmp(argv[i], "--out") == 0)
+                  out_path = argv[++i];
+            else {
+                  std::fprintf(stderr, "usage: %s [--protos N] [--runs N] [--seed N] [--out file.json]\n", argv[0]);
+                  return 1;
+            }
+      }
+
+      const auto bytes = synthetic::corpus_generator(options).chunk();
+      const auto file = chunk::file::view(bytes.data(), bytes.size());
+      std::vector<const chunk::proto *> protos;
+      flatten(file->main(), protos);
+      auto instructions = std::size_t{0u};
+      for (const auto p : protos)
+            instructions += p->code.size();
+
+      std::vector<stage_result> stages;
+
+      /* Per instruction: optable row, then every operand through its field and kind. */
+      stages.push_back(run("lookup", protos, instructions, runs, [](const chunk::proto &p) {
+            auto sum = std::uint64_t{0u};
+            const auto words = p.code.data();
+            for (auto pc = std::size_t{0u}; pc < p.code.size(); ++pc) {
+                  const auto word = decoder::detail::load_word(words + pc * 4u);
+                  const auto op = instruction_op(word);
+                  if (!opcode_valid(op))
+                        continue;
+                  const auto &entry = opentry(op);
+                  const auto &kinds = opkinds[op].kinds;
+                  for (auto i = 0u; i < entry.operand_count; ++i)
+                        sum += static_cast<std::uint64_t>(instruction_operand(word, entry.operands[i].field)) + static_cast<std::uint64_t>(kinds[i]);
+            }
+            bench::keep(sum);
+      }));
+
+      decoder::decoded code;
+      stages.push_back(run("decode", protos, instructions, runs, [&](const chunk::proto &p) {
+            p.code.decode(code);
+            bench::keep(code.op[0]);
+      }));
+
+      disasm::renderer renderer;
+      std::string text;
+      stages.push_back(run("render", protos, instructions, runs, [&](const chunk::proto &p) {
+            text.clear();
+            auto w = disasm::writer::to_string(text);
+            renderer.proto(w, p, "f");
+            w.flush();
+            bench::keep(text.size());
+      }));
+
+      cfg::builder builder;
+      stages.push_back(run("cfg", protos, instructions, runs, [&](const chunk::proto &p) {
+            p.code.decode(code);
+            bench::keep(builder.build(code).block_count);
+      }));
+
+      dataflow::liveness liveness;
+      stages.push_back(run("dataflow", protos, instructions, runs, [&](const chunk::proto &p) {
+            liveness.solve(p);
+            bench::keep(liveness.visits());
+      }));
+
+      std::string json;
+      char line[512];
+      std::snprintf(line, sizeof(line),
+                    "{\n  \"schema\": 1,\n  \"corpus\": {\"seed\": %llu, \"protos\": %zu, \"instructions\": %zu, \"bytes\": %zu},\n  \"runs\": %zu,\n  \"stages\": [\n",
+                    static_cast<unsigned long long>(options.seed), protos.size(), instructions, bytes.size(), runs);
+      json += line;
+      for (auto i = std::size_t{0u}; i < stages.size(); ++i) {
+            const auto &s = stages[i];
+            std::snprintf(line, sizeof(line),
+                          "    {\"name\": \"%s\", \"ns_per_insn\": %.3f, \"minsn_per_s\": %.2f, \"latency_ns\": {\"p50\": %.0f, \"p90\": %.0f, \"p99\": %.0f, \"max\": %.0f}}%s\n",
+                          s.name, s.ns_per_insn, 1000.0 / s.ns_per_insn, percentile(s.latencies, 0.50), percentile(s.latencies, 0.90), percentile(s.latencies, 0.99),
+                          s.latencies.empty() ? 0.0 : s.latencies.back(), (i + 1u < stages.size()) ? "," : "");
+            json += line;
+      }
+      json += "  ]\n}\n";
+
+      if (out_path == nullptr) {
+            std::fwrite(json.data(), 1u, json.size(), stdout);
+            return 0;
+      }
+      const auto out = std::fopen(out_path, "wb");
+      const auto written = out != nullptr && std::fwrite(json.data(), 1u, json.size(), out) == json.size();
+      if ((out != nullptr && std::fclose(out) != 0) || !written) {
+            std::fprintf(stderr, "cannot write %s\n", out_path);
+            return 1;
+      }
+      return 0;
+}
@@ -0,0 +1,516 @@
+#pragma once
+
+#include "../chunk.hpp"
+#include "../decoder.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+/* In-memory luac 5.3 chunks for benchmarks, written in the same layout lundump.c reads. */
+namespace synthetic {
+
+      struct constant_spec {
+            chunk::constant_type type = chunk::constant_type::nil;
+            bool boolean = false;
+            std::int64_t integer = 0;
+            double number = 0.0;
+            std::string string;
+      };
+
+      struct local_spec {
+            std::string name;
+            std::int32_t start_pc;
+            std::int32_t end_pc;
+      };
+
+      struct proto_spec {
+            std::string source;
+            std::int32_t line_defined = 0;
+            std::int32_t last_line_defined = 0;
+            std::uint8_t param_count = 0u;
+            std::uint8_t is_vararg = 0u;
+            std::uint8_t max_stack_size = 2u;
+            std::vector<std::uint32_t> code;
+            std::vector<constant_spec> constants;
+            std::vector<chunk::upvalue> upvalues;
+            std::vector<proto_spec> protos;
+            std::vector<std::int32_t> line_info;
+            std::vector<local_spec> locals;
+            std::vector<std::string> upvalue_names;
+      };
+
+      class chunk_writer {
+          public:
+            std::vector<std::uint8_t> write(const proto_spec &main) {
+                  out.clear();
+                  bytes(chunk::signature, 4u);
+                  byte(chunk::version);
+                  byte(chunk::format);
+                  bytes(chunk::luac_data, 6u);
+                  byte(4u); /* int */
+                  byte(8u); /* size_t */
+                  byte(4u); /* Instruction */
+                  byte(8u); /* lua_Integer */
+                  byte(8u); /* lua_Number */
+                  value(chunk::luac_int);
+                  value(chunk::luac_num);
+                  byte(static_cast<std::uint8_t>(main.upvalues.size()));
+                  function(main, {});
+                  return std::move(out);
+            }
+
+          private:
+            std::vector<std::uint8_t> out;
+
+            void bytes(const void *const data, const std::size_t n) {
+                  const auto at = static_cast<const std::uint8_t *>(data);
+                  out.insert(out.end(), at, at + n);
+            }
+
+            void byte(const std::uint8_t b) {
+                  out.push_back(b);
+            }
+
+            template <typename T>
+            void value(const T v) {
+                  bytes(&v, sizeof(T));
+            }
+
+            void integer(const std::size_t v) {
+                  value(static_cast<std::int32_t>(v));
+            }
+
+            void string(const std::string &s, const bool null = false) {
+                  if (null) {
+                        byte(0u);
+                        return;
+                  }
+                  const auto size = s.size() + 1u;
+                  if (size < 0xFFu) {
+                        byte(static_cast<std::uint8_t>(size));
+                  } else {
+                        byte(0xFFu);
+                        value(static_cast<std::uint64_t>(size));
+                  }
+                  bytes(s.data(), s.size());
+            }
+
+            void function(const proto_spec &p, const std::string &parent_source) {
+                  string(p.source, p.source == parent_source);
+                  value(p.line_defined);
+                  value(p.last_line_defined);
+                  byte(p.param_count);
+                  byte(p.is_vararg);
+                  byte(p.max_stack_size);
+
+                  integer(p.code.size());
+                  for (const auto word : p.code)
+                        value(word);
+
+                  integer(p.constants.size());
+                  for (const auto &k : p.constants) {
+                        byte(static_cast<std::uint8_t>(k.type));
+                        switch (k.type) {
+                              case chunk::constant_type::boolean:
+                                    byte(k.boolean ? 1u : 0u);
+                                    break;
+                              case chunk::constant_type::number:
+                                    value(k.number);
+                                    break;
+                              case chunk::constant_type::integer:
+                                    value(k.integer);
+                                    break;
+                              case chunk::constant_type::short_string:
+                              case chunk::constant_type::long_string:
+                                    string(k.string);
+                                    break;
+                              default:
+                                    break;
+                        }
+                  }
+
+                  integer(p.upvalues.size());
+                  for (const auto &upvalue : p.upvalues) {
+                        byte(upvalue.instack);
+                        byte(upvalue.idx);
+                  }
+
+                  integer(p.protos.size());
+                  for (const auto &child : p.protos)
+                        function(child, p.source);
+
+                  integer(p.line_info.size());
+                  for (const auto line : p.line_info)
+                        value(line);
+                  integer(p.locals.size());
+                  for (const auto &local : p.locals) {
+                        string(local.name);
+                        value(local.start_pc);
+                        value(local.end_pc);
+                  }
+                  integer(p.upvalue_names.size());
+                  for (const auto &name : p.upvalue_names)
+                        string(name);
+            }
+      };
+
+      /* Packs an instruction word from raw fields. */
+      constexpr std::uint32_t encode_abc(const opcodes op, const std::uint32_t a, const std::uint32_t b, const std::uint32_t c) {
+            return static_cast<std::uint32_t>(op) | (a << 6u) | (c << 14u) | (b << 23u);
+      }
+
+      constexpr std::uint32_t encode_abx(const opcodes op, const std::uint32_t a, const std::uint32_t bx) {
+            return static_cast<std::uint32_t>(op) | (a << 6u) | (bx << 14u);
+      }
+
+      constexpr std::uint32_t encode_asbx(const opcodes op, const std::uint32_t a, const std::int32_t sbx) {
+            return encode_abx(op, a, static_cast<std::uint32_t>(sbx + field_of(operand_encoding::sBx).bias));
+      }
+
+      constexpr std::uint32_t encode_ax(const opcodes op, const std::uint32_t ax) {
+            return static_cast<std::uint32_t>(op) | (ax << 6u);
+      }
+
+      /* Rough static opcode mix of luac output, indexed by opcode. Pairs (FORPREP/FORLOOP, ...) are emitted as a unit by their first opcode. */
+      inline constexpr std::uint8_t opcode_weights[opcode_count] = {
+            12u, /* MOVE */
+            9u,  /* LOADK */
+            0u,  /* LOADKX, see corpus_options::loadkx_every */
+            2u,  /* LOADBOOL */
+            1u,  /* LOADNIL */
+            4u,  /* GETUPVAL */
+            10u, /* GETTABUP */
+            7u,  /* GETTABLE */
+            2u,  /* SETTABUP */
+            1u,  /* SETUPVAL */
+            5u,  /* SETTABLE */
+            2u,  /* NEWTABLE */
+            4u,  /* SELF */
+            2u,  /* ADD */
+            1u,  /* SUB */
+            1u,  /* MUL */
+            1u,  /* MOD */
+            1u,  /* POW */
+            1u,  /* DIV */
+            1u,  /* IDIV */
+            1u,  /* BAND */
+            1u,  /* BOR */
+            1u,  /* BXOR */
+            1u,  /* SHL */
+            1u,  /* SHR */
+            1u,  /* UNM */
+            1u,  /* BNOT */
+            1u,  /* NOT */
+            1u,  /* LEN */
+            2u,  /* CONCAT */
+            5u,  /* JMP */
+            3u,  /* EQ, followed by its OP_JMP */
+            1u,  /* LT */
+            1u,  /* LE */
+            4u,  /* TEST */
+            1u,  /* TESTSET */
+            9u,  /* CALL */
+            1u,  /* TAILCALL */
+            2u,  /* RETURN */
+            0u,  /* FORLOOP, closes FORPREP */
+            1u,  /* FORPREP */
+            1u,  /* TFORCALL, JMP / TFORCALL / TFORLOOP */
+            0u,  /* TFORLOOP */
+            1u,  /* SETLIST */
+            2u,  /* CLOSURE, only with children */
+            1u,  /* VARARG */
+            0u   /* EXTRAARG, only after LOADKX / SETLIST */
+      };
+
+      struct corpus_options {
+            std::uint64_t seed = 0x9E3779B97F4A7C15ull;
+            std::uint32_t protos = 256u;        /* Whole tree, main included. */
+            std::uint32_t max_children = 4u;
+            std::uint32_t min_code = 16u;
+            std::uint32_t max_code = 512u;
+            std::uint32_t constants = 64u;
+            std::uint8_t max_stack_size = 32u;
+            std::uint32_t loadkx_every = 512u;  /* About one OP_LOADKX + OP_EXTRAARG per this many instructions, 0 for none. */
+            bool debug_info = true;             /* Line info, locals and upvalue names. */
+      };
+
+      /*
+            Well formed random protos from the optable: operands stay inside their field widths and the limits of the proto
+            (registers below max_stack_size, constants, upvalues and children in range), every jump lands on an instruction,
+            comparisons and tests are followed by OP_JMP, loops come in matching pairs and code ends in OP_RETURN.
+      */
+      class corpus_generator {
+          public:
+            explicit corpus_generator(const corpus_options &settings = {}) : config(settings) {
+                  random.state = settings.seed | 1u;
+                  auto total = 0u;
+                  for (const auto w : opcode_weights)
+                        total += w;
+                  weight_total = total;
+            }
+
+            /* One main proto holding `protos` functions in a random tree. */
+            proto_spec tree() {
+                  std::vector<std::vector<std::uint32_t>> children(1u);
+                  std::deque<std::uint32_t> open(1u, 0u);
+                  while (children.size() < config.protos && !open.empty()) {
+                        const auto parent = open.front();
+                        open.pop_front();
+                        const auto count = std::min<std::size_t>(1u + random.below(std::max(config.max_children, 1u)), config.protos - children.size());
+                        for (auto i = std::size_t{0u}; i < count; ++i) {
+                              const auto id = static_cast<std::uint32_t>(children.size());
+                              open.push_back(id);
+                              children[parent].push_back(id);
+                              children.emplace_back();
+                        }
+                  }
+                  return build(children, 0u, "@synthetic.lua", 0);
+            }
+
+            std::vector<std::uint8_t> chunk() {
+                  return chunk_writer().write(tree());
+            }
+
+            /* Code only, `children` bounds the OP_CLOSURE indices. */
+            std::vector<std::uint32_t> code(const std::uint32_t count, const std::uint32_t children, const std::uint32_t constants, const std::uint32_t upvalues) {
+                  const auto n = std::max(count, 2u);
+                  std::vector<std::uint32_t> out;
+                  std::vector<std::uint8_t> data(n, 0u); /* 1 where the word is an OP_EXTRAARG, never a jump target. */
+                  std::vector<std::uint32_t> jumps;      /* OP_JMP positions whose targets are picked at the end. */
+                  const auto stack = std::max<std::uint32_t>(config.max_stack_size, 8u);
+                  const auto reg = [&] { return random.below(stack); };
+                  const auto rk = [&] { return (constants != 0u && random.below(2u) != 0u) ? (decoder::rk_bit | random.below(std::min(constants, 256u))) : reg(); };
+                  const auto constant = [&] { return (constants != 0u) ? random.below(constants) : 0u; };
+                  const auto upvalue = [&] { return (upvalues != 0u) ? random.below(upvalues) : 0u; };
+                  const auto fits = [&](const std::uint32_t more) { return out.size() + more < n; };
+
+                  while (out.size() + 1u < n) {
+                        if (config.loadkx_every != 0u && fits(2u) && random.below(config.loadkx_every) == 0u) {
+                              out.push_back(encode_abx(opcodes::OP_LOADKX, reg(), 0u));
+                              data[out.size()] = 1u;
+                              out.push_back(encode_ax(opcodes::OP_EXTRAARG, constant()));
+                              continue;
+                        }
+                        const auto op = pick();
+                        switch (op) {
+                              case opcodes::OP_LOADK:
+                                    out.push_back(encode_abx(op, reg(), constant()));
+                                    break;
+                              case opcodes::OP_LOADBOOL: {
+                                    /* A skipping load comes with the load it skips, as luac emits for `a = x < y`, so it never lands on an OP_EXTRAARG. */
+                                    const auto a = reg();
+                                    if (fits(2u) && random.below(2u) != 0u) {
+                                          out.push_back(encode_abc(op, a, 0u, 1u));
+                                          out.push_back(encode_abc(op, a, 1u, 0u));
+                                    } else {
+                                          out.push_back(encode_abc(op, a, random.below(2u), 0u));
+                                    }
+                                    break;
+                              }
+                              case opcodes::OP_LOADNIL: {
+                                    const auto a = reg();
+                                    out.push_back(encode_abc(op, a, random.below(stack - a), 0u));
+                                    break;
+                              }
+                              case opcodes::OP_GETUPVAL:
+                              case opcodes::OP_SETUPVAL:
+                                    out.push_back(encode_abc(op, reg(), upvalue(), 0u));
+                                    break;
+                              case opcodes::OP_GETTABUP:
+                                    out.push_back(encode_abc(op, reg(), upvalue(), rk()));
+                                    break;
+                              case opcodes::OP_SETTABUP:
+                                    out.push_back(encode_abc(op, upvalue(), rk(), rk()));
+                                    break;
+                              case opcodes::OP_GETTABLE:
+                                    out.push_back(encode_abc(op, reg(), reg(), rk()));
+                                    break;
+                              case opcodes::OP_SELF: {
+                                    const auto a = random.below(stack - 1u);
+                                    out.push_back(encode_abc(op, a, reg(), rk()));
+                                    break;
+                              }
+                              case opcodes::OP_NEWTABLE:
+                                    out.push_back(encode_abc(op, reg(), random.below(field_of(operand_encoding::B).mask + 1u), random.below(field_of(operand_encoding::C).mask + 1u)));
+                                    break;
+                              case opcodes::OP_CONCAT: {
+                                    const auto b = random.below(stack - 1u);
+                                    out.push_back(encode_abc(op, reg(), b, b + 1u + random.below(stack - b - 1u)));
+                                    break;
+                              }
+                              case opcodes::OP_JMP:
+                                    jumps.push_back(static_cast<std::uint32_t>(out.size()));
+                                    out.push_back(encode_asbx(op, 0u, 0));
+                                    break;
+                              case opcodes::OP_EQ:
+                              case opcodes::OP_LT:
+                              case opcodes::OP_LE:
+                              case opcodes::OP_TEST:
+                              case opcodes::OP_TESTSET:
+                                    if (!fits(2u))
+                                          continue;
+                                    if (op == opcodes::OP_TEST)
+                                          out.push_back(encode_abc(op, reg(), 0u, random.below(2u)));
+                                    else if (op == opcodes::OP_TESTSET)
+                                          out.push_back(encode_abc(op, reg(), reg(), random.below(2u)));
+                                    else
+                                          out.push_back(encode_abc(op, random.below(2u), rk(), rk()));
+                                    jumps.push_back(static_cast<std::uint32_t>(out.size()));
+                                    out.push_back(encode_asbx(opcodes::OP_JMP, 0u, 0));
+                                    break;
+                              case opcodes::OP_CALL:
+                              case opcodes::OP_TAILCALL: {
+                                    const auto a = random.below(stack - 2u);
+                                    out.push_back(encode_abc(op, a, random.below(std::min(4u, stack - a)), random.below(4u)));
+                                    break;
+                              }
+                              case opcodes::OP_RETURN: {
+                                    const auto a = reg();
+                                    out.push_back(encode_abc(op, a, random.below(std::min(4u, stack - a + 1u)), 0u));
+                                    break;
+                              }
+                              case opcodes::OP_FORPREP: {
+                                    /* FORPREP a, body, FORLOOP a jumping back to the body. */
+                                    const auto body = random.below(4u);
+                                    if (!fits(body + 2u))
+                                          continue;
+                                    const auto a = random.below(stack - 3u);
+                                    out.push_back(encode_asbx(op, a, static_cast<std::int32_t>(body)));
+                                    for (auto i = 0u; i < body; ++i)
+                                          out.push_back(encode_abc(opcodes::OP_MOVE, reg(), a + 3u, 0u));
+                                    out.push_back(encode_asbx(opcodes::OP_FORLOOP, a, -static_cast<std::int32_t>(body) - 1));
+                                    break;
+                              }
+                              case opcodes::OP_TFORCALL: {
+                                    /* JMP to TFORCALL, body, TFORCALL a, TFORLOOP a + 2 back to the body. */
+                                    const auto body = random.below(4u);
+                                    if (!fits(body + 3u))
+                                          continue;
+                                    const auto a = random.below(stack - 4u);
+                                    out.push_back(encode_asbx(opcodes::OP_JMP, 0u, static_cast<std::int32_t>(body)));
+                                    for (auto i = 0u; i < body; ++i)
+                                          out.push_back(encode_abc(opcodes::OP_MOVE, reg(), a + 3u, 0u));
+                                    out.push_back(encode_abc(op, a, 0u, 1u + random.below(2u)));
+                                    out.push_back(encode_asbx(opcodes::OP_TFORLOOP, a + 2u, -static_cast<std::int32_t>(body) - 2));
+                                    break;
+                              }
+                              case opcodes::OP_SETLIST: {
+                                    const auto a = random.below(stack - 1u);
+                                    if (fits(2u) && random.below(8u) == 0u) {
+                                          out.push_back(encode_abc(op, a, random.below(stack - a), 0u));
+                                          data[out.size()] = 1u;
+                                          out.push_back(encode_ax(opcodes::OP_EXTRAARG, 1u + random.below(1024u)));
+                                    } else {
+                                          out.push_back(encode_abc(op, a, random.below(stack - a), 1u + random.below(field_of(operand_encoding::C).mask)));
+                                    }
+                                    break;
+                              }
+                              case opcodes::OP_CLOSURE:
+                                    if (children == 0u)
+                                          continue;
+                                    out.push_back(encode_abx(op, reg(), random.below(children)));
+                                    break;
+                              case opcodes::OP_VARARG: {
+                                    const auto a = reg();
+                                    out.push_back(encode_abc(op, a, random.below(std::min(4u, stack - a + 1u)), 0u));
+                                    break;
+                              }
+                              default:
+                                    /* Register and RK operands per the optable kinds (MOVE, arithmetic, unary ops, SETTABLE). */
+                                    out.push_back(generic(op, reg, rk));
+                                    break;
+                        }
+                  }
+                  out.push_back(encode_abc(opcodes::OP_RETURN, 0u, 1u, 0u));
+
+                  /* Jump targets: any instruction start, sBx relative to the next instruction. */
+                  for (const auto at : jumps) {
+                        auto target = random.below(static_cast<std::uint32_t>(out.size()));
+                        while (data[target] != 0u)
+                              --target;
+                        out[at] = encode_asbx(opcodes::OP_JMP, 0u, static_cast<std::int32_t>(target) - static_cast<std::int32_t>(at) - 1);
+                  }
+                  return out;
+            }
+
+          private:
+            corpus_options config;
+            bench::rng random;
+            std::uint32_t weight_total = 0u;
+
+            opcodes pick() {
+                  auto roll = random.below(weight_total);
+                  for (auto op = 0u; op < opcode_count; ++op) {
+                        if (roll < opcode_weights[op])
+                              return static_cast<opcodes>(op);
+                        roll -= opcode_weights[op];
+                  }
+                  return opcodes::OP_MOVE;
+            }
+
+            template <typename Reg, typename Rk>
+            static std::uint32_t generic(const opcodes op, Reg &reg, Rk &rk) {
+                  const auto &entry = opentry(op);
+                  auto word = static_cast<std::uint32_t>(op);
+                  const auto rk_slots = decoder::rk_mask_of(op);
+                  for (auto i = 0u; i < entry.operand_count; ++i) {
+                        const auto &operand = entry.operands[i];
+                        const auto slot = (operand.encoding == operand_encoding::B) ? decoder::rk_b : (operand.encoding == operand_encoding::C) ? decoder::rk_c : 0u;
+                        const auto value = (rk_slots & slot) ? rk() : reg();
+                        word |= (value & operand.field.mask) << operand.field.shift;
+                  }
+                  return word;
+            }
+
+            proto_spec build(const std::vector<std::vector<std::uint32_t>> &children, const std::uint32_t self, const std::string &source, const std::int32_t line) {
+                  proto_spec p;
+                  p.source = source;
+                  p.line_defined = line;
+                  p.max_stack_size = std::max<std::uint8_t>(config.max_stack_size, 8u);
+                  p.upvalues.push_back(chunk::upvalue{static_cast<std::uint8_t>(self == 0u ? 1u : 0u), 0u});
+                  for (auto i = random.below(3u); i > 0u; --i)
+                        p.upvalues.push_back(chunk::upvalue{static_cast<std::uint8_t>(random.below(2u)), static_cast<std::uint8_t>(random.below(p.max_stack_size))});
+                  const auto constant_count = config.constants / 2u + random.below(config.constants / 2u + 1u);
+                  for (auto i = 0u; i < constant_count; ++i) {
+                        constant_spec k;
+                        switch (random.below(4u)) {
+                              case 0u:
+                                    k.type = chunk::constant_type::integer;
+                                    k.integer = static_cast<std::int64_t>(random.below(100000u));
+                                    break;
+                              case 1u:
+                                    k.type = chunk::constant_type::number;
+                                    k.number = static_cast<double>(random.below(100000u)) / 64.0;
+                                    break;
+                              default:
+                                    k.type = chunk::constant_type::short_string;
+                                    k.string = "k" + std::to_string(random.below(4096u));
+                                    break;
+                        }
+                        p.constants.push_back(std::move(k));
+                  }
+                  const auto size = config.min_code + random.below(std::max(config.max_code, config.min_code) - config.min_code + 1u);
+                  p.code = code(size, static_cast<std::uint32_t>(children[self].size()), constant_count, static_cast<std::uint32_t>(p.upvalues.size()));
+                  p.last_line_defined = line + static_cast<std::int32_t>(p.code.size() / 3u) + 1;
+                  if (config.debug_info) {
+                        for (auto pc = 0u; pc < p.code.size(); ++pc)
+                              p.line_info.push_back(line + static_cast<std::int32_t>(pc / 3u));
+                        p.upvalue_names.push_back("_ENV");
+                        for (auto i = 1u; i < p.upvalues.size(); ++i)
+                              p.upvalue_names.push_back("u" + std::to_string(i));
+                        for (auto r = 0u; r < p.param_count + 2u && r < p.max_stack_size; ++r)
+                              p.locals.push_back(local_spec{"l" + std::to_string(r), 0, static_cast<std::int32_t>(p.code.size())});
+                  }
+                  for (const auto child : children[self])
+                        p.protos.push_back(build(children, child, source, p.last_line_defined + 1));
+                  return p;
+            }
+      };
+
+} // namespace synthetic
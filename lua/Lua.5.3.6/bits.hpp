@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+/*
+      Bit scans, population count and the wide multiply on 64 bit words.
+      GCC and Clang builtins, MSVC intrinsics on x64, plain loops everywhere else.
+*/
+namespace bits {
+
+      inline std::uint32_t popcount(const std::uint64_t x) {
+#if defined(__GNUC__)
+            return static_cast<std::uint32_t>(__builtin_popcountll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            return static_cast<std::uint32_t>(__popcnt64(x));
+#else
+            auto n = 0u;
+            for (auto v = x; v != 0u; v &= v - 1u)
+                  ++n;
+            return n;
+#endif
+      }
+
+      /* Index of the lowest set bit, x != 0. */
+      inline std::uint32_t countr_zero(const std::uint64_t x) {
+#if defined(__GNUC__)
+            return static_cast<std::uint32_t>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanForward64(&index, x);
+            return static_cast<std::uint32_t>(index);
+#else
+            auto n = 0u;
+            for (auto v = x; (v & 1u) == 0u; v >>= 1u)
+                  ++n;
+            return n;
+#endif
+      }
+
+      /* Bits needed to hold x, 0 for 0. */
+      inline std::uint32_t bit_width(const std::uint64_t x) {
+            if (x == 0u)
+                  return 0u;
+#if defined(__GNUC__)
+            return 64u - static_cast<std::uint32_t>(__builtin_clzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+            unsigned long index;
+            _BitScanReverse64(&index, x);
+            return static_cast<std::uint32_t>(index) + 1u;
+#else
+            auto n = 0u;
+            for (auto v = x; v != 0u; v >>= 1u)
+                  ++n;
+            return n;
+#endif
+      }
+
+      /* 64x64 -> 128 multiply, returns the low half. */
+      inline std::uint64_t multiply(const std::uint64_t a, const std::uint64_t b, std::uint64_t &high) {
+#if defined(__SIZEOF_INT128__)
+            const auto product = static_cast<unsigned __int128>(a) * b;
+            high = static_cast<std::uint64_t>(product >> 64u);
+            return static_cast<std::uint64_t>(product);
+#elif defined(_MSC_VER) && defined(_M_X64)
+            return _umul128(a, b, &high);
+#else
+            /* Schoolbook on 32 bit halves. */
+            const auto a_low = a & 0xFFFFFFFFu;
+            const auto a_high = a >> 32u;
+            const auto b_low = b & 0xFFFFFFFFu;
+            const auto b_high = b >> 32u;
+            const auto low_low = a_low * b_low;
+            const auto high_low = a_high * b_low;
+            const auto low_high = a_low * b_high;
+            const auto cross = (low_low >> 32u) + (high_low & 0xFFFFFFFFu) + low_high;
+            high = a_high * b_high + (high_low >> 32u) + (cross >> 32u);
+            return (cross << 32u) | (low_low & 0xFFFFFFFFu);
+#endif
+      }
+
+} // namespace bits
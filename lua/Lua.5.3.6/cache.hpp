@@ -0,0 +1,583 @@
+#pragma once
+
+#include "bits.hpp"
+#include "cfg.hpp"
+#include "chunk.hpp"
+#include "dataflow.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+      Content-addressed cache of decoded and analyzed protos, an in-memory LRU in front of a directory of entries.
+
+      The key hashes a proto's code, constants and the header fields analysis depends on, so identical functions
+      share one entry whichever chunk or parent they come from. Of the children only their upvalue descriptors are
+      part of the key, since a closure reads the registers it captures.
+
+      Entry files, little endian, named by key under a 256-way fan out (ab/ab...ef.lpa):
+            header   48 bytes  "LPAC", version, frame, counts, flags, set width, key, hash of everything after the header
+            code     op, a, rk (u8), b, c (u16) per instruction, bx / sBx / Ax are rebuilt from them
+            blocks   start, end (u32) per block
+            edges    from, to (u32 block ids), kind (u8) per edge
+            sets     live in, live out, uses, defs per block, only the low `set width` 64 bit words of each
+*/
+namespace cache {
+
+      struct cache_error : std::runtime_error {
+            using std::runtime_error::runtime_error;
+      };
+
+      struct key {
+            std::uint64_t lo = 0u;
+            std::uint64_t hi = 0u;
+
+            friend bool operator==(const key &l, const key &r) {
+                  return l.lo == r.lo && l.hi == r.hi;
+            }
+
+            friend bool operator!=(const key &l, const key &r) {
+                  return !(l == r);
+            }
+
+            std::string hex() const {
+                  char text[33];
+                  std::snprintf(text, sizeof(text), "%016llx%016llx", static_cast<unsigned long long>(hi), static_cast<unsigned long long>(lo));
+                  return text;
+            }
+      };
+
+      struct key_hash {
+            std::size_t operator()(const key &k) const {
+                  return static_cast<std::size_t>(k.lo);
+            }
+      };
+
+      namespace detail {
+
+            constexpr std::uint64_t prime0 = 0xa0761d6478bd642full;
+            constexpr std::uint64_t prime1 = 0xe7037ed1a0b428dbull;
+            constexpr std::uint64_t prime2 = 0x8ebc6af09c88c6e3ull;
+            constexpr std::uint64_t prime3 = 0x589965cc75374cc3ull;
+
+            /* 64x64 -> 128 multiply, halves xored. */
+            inline std::uint64_t fold(const std::uint64_t a, const std::uint64_t b) {
+                  std::uint64_t high;
+                  const auto low = bits::multiply(a, b, high);
+                  return low ^ high;
+            }
+
+            template <typename T>
+            inline T load(const std::uint8_t *const bytes) {
+                  T value;
+                  std::memcpy(&value, bytes, sizeof(T));
+                  return value;
+            }
+
+            template <typename T>
+            inline void store(std::uint8_t *const bytes, const T value) {
+                  std::memcpy(bytes, &value, sizeof(T));
+            }
+
+      } // namespace detail
+
+      /* Two 64 bit multiply-fold lanes over 16 byte blocks, chained through `seed`. Fast, not collision resistant against crafted input. */
+      inline key hash(const void *const data, const std::size_t size, const key seed = {}) {
+            const auto bytes = static_cast<const std::uint8_t *>(data);
+            auto lo = seed.lo ^ detail::prime0;
+            auto hi = seed.hi ^ detail::prime1;
+            auto at = std::size_t{0u};
+            for (; at + 16u <= size; at += 16u) {
+                  const auto a = detail::load<std::uint64_t>(bytes + at);
+                  const auto b = detail::load<std::uint64_t>(bytes + at + 8u);
+                  lo = detail::fold(lo ^ a, detail::prime1) + b;
+                  hi = detail::fold(hi ^ b, detail::prime2) + a;
+            }
+            std::uint8_t tail[16]{};
+            if (size != at)
+                  std::memcpy(tail, bytes + at, size - at);
+            lo = detail::fold(lo ^ detail::load<std::uint64_t>(tail), detail::prime1) + size;
+            hi = detail::fold(hi ^ detail::load<std::uint64_t>(tail + 8u), detail::prime2) + size;
+            return {detail::fold(lo ^ detail::prime0, hi ^ detail::prime3), detail::fold(hi ^ detail::prime2, lo ^ detail::prime1)};
+      }
+
+      /* Code, constants, the header fields the analysis reads and the upvalue descriptors of children (closures read what they capture). */
+      inline key key_of(const chunk::proto &p) {
+            const std::uint8_t shape[4] = {p.max_stack_size, p.param_count, p.is_vararg, static_cast<std::uint8_t>(p.upvalues.size())};
+            auto k = hash(shape, sizeof(shape));
+            k = hash(p.code.data(), p.code.size() * 4u, k);
+            for (auto i = std::size_t{0u}; i < p.constants.size(); ++i) {
+                  const auto c = p.constants[i];
+                  std::uint8_t scalar[9];
+                  scalar[0] = static_cast<std::uint8_t>(c.type);
+                  switch (c.type) {
+                        case chunk::constant_type::boolean:
+                              scalar[1] = c.boolean ? 1u : 0u;
+                              k = hash(scalar, 2u, k);
+                              break;
+                        case chunk::constant_type::integer:
+                              detail::store(scalar + 1, c.integer);
+                              k = hash(scalar, 9u, k);
+                              break;
+                        case chunk::constant_type::number:
+                              detail::store(scalar + 1, c.number);
+                              k = hash(scalar, 9u, k);
+                              break;
+                        case chunk::constant_type::short_string:
+                        case chunk::constant_type::long_string:
+                              detail::store(scalar + 1, static_cast<std::uint64_t>(c.string.size()));
+                              k = hash(scalar, 9u, k);
+                              k = hash(c.string.data(), c.string.size(), k);
+                              break;
+                        default:
+                              k = hash(scalar, 1u, k);
+                              break;
+                  }
+            }
+            for (auto i = std::size_t{0u}; i < p.proto_count(); ++i) {
+                  const auto &upvalues = p.child(i).upvalues;
+                  std::uint8_t count[4];
+                  detail::store(count, static_cast<std::uint32_t>(upvalues.size()));
+                  k = hash(count, sizeof(count), k);
+                  k = hash(upvalues.data(), upvalues.size() * 2u, k);
+            }
+            return k;
+      }
+
+      /* Everything a proto's decode, CFG build and liveness pass produce, owning. */
+      struct analysis {
+            struct span {
+                  std::uint32_t start;
+                  std::uint32_t end;
+            };
+
+            struct flow_edge {
+                  std::uint32_t from;
+                  std::uint32_t to;
+                  cfg::edge_kind kind;
+            };
+
+            decoder::decoded code;
+            std::vector<span> blocks;
+            std::vector<flow_edge> edges;
+            std::vector<dataflow::regset> live_in;
+            std::vector<dataflow::regset> live_out;
+            std::vector<dataflow::regset> uses;
+            std::vector<dataflow::regset> defs;
+            std::uint32_t frame = 0u;
+            bool malformed = false;
+
+            /* Heap footprint, what the memory tier budgets against. */
+            std::size_t bytes() const {
+                  return code.size() * 19u + blocks.size() * (sizeof(span) + 4u * sizeof(dataflow::regset)) + edges.size() * sizeof(flow_edge) + sizeof(analysis);
+            }
+      };
+
+      /* Runs the passes, `solver` is scratch so repeated calls do not allocate. */
+      inline analysis analyze(const chunk::proto &p, dataflow::liveness &solver) {
+            solver.solve(p);
+            analysis out;
+            out.code = solver.instructions();
+            out.frame = p.max_stack_size;
+            const auto &graph = solver.blocks();
+            out.malformed = graph.malformed;
+            out.blocks.reserve(graph.block_count);
+            out.edges.reserve(graph.edge_count);
+            for (auto b = 0u; b < graph.block_count; ++b) {
+                  const auto &block = *graph.blocks[b];
+                  out.blocks.push_back({block.start, block.end});
+                  for (auto e = block.succs; e != nullptr; e = e->next_succ)
+                        out.edges.push_back({e->from->id, e->to->id, e->kind});
+                  out.live_in.push_back(solver.live_in(b));
+                  out.live_out.push_back(solver.live_out(b));
+                  out.uses.push_back(solver.uses(b));
+                  out.defs.push_back(solver.defs(b));
+            }
+            return out;
+      }
+
+      constexpr char magic[] = "LPAC";
+      constexpr std::uint16_t version = 1u;
+      constexpr std::size_t header_size = 48u;
+      constexpr std::uint8_t flag_malformed = 1u << 0u;
+
+      namespace detail {
+
+            constexpr std::size_t set_words_max = sizeof(dataflow::regset) / 8u;
+
+            /* Words needed to hold every register any set mentions, most frames fit in one. */
+            inline std::size_t set_words(const analysis &a) {
+                  auto used = std::size_t{0u};
+                  for (const auto *const sets : {&a.live_in, &a.live_out, &a.uses, &a.defs}) {
+                        for (const auto &set : *sets) {
+                              for (auto w = used; w < set_words_max; ++w) {
+                                    if (set.words[w] != 0u)
+                                          used = w + 1u;
+                              }
+                        }
+                  }
+                  return used;
+            }
+
+            inline std::size_t entry_size(const std::size_t n, const std::size_t blocks, const std::size_t edges, const std::size_t words) {
+                  return header_size + n * 7u + blocks * (8u + 4u * 8u * words) + edges * 9u;
+            }
+
+      } // namespace detail
+
+      inline std::vector<std::uint8_t> serialize(const analysis &a, const key &k) {
+            const auto n = a.code.size();
+            const auto blocks = a.blocks.size();
+            const auto edges = a.edges.size();
+            const auto words = detail::set_words(a);
+            std::vector<std::uint8_t> out(detail::entry_size(n, blocks, edges, words));
+            std::memcpy(out.data(), magic, 4u);
+            detail::store(out.data() + 4u, version);
+            detail::store(out.data() + 6u, static_cast<std::uint16_t>(a.frame));
+            detail::store(out.data() + 8u, static_cast<std::uint32_t>(n));
+            detail::store(out.data() + 12u, static_cast<std::uint32_t>(blocks));
+            detail::store(out.data() + 16u, static_cast<std::uint32_t>(edges));
+            detail::store(out.data() + 20u, a.malformed ? flag_malformed : std::uint8_t{0u});
+            detail::store(out.data() + 21u, static_cast<std::uint8_t>(words));
+            detail::store(out.data() + 24u, k.lo);
+            detail::store(out.data() + 32u, k.hi);
+
+            auto at = out.data() + header_size;
+            const auto put = [&](const void *const data, const std::size_t size) {
+                  if (size != 0u)
+                        std::memcpy(at, data, size);
+                  at += size;
+            };
+            put(a.code.op.data(), n);
+            put(a.code.a.data(), n);
+            put(a.code.rk.data(), n);
+            put(a.code.b.data(), n * 2u);
+            put(a.code.c.data(), n * 2u);
+            for (const auto &s : a.blocks)
+                  put(&s.start, 4u);
+            for (const auto &s : a.blocks)
+                  put(&s.end, 4u);
+            for (const auto &e : a.edges)
+                  put(&e.from, 4u);
+            for (const auto &e : a.edges)
+                  put(&e.to, 4u);
+            for (const auto &e : a.edges)
+                  put(&e.kind, 1u);
+            for (const auto *const sets : {&a.live_in, &a.live_out, &a.uses, &a.defs}) {
+                  for (const auto &set : *sets)
+                        put(set.words, words * 8u);
+            }
+            detail::store(out.data() + 40u, hash(out.data() + header_size, out.size() - header_size).lo);
+            return out;
+      }
+
+      /* Throws cache_error when the bytes are not an intact entry for `k`. */
+      inline analysis deserialize(const std::uint8_t *const bytes, const std::size_t size, const key &k) {
+            if (size < header_size || std::memcmp(bytes, magic, 4u) != 0)
+                  throw cache_error("not a cache entry");
+            if (detail::load<std::uint16_t>(bytes + 4u) != version)
+                  throw cache_error("unsupported cache entry version");
+            const std::size_t n = detail::load<std::uint32_t>(bytes + 8u);
+            const std::size_t blocks = detail::load<std::uint32_t>(bytes + 12u);
+            const std::size_t edges = detail::load<std::uint32_t>(bytes + 16u);
+            const std::size_t words = bytes[21u];
+            if (words > detail::set_words_max || size != detail::entry_size(n, blocks, edges, words))
+                  throw cache_error("cache entry size mismatch");
+            if (key{detail::load<std::uint64_t>(bytes + 24u), detail::load<std::uint64_t>(bytes + 32u)} != k)
+                  throw cache_error("cache entry holds another key");
+            if (hash(bytes + header_size, size - header_size).lo != detail::load<std::uint64_t>(bytes + 40u))
+                  throw cache_error("cache entry corrupt");
+
+            analysis out;
+            out.frame = detail::load<std::uint16_t>(bytes + 6u);
+            out.malformed = (bytes[20u] & flag_malformed) != 0u;
+            auto at = bytes + header_size;
+            const auto take = [&](void *const data, const std::size_t size) {
+                  if (size != 0u)
+                        std::memcpy(data, at, size);
+                  at += size;
+            };
+            auto &code = out.code;
+            code.resize(n);
+            take(code.op.data(), n);
+            take(code.a.data(), n);
+            take(code.rk.data(), n);
+            take(code.b.data(), n * 2u);
+            take(code.c.data(), n * 2u);
+            for (auto i = std::size_t{0u}; i < n; ++i) {
+                  const auto bx = (static_cast<std::uint32_t>(code.b[i]) << 9u) | code.c[i];
+                  code.bx[i] = bx;
+                  code.sbx[i] = static_cast<std::int32_t>(bx) - field_of(operand_encoding::sBx).bias;
+                  code.ax[i] = (bx << 8u) | code.a[i];
+            }
+            out.blocks.resize(blocks);
+            for (auto &s : out.blocks)
+                  take(&s.start, 4u);
+            for (auto &s : out.blocks)
+                  take(&s.end, 4u);
+            out.edges.resize(edges);
+            for (auto &e : out.edges)
+                  take(&e.from, 4u);
+            for (auto &e : out.edges)
+                  take(&e.to, 4u);
+            for (auto &e : out.edges)
+                  take(&e.kind, 1u);
+            for (auto *const sets : {&out.live_in, &out.live_out, &out.uses, &out.defs}) {
+                  sets->resize(blocks);
+                  for (auto &set : *sets)
+                        take(set.words, words * 8u);
+            }
+            for (const auto &e : out.edges) {
+                  if (e.from >= blocks || e.to >= blocks)
+                        throw cache_error("cache entry edge out of range");
+            }
+            return out;
+      }
+
+      /* Snapshot of the counters. */
+      struct statistics {
+            std::uint64_t lookups = 0u;
+            std::uint64_t memory_hits = 0u;
+            std::uint64_t disk_hits = 0u;
+            std::uint64_t misses = 0u;
+            std::uint64_t bytes_saved = 0u;  /* Bytecode whose decode and analysis a hit skipped. */
+            std::uint64_t lookup_ns = 0u;    /* Summed over lookups, a miss counts until its result is stored. */
+            std::uint64_t evictions = 0u;
+            std::uint64_t disk_errors = 0u;  /* Unreadable or corrupt entries, recomputed and rewritten. */
+            std::uint64_t latency[32]{};     /* Lookups by floor(log2(ns)). */
+
+            double hit_rate() const {
+                  return (lookups != 0u) ? static_cast<double>(memory_hits + disk_hits) / static_cast<double>(lookups) : 0.0;
+            }
+
+            double mean_lookup_ns() const {
+                  return (lookups != 0u) ? static_cast<double>(lookup_ns) / static_cast<double>(lookups) : 0.0;
+            }
+
+            /* Upper bound of the latency bucket holding quantile `q` (0..1). */
+            std::uint64_t lookup_ns_quantile(const double q) const {
+                  auto seen = std::uint64_t{0u};
+                  for (auto i = 0u; i < 32u; ++i) {
+                        seen += latency[i];
+                        if (static_cast<double>(seen) >= q * static_cast<double>(lookups) && seen != 0u)
+                              return (2ull << i) - 1u;
+                  }
+                  return 0u;
+            }
+      };
+
+      /* Memory tier guarded by one mutex, safe to share between threads; a miss computes outside the lock. */
+      class store {
+          public:
+            struct options {
+                  std::string directory;                    /* Empty keeps the cache in memory only. */
+                  std::size_t memory_bytes = 64u << 20u;    /* LRU budget, by analysis::bytes(). */
+            };
+
+            explicit store(options settings) : config(std::move(settings)) {
+                  if (!config.directory.empty())
+                        std::filesystem::create_directories(config.directory);
+            }
+
+            /* The proto's analysis, from memory, then disk, else computed and written to both. */
+            std::shared_ptr<const analysis> get(const chunk::proto &p) {
+                  const auto start = std::chrono::steady_clock::now();
+                  const auto k = key_of(p);
+                  const auto code_bytes = p.code.size() * 4u;
+                  auto found = remember(k);
+                  if (found) {
+                        counters.memory_hits.fetch_add(1u, std::memory_order_relaxed);
+                  } else {
+                        found = read(k);
+                        if (found) {
+                              counters.disk_hits.fetch_add(1u, std::memory_order_relaxed);
+                              keep(k, found);
+                        }
+                  }
+                  if (found) {
+                        counters.bytes_saved.fetch_add(code_bytes, std::memory_order_relaxed);
+                  } else {
+                        thread_local dataflow::liveness solver;
+                        found = std::make_shared<const analysis>(analyze(p, solver));
+                        counters.misses.fetch_add(1u, std::memory_order_relaxed);
+                        write(k, *found);
+                        keep(k, found);
+                  }
+                  record(start);
+                  return found;
+            }
+
+            /* Memory then disk, nullptr when neither has it. Not counted. */
+            std::shared_ptr<const analysis> find(const key &k) {
+                  if (auto found = remember(k))
+                        return found;
+                  auto found = read(k);
+                  if (found)
+                        keep(k, found);
+                  return found;
+            }
+
+            void put(const key &k, std::shared_ptr<const analysis> value) {
+                  write(k, *value);
+                  keep(k, std::move(value));
+            }
+
+            /* Drops the memory tier, entries already handed out stay alive with their holders. */
+            void clear_memory() {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  order.clear();
+                  slots.clear();
+                  resident = 0u;
+            }
+
+            std::size_t memory_bytes() const {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  return resident;
+            }
+
+            statistics stats() const {
+                  statistics out;
+                  out.memory_hits = counters.memory_hits.load(std::memory_order_relaxed);
+                  out.disk_hits = counters.disk_hits.load(std::memory_order_relaxed);
+                  out.misses = counters.misses.load(std::memory_order_relaxed);
+                  out.lookups = out.memory_hits + out.disk_hits + out.misses;
+                  out.bytes_saved = counters.bytes_saved.load(std::memory_order_relaxed);
+                  out.lookup_ns = counters.lookup_ns.load(std::memory_order_relaxed);
+                  out.evictions = counters.evictions.load(std::memory_order_relaxed);
+                  out.disk_errors = counters.disk_errors.load(std::memory_order_relaxed);
+                  for (auto i = 0u; i < 32u; ++i)
+                        out.latency[i] = counters.latency[i].load(std::memory_order_relaxed);
+                  return out;
+            }
+
+            /* Where the entry for `k` lives on disk. */
+            std::string path_of(const key &k) const {
+                  const auto name = k.hex();
+                  return config.directory + "/" + name.substr(0u, 2u) + "/" + name + ".lpa";
+            }
+
+          private:
+            struct node {
+                  key id;
+                  std::shared_ptr<const analysis> value;
+                  std::size_t bytes;
+            };
+
+            struct atomic_counters {
+                  std::atomic<std::uint64_t> memory_hits{0u};
+                  std::atomic<std::uint64_t> disk_hits{0u};
+                  std::atomic<std::uint64_t> misses{0u};
+                  std::atomic<std::uint64_t> bytes_saved{0u};
+                  std::atomic<std::uint64_t> lookup_ns{0u};
+                  std::atomic<std::uint64_t> evictions{0u};
+                  std::atomic<std::uint64_t> disk_errors{0u};
+                  std::atomic<std::uint64_t> latency[32]{};
+            };
+
+            options config;
+            mutable std::mutex mutex;
+            std::list<node> order; /* Most recently used first. */
+            std::unordered_map<key, std::list<node>::iterator, key_hash> slots;
+            std::size_t resident = 0u;
+            std::atomic<std::uint64_t> temporaries{0u};
+            atomic_counters counters;
+
+            std::shared_ptr<const analysis> remember(const key &k) {
+                  std::lock_guard<std::mutex> lock(mutex);
+                  const auto slot = slots.find(k);
+                  if (slot == slots.end())
+                        return nullptr;
+                  order.splice(order.begin(), order, slot->second);
+                  return slot->second->value;
+            }
+
+            void keep(const key &k, std::shared_ptr<const analysis> value) {
+                  const auto bytes = value->bytes();
+                  if (bytes > config.memory_bytes)
+                        return;
+                  std::lock_guard<std::mutex> lock(mutex);
+                  const auto slot = slots.find(k);
+                  if (slot != slots.end()) {
+                        order.splice(order.begin(), order, slot->second);
+                        return;
+                  }
+                  order.push_front(node{k, std::move(value), bytes});
+                  slots.emplace(k, order.begin());
+                  resident += bytes;
+                  while (resident > config.memory_bytes) {
+                        resident -= order.back().bytes;
+                        slots.erase(order.back().id);
+                        order.pop_back();
+                        counters.evictions.fetch_add(1u, std::memory_order_relaxed);
+                  }
+            }
+
+            std::shared_ptr<const analysis> read(const key &k) {
+                  if (config.directory.empty())
+                        return nullptr;
+                  /* Entries are small, one read beats mapping and unmapping them. */
+                  std::ifstream in(path_of(k), std::ios::binary | std::ios::ate);
+                  if (!in)
+                        return nullptr;
+                  thread_local std::vector<std::uint8_t> buffer;
+                  buffer.resize(static_cast<std::size_t>(in.tellg()));
+                  in.seekg(0);
+                  try {
+                        if (!in.read(reinterpret_cast<char *>(buffer.data()), static_cast<std::streamsize>(buffer.size())))
+                              throw cache_error("short read");
+                        return std::make_shared<const analysis>(deserialize(buffer.data(), buffer.size(), k));
+                  } catch (const std::exception &) {
+                        counters.disk_errors.fetch_add(1u, std::memory_order_relaxed);
+                        return nullptr;
+                  }
+            }
+
+            /* Temporary file then rename, so a reader never maps a half written entry. */
+            void write(const key &k, const analysis &value) {
+                  if (config.directory.empty())
+                        return;
+                  const auto path = path_of(k);
+                  const auto bytes = serialize(value, k);
+                  std::error_code error;
+                  std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+                  const auto temporary = path + ".tmp" + std::to_string(temporaries.fetch_add(1u, std::memory_order_relaxed));
+                  {
+                        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+                        if (!out.flush()) {
+                              counters.disk_errors.fetch_add(1u, std::memory_order_relaxed);
+                              return;
+                        }
+                  }
+                  if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+                        std::remove(temporary.c_str());
+                        counters.disk_errors.fetch_add(1u, std::memory_order_relaxed);
+                  }
+            }
+
+            void record(const std::chrono::steady_clock::time_point start) {
+                  const auto ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+                  counters.lookup_ns.fetch_add(ns, std::memory_order_relaxed);
+                  const auto bucket = (ns > 1u) ? std::min(31u, bits::bit_width(ns) - 1u) : 0u;
+                  counters.latency[bucket].fetch_add(1u, std::memory_order_relaxed);
+            }
+      };
+
+} // namespace cache
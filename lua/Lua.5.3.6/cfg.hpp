@@ -0,0 +1,288 @@
+#pragma once
+
+#include "arena.hpp"
+#include "chunk.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+      Basic blocks and control-flow graph over decoded Lua 5.3 code.
+      Opcodes with an operand_kind::jmp operand in optable jump through it (sBx) or skip on it (C); the compare and test skips,
+      OP_EXTRAARG pairs and OP_RETURN carry no such operand and are listed by hand. Every block and edge lives in the builder's arena.
+*/
+namespace cfg {
+
+      /* How control leaves an instruction. */
+      enum class flow : std::uint8_t {
+            next,        /* Falls through. */
+            jump,        /* Unconditional sBx jump (OP_JMP, OP_FORPREP). */
+            loop,        /* sBx back edge or fall through (OP_FORLOOP, OP_TFORLOOP). */
+            skip,        /* Conditionally skips the next instruction (OP_EQ, OP_LT, OP_LE, OP_TEST, OP_TESTSET). */
+            skip_if_c,   /* Skips the next instruction when the C jmp operand is set (OP_LOADBOOL). */
+            extra_arg,   /* Consumes the following OP_EXTRAARG (OP_LOADKX, OP_SETLIST with C == 0). */
+            exit         /* Leaves the function (OP_RETURN). */
+      };
+
+      /* First operand of kind jmp, nullptr when the opcode takes none. */
+      constexpr const optable_operand *jump_operand(const opcodes op) {
+            const auto &entry = opentry(op);
+            for (auto i = 0u; i < entry.operand_count; ++i) {
+                  if (entry.operands[i].kind == operand_kind::jmp)
+                        return &entry.operands[i];
+            }
+            return nullptr;
+      }
+
+      constexpr flow flow_of(const opcodes op) {
+            const auto &entry = opentry(op);
+            for (auto i = 0u; i < entry.operand_count; ++i) {
+                  if (entry.operands[i].kind != operand_kind::jmp)
+                        continue;
+                  if (entry.operands[i].encoding == operand_encoding::C)
+                        return flow::skip_if_c;
+                  /* optable does not say which sBx jumps are conditional. */
+                  return (op == opcodes::OP_FORLOOP || op == opcodes::OP_TFORLOOP) ? flow::loop : flow::jump;
+            }
+            switch (op) {
+                  case opcodes::OP_EQ:
+                  case opcodes::OP_LT:
+                  case opcodes::OP_LE:
+                  case opcodes::OP_TEST:
+                  case opcodes::OP_TESTSET:
+                        return flow::skip;
+                  case opcodes::OP_LOADKX:
+                  case opcodes::OP_SETLIST:
+                        return flow::extra_arg;
+                  case opcodes::OP_RETURN:
+                        return flow::exit;
+                  default:
+                        return flow::next;
+            }
+      }
+
+      /* flow_of for every valid opcode, what the builder indexes per instruction. */
+      struct flow_table {
+            flow flows[opcode_count];
+      };
+      constexpr flow_table make_flow_table() {
+            flow_table table{};
+            for (auto i = 0u; i < opcode_count; ++i)
+                  table.flows[i] = flow_of(static_cast<opcodes>(i));
+            return table;
+      }
+      inline constexpr flow_table flows = make_flow_table();
+
+      static_assert(flows.flows[static_cast<std::size_t>(opcodes::OP_JMP)] == flow::jump && flows.flows[static_cast<std::size_t>(opcodes::OP_FORPREP)] == flow::jump, "OP_JMP and OP_FORPREP jump through sBx.");
+      static_assert(flows.flows[static_cast<std::size_t>(opcodes::OP_LOADBOOL)] == flow::skip_if_c, "OP_LOADBOOL skips through C.");
+      static_assert(jump_operand(opcodes::OP_FORLOOP)->encoding == operand_encoding::sBx && jump_operand(opcodes::OP_TFORLOOP)->encoding == operand_encoding::sBx, "Loops jump through sBx.");
+
+      enum class edge_kind : std::uint8_t {
+            fallthrough,
+            jump,      /* Taken sBx jump. */
+            back,      /* Loop back edge (target at or before the source). */
+            skip       /* Skip over the next instruction. */
+      };
+
+      struct block;
+
+      struct edge {
+            block *from;
+            block *to;
+            edge_kind kind;
+            edge *next_succ;
+            edge *next_pred;
+      };
+
+      struct block {
+            std::uint32_t id;
+            std::uint32_t start; /* First pc. */
+            std::uint32_t end;   /* One past the last pc, a consumed OP_EXTRAARG stays inside. */
+            std::uint32_t succ_count;
+            std::uint32_t pred_count;
+            edge *succs;
+            edge *preds;
+      };
+
+      struct graph {
+            block **blocks = nullptr; /* In pc order, blocks[0] is the entry. */
+            std::uint32_t block_count = 0u;
+            std::uint32_t edge_count = 0u;
+            std::uint32_t *block_of = nullptr; /* pc -> block id. */
+            std::uint32_t instruction_count = 0u;
+            bool malformed = false; /* Some jump left the function or code ran off the end. */
+
+            const block &entry() const {
+                  return *blocks[0];
+            }
+      };
+
+      /* Builds graphs into its own arena, each build() resets it so the previous graph is gone. */
+      class builder {
+          public:
+            explicit builder(const std::size_t chunk_size = 256u * 1024u) : memory(chunk_size) {}
+
+            const graph &build(const decoder::decoded &code) {
+                  return build(code.op.data(), code.sbx.data(), code.c.data(), static_cast<std::uint32_t>(code.size()));
+            }
+
+            const graph &build(const chunk::proto &p) {
+                  p.code.decode(scratch);
+                  return build(scratch);
+            }
+
+            /* Straight from decoder output arrays. */
+            const graph &build(const std::uint8_t *const ops, const std::int32_t *const sbx, const std::uint16_t *const c, const std::uint32_t count) {
+                  memory.reset();
+                  result = graph{};
+                  result.instruction_count = count;
+                  if (count == 0u)
+                        return result;
+
+                  /* Leaders */
+                  const auto words = (count + 63u) / 64u;
+                  const auto leaders = memory.make_array<std::uint64_t>(words);
+                  const auto mark = [&](const std::int64_t pc) {
+                        if (pc >= 0 && pc < count)
+                              leaders[pc >> 6] |= 1ull << (pc & 63);
+                  };
+                  mark(0);
+                  for (auto pc = 0u; pc < count; ++pc) {
+                        const auto op = static_cast<opcodes>(ops[pc]);
+                        if (!opcode_valid(op))
+                              continue;
+                        switch (flows.flows[ops[pc]]) {
+                              case flow::jump:
+                              case flow::loop:
+                                    mark(target(pc, sbx[pc]));
+                                    mark(pc + 1);
+                                    break;
+                              case flow::skip:
+                                    mark(pc + 1);
+                                    mark(pc + 2);
+                                    break;
+                              case flow::skip_if_c:
+                                    if (c[pc] != 0u) {
+                                          mark(pc + 1);
+                                          mark(pc + 2);
+                                    }
+                                    break;
+                              case flow::extra_arg:
+                                    if (consumes_extra_arg(op, ops, c, pc, count))
+                                          ++pc;
+                                    break;
+                              case flow::exit:
+                                    mark(pc + 1);
+                                    break;
+                              default:
+                                    break;
+                        }
+                  }
+
+                  /* Blocks */
+                  auto block_count = 0u;
+                  for (auto w = 0u; w < words; ++w)
+                        block_count += static_cast<std::uint32_t>(popcount(leaders[w]));
+                  result.blocks = memory.make_array<block *>(block_count);
+                  result.block_of = memory.make_array<std::uint32_t>(count);
+                  result.block_count = block_count;
+                  auto id = 0u;
+                  for (auto pc = 0u; pc < count; ++pc) {
+                        if (leaders[pc >> 6] & (1ull << (pc & 63u))) {
+                              if (id != 0u)
+                                    result.blocks[id - 1u]->end = pc;
+                              result.blocks[id] = memory.make<block>(block{id, pc, count, 0u, 0u, nullptr, nullptr});
+                              ++id;
+                        }
+                        result.block_of[pc] = id - 1u;
+                  }
+
+                  /* Edges, taken from the instruction that ends each block. */
+                  for (auto b = 0u; b < block_count; ++b) {
+                        const auto current = result.blocks[b];
+                        auto last = current->end - 1u;
+                        if (last > current->start && static_cast<opcodes>(ops[last]) == opcodes::OP_EXTRAARG && opcode_valid(static_cast<opcodes>(ops[last - 1u])) && flows.flows[ops[last - 1u]] == flow::extra_arg && consumes_extra_arg(static_cast<opcodes>(ops[last - 1u]), ops, c, last - 1u, count))
+                              --last;
+                        const auto op = static_cast<opcodes>(ops[last]);
+                        const auto kind = opcode_valid(op) ? flows.flows[ops[last]] : flow::next;
+                        switch (kind) {
+                              case flow::jump:
+                                    connect(current, target(last, sbx[last]), last, edge_kind::jump);
+                                    break;
+                              case flow::loop:
+                                    /* sBx == 0 lands on the fall through, one edge then. */
+                                    if (sbx[last] != 0)
+                                          connect(current, target(last, sbx[last]), last, edge_kind::jump);
+                                    connect(current, static_cast<std::int64_t>(last) + 1, last, edge_kind::fallthrough);
+                                    break;
+                              case flow::skip:
+                                    connect(current, static_cast<std::int64_t>(last) + 1, last, edge_kind::fallthrough);
+                                    connect(current, static_cast<std::int64_t>(last) + 2, last, edge_kind::skip);
+                                    break;
+                              case flow::skip_if_c:
+                                    connect(current, static_cast<std::int64_t>(last) + ((c[last] != 0u) ? 2 : 1), last, (c[last] != 0u) ? edge_kind::skip : edge_kind::fallthrough);
+                                    break;
+                              case flow::extra_arg:
+                                    connect(current, static_cast<std::int64_t>(last) + (consumes_extra_arg(op, ops, c, last, count) ? 2 : 1), last, edge_kind::fallthrough);
+                                    break;
+                              case flow::exit:
+                                    break;
+                              default:
+                                    connect(current, static_cast<std::int64_t>(last) + 1, last, edge_kind::fallthrough);
+                                    break;
+                        }
+                  }
+                  return result;
+            }
+
+            const graph &last() const {
+                  return result;
+            }
+
+            arena &storage() {
+                  return memory;
+            }
+
+          private:
+            arena memory;
+            graph result;
+            decoder::decoded scratch;
+
+            static std::int64_t target(const std::uint32_t pc, const std::int32_t offset) {
+                  return static_cast<std::int64_t>(pc) + 1 + offset;
+            }
+
+            /* OP_LOADKX always, OP_SETLIST only when C == 0 (block number in the next OP_EXTRAARG). */
+            static bool consumes_extra_arg(const opcodes op, const std::uint8_t *const ops, const std::uint16_t *const c, const std::uint32_t pc, const std::uint32_t count) {
+                  if (op == opcodes::OP_SETLIST && c[pc] != 0u)
+                        return false;
+                  return pc + 1u < count && static_cast<opcodes>(ops[pc + 1u]) == opcodes::OP_EXTRAARG;
+            }
+
+            static std::uint32_t popcount(std::uint64_t v) {
+                  auto n = 0u;
+                  for (; v != 0u; v &= v - 1u)
+                        ++n;
+                  return n;
+            }
+
+            void connect(block *const from, const std::int64_t to_pc, const std::uint32_t pc, edge_kind kind) {
+                  if (to_pc < 0 || to_pc >= result.instruction_count) {
+                        result.malformed = true;
+                        return;
+                  }
+                  const auto to = result.blocks[result.block_of[to_pc]];
+                  if (kind == edge_kind::jump && to_pc <= pc)
+                        kind = edge_kind::back;
+                  const auto e = memory.make<edge>(edge{from, to, kind, from->succs, to->preds});
+                  from->succs = e;
+                  to->preds = e;
+                  ++from->succ_count;
+                  ++to->pred_count;
+                  ++result.edge_count;
+            }
+      };
+
+} // namespace cfg
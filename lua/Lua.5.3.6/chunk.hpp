@@ -0,0 +1,567 @@
+#pragma once
+
+#include "decoder.hpp"
+#include "header.hpp"
+#include "mapped_file.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+      Zero-copy loader for luac 5.3 chunks.
+      Protos expose their code, constants, upvalues and debug info as views into the mapped file, nothing gets copied.
+*/
+namespace chunk {
+
+      struct load_error : std::runtime_error {
+            using std::runtime_error::runtime_error;
+      };
+
+      constexpr char signature[] = "\x1bLua";
+      constexpr std::uint8_t version = 0x53u;
+      constexpr std::uint8_t format = 0u;
+      constexpr char luac_data[] = "\x19\x93\r\n\x1a\n";
+      constexpr std::int64_t luac_int = 0x5678;
+      constexpr double luac_num = 370.5;
+
+      enum class constant_type : std::uint8_t {
+            nil = 0u,
+            boolean = 1u,
+            number = 3u,        /* LUA_TNUMFLT */
+            short_string = 4u,  /* LUA_TSHRSTR */
+            integer = 19u,      /* LUA_TNUMINT */
+            long_string = 20u   /* LUA_TLNGSTR */
+      };
+
+      enum class load_mode {
+            eager, /* Whole proto tree parsed on open. */
+            lazy   /* Child protos get skipped over and parsed the first time they are touched. */
+      };
+
+      namespace detail {
+
+            template <typename T>
+            inline T load(const std::uint8_t *const bytes) {
+                  T value;
+                  std::memcpy(&value, bytes, sizeof(T));
+                  return value;
+            }
+
+      } // namespace detail
+
+      /* One instruction word typed against opcodes. */
+      struct instruction {
+            std::uint32_t word;
+
+            opcodes op() const {
+                  return instruction_op(word);
+            }
+            std::int32_t operand(const operand_encoding encoding) const {
+                  return instruction_operand(word, encoding);
+            }
+            const optable_entry &entry() const {
+                  return opentry(op());
+            }
+      };
+
+      /* Fixed stride records in the mapped file (instructions, line info), read unaligned. */
+      template <typename T>
+      class packed_view {
+          public:
+            packed_view() = default;
+            packed_view(const std::uint8_t *const bytes, const std::size_t count) : bytes(bytes), count(count) {}
+
+            std::size_t size() const {
+                  return count;
+            }
+            bool empty() const {
+                  return count == 0u;
+            }
+            const std::uint8_t *data() const {
+                  return bytes;
+            }
+            T operator[](const std::size_t i) const {
+                  return detail::load<T>(bytes + i * sizeof(T));
+            }
+
+            class iterator {
+                public:
+                  using iterator_category = std::input_iterator_tag;
+                  using value_type = T;
+                  using difference_type = std::ptrdiff_t;
+                  using pointer = const T *;
+                  using reference = T;
+
+                  iterator(const std::uint8_t *at) : at(at) {}
+                  T operator*() const {
+                        return detail::load<T>(at);
+                  }
+                  iterator &operator++() {
+                        at += sizeof(T);
+                        return *this;
+                  }
+                  bool operator==(const iterator &other) const {
+                        return at == other.at;
+                  }
+                  bool operator!=(const iterator &other) const {
+                        return at != other.at;
+                  }
+
+                private:
+                  const std::uint8_t *at;
+            };
+
+            iterator begin() const {
+                  return {bytes};
+            }
+            iterator end() const {
+                  return {bytes + count * sizeof(T)};
+            }
+
+          private:
+            const std::uint8_t *bytes = nullptr;
+            std::size_t count = 0u;
+      };
+
+      class code_view : public packed_view<std::uint32_t> {
+          public:
+            using packed_view::packed_view;
+
+            instruction at(const std::size_t pc) const {
+                  return {(*this)[pc]};
+            }
+
+            /* Straight into the batch decoder. */
+            void decode(decoder::decoded &out) const {
+                  out.resize(size());
+                  decoder::decode(static_cast<const void *>(data()), size(), out.view());
+            }
+      };
+
+      struct constant {
+            constant_type type = constant_type::nil;
+            bool boolean = false;
+            std::int64_t integer = 0;
+            double number = 0.0;
+            std::string_view string; /* Points into the mapped file. */
+
+            bool is_string() const {
+                  return type == constant_type::short_string || type == constant_type::long_string;
+            }
+      };
+
+      struct upvalue {
+            std::uint8_t instack;
+            std::uint8_t idx;
+      };
+
+      struct local_variable {
+            std::string_view name;
+            std::int32_t start_pc;
+            std::int32_t end_pc;
+      };
+
+      /* Variable length records, random access through a table of offsets gathered while walking the proto. */
+      template <typename T>
+      class record_view {
+          public:
+            using reader = T (*)(const std::uint8_t *, std::size_t);
+
+            record_view() = default;
+            record_view(const std::uint8_t *const bytes, std::vector<std::uint32_t> offsets, const std::size_t size_t_size, const reader read) : bytes(bytes), offsets(std::move(offsets)), size_t_size(size_t_size), read(read) {}
+
+            std::size_t size() const {
+                  return offsets.size();
+            }
+            bool empty() const {
+                  return offsets.empty();
+            }
+            T operator[](const std::size_t i) const {
+                  return read(bytes + offsets[i], size_t_size);
+            }
+
+          private:
+            const std::uint8_t *bytes = nullptr;
+            std::vector<std::uint32_t> offsets;
+            std::size_t size_t_size = 8u;
+            reader read = nullptr;
+      };
+
+      struct header_info {
+            std::uint8_t version;
+            std::uint8_t format;
+            std::uint8_t int_size;
+            std::uint8_t size_t_size;
+            std::uint8_t instruction_size;
+            std::uint8_t integer_size;
+            std::uint8_t number_size;
+            std::uint8_t upvalue_count; /* Upvalues of the main closure. */
+      };
+
+      class file;
+
+      class proto {
+          public:
+            std::string_view source; /* Inherited from the parent when stripped. */
+            std::int32_t line_defined = 0;
+            std::int32_t last_line_defined = 0;
+            std::uint8_t param_count = 0u;
+            std::uint8_t is_vararg = 0u;
+            std::uint8_t max_stack_size = 0u;
+
+            code_view code;
+            record_view<constant> constants;
+            packed_view<upvalue> upvalues;
+
+            /* Debug info, empty when stripped. */
+            packed_view<std::int32_t> line_info;
+            record_view<local_variable> locals;
+            record_view<std::string_view> upvalue_names;
+
+            std::size_t offset = 0u; /* Byte range of this proto inside the chunk. */
+            std::size_t length = 0u;
+
+            std::size_t proto_count() const {
+                  return children.size();
+            }
+
+            /* Nested proto, parsed on first touch in lazy mode (safe from several threads). */
+            const proto &child(const std::size_t i) const;
+
+          private:
+            friend class file;
+            friend class parser;
+
+            /* Racing first touches may both parse, the first one published wins and the other is dropped. */
+            struct child_slot {
+                  std::size_t offset = 0u;
+                  std::atomic<proto *> parsed{nullptr};
+
+                  child_slot() = default;
+                  child_slot(child_slot &&other) noexcept : offset(other.offset), parsed(other.parsed.exchange(nullptr, std::memory_order_relaxed)) {}
+                  ~child_slot() {
+                        delete parsed.load(std::memory_order_relaxed);
+                  }
+            };
+
+            const file *owner = nullptr;
+            mutable std::vector<child_slot> children;
+      };
+
+      /* Walks the chunk layout of lundump.c, either building protos or only measuring them. */
+      class parser {
+          public:
+            parser(const std::uint8_t *const begin, const std::uint8_t *const end, const header_info &header) : begin(begin), end(end), header(header) {}
+
+            void parse(proto &out, const std::size_t offset, const std::string_view parent_source, const load_mode mode) {
+                  at = begin + offset;
+                  out.offset = offset;
+
+                  const auto source = string();
+                  out.source = source.data() != nullptr ? source : parent_source;
+                  out.line_defined = integer();
+                  out.last_line_defined = integer();
+                  out.param_count = byte();
+                  out.is_vararg = byte();
+                  out.max_stack_size = byte();
+
+                  const auto code_count = count(4u);
+                  out.code = code_view(take(code_count * 4u), code_count);
+
+                  const auto constant_count = count(1u);
+                  const auto constants_begin = at;
+                  std::vector<std::uint32_t> constant_offsets(constant_count);
+                  for (auto &constant_offset : constant_offsets) {
+                        constant_offset = static_cast<std::uint32_t>(at - constants_begin);
+                        skip_constant();
+                  }
+                  out.constants = record_view<constant>(constants_begin, std::move(constant_offsets), header.size_t_size, &read_constant);
+
+                  const auto upvalue_count = count(2u);
+                  out.upvalues = packed_view<upvalue>(take(upvalue_count * 2u), upvalue_count);
+
+                  const auto proto_count = count(1u);
+                  out.children.resize(proto_count);
+                  for (auto &slot : out.children) {
+                        slot.offset = static_cast<std::size_t>(at - begin);
+                        if (mode == load_mode::eager) {
+                              auto parsed = std::make_unique<proto>();
+                              parsed->owner = out.owner;
+                              parser nested(begin, end, header);
+                              nested.parse(*parsed, slot.offset, out.source, mode);
+                              at = begin + slot.offset + parsed->length;
+                              slot.parsed.store(parsed.release(), std::memory_order_relaxed);
+                        } else {
+                              skip_function();
+                        }
+                  }
+
+                  const auto line_count = count(4u);
+                  out.line_info = packed_view<std::int32_t>(take(line_count * 4u), line_count);
+
+                  const auto local_count = count(1u);
+                  const auto locals_begin = at;
+                  std::vector<std::uint32_t> local_offsets(local_count);
+                  for (auto &local_offset : local_offsets) {
+                        local_offset = static_cast<std::uint32_t>(at - locals_begin);
+                        string();
+                        take(8u);
+                  }
+                  out.locals = record_view<local_variable>(locals_begin, std::move(local_offsets), header.size_t_size, &read_local);
+
+                  const auto name_count = count(1u);
+                  const auto names_begin = at;
+                  std::vector<std::uint32_t> name_offsets(name_count);
+                  for (auto &name_offset : name_offsets) {
+                        name_offset = static_cast<std::uint32_t>(at - names_begin);
+                        string();
+                  }
+                  out.upvalue_names = record_view<std::string_view>(names_begin, std::move(name_offsets), header.size_t_size, &read_name);
+
+                  out.length = static_cast<std::size_t>(at - (begin + offset));
+            }
+
+            /* Same walk as parse without building anything. */
+            void skip_function() {
+                  string();
+                  take(4u + 4u + 3u);
+                  take(count(4u) * 4u);
+                  for (auto n = count(1u); n != 0u; --n)
+                        skip_constant();
+                  take(count(2u) * 2u);
+                  for (auto n = count(1u); n != 0u; --n)
+                        skip_function();
+                  take(count(4u) * 4u);
+                  for (auto n = count(1u); n != 0u; --n) {
+                        string();
+                        take(8u);
+                  }
+                  for (auto n = count(1u); n != 0u; --n)
+                        string();
+            }
+
+            static std::string_view read_string(const std::uint8_t *at, const std::size_t size_t_size, std::size_t *const consumed = nullptr) {
+                  std::uint64_t size = *at++;
+                  auto used = std::size_t{1u};
+                  if (size == 0xFFu) {
+                        size = (size_t_size == 8u) ? detail::load<std::uint64_t>(at) : detail::load<std::uint32_t>(at);
+                        at += size_t_size;
+                        used += size_t_size;
+                  }
+                  if (consumed != nullptr)
+                        *consumed = used + (size != 0u ? static_cast<std::size_t>(size - 1u) : 0u);
+                  if (size == 0u)
+                        return {};
+                  return {reinterpret_cast<const char *>(at), static_cast<std::size_t>(size - 1u)};
+            }
+
+          private:
+            const std::uint8_t *begin;
+            const std::uint8_t *end;
+            const std::uint8_t *at = nullptr;
+            const header_info &header;
+
+            const std::uint8_t *take(const std::size_t n) {
+                  if (static_cast<std::size_t>(end - at) < n)
+                        throw load_error("truncated chunk");
+                  const auto result = at;
+                  at += n;
+                  return result;
+            }
+
+            std::uint8_t byte() {
+                  return *take(1u);
+            }
+
+            std::int32_t integer() {
+                  return detail::load<std::int32_t>(take(4u));
+            }
+
+            /* Element count followed by at least `stride` bytes per element, rejects counts the file cannot hold. */
+            std::size_t count(const std::size_t stride) {
+                  const auto n = integer();
+                  if (n < 0 || static_cast<std::size_t>(n) > static_cast<std::size_t>(end - at) / stride)
+                        throw load_error("bad element count");
+                  return static_cast<std::size_t>(n);
+            }
+
+            std::string_view string() {
+                  if (at >= end)
+                        throw load_error("truncated chunk");
+                  std::size_t consumed = 1u;
+                  if (*at == 0xFFu && static_cast<std::size_t>(end - at) < 1u + header.size_t_size)
+                        throw load_error("truncated chunk");
+                  const auto result = read_string(at, header.size_t_size, &consumed);
+                  take(consumed);
+                  return result;
+            }
+
+            void skip_constant() {
+                  switch (static_cast<constant_type>(byte())) {
+                        case constant_type::nil:
+                              break;
+                        case constant_type::boolean:
+                              take(1u);
+                              break;
+                        case constant_type::number:
+                        case constant_type::integer:
+                              take(8u);
+                              break;
+                        case constant_type::short_string:
+                        case constant_type::long_string:
+                              string();
+                              break;
+                        default:
+                              throw load_error("bad constant type");
+                  }
+            }
+
+            static constant read_constant(const std::uint8_t *const at, const std::size_t size_t_size) {
+                  constant result;
+                  result.type = static_cast<constant_type>(at[0]);
+                  switch (result.type) {
+                        case constant_type::boolean:
+                              result.boolean = at[1] != 0u;
+                              break;
+                        case constant_type::number:
+                              result.number = detail::load<double>(at + 1u);
+                              break;
+                        case constant_type::integer:
+                              result.integer = detail::load<std::int64_t>(at + 1u);
+                              break;
+                        case constant_type::short_string:
+                        case constant_type::long_string:
+                              result.string = read_string(at + 1u, size_t_size);
+                              break;
+                        default:
+                              break;
+                  }
+                  return result;
+            }
+
+            static local_variable read_local(const std::uint8_t *const at, const std::size_t size_t_size) {
+                  std::size_t consumed = 0u;
+                  const auto name = read_string(at, size_t_size, &consumed);
+                  return {name, detail::load<std::int32_t>(at + consumed), detail::load<std::int32_t>(at + consumed + 4u)};
+            }
+
+            static std::string_view read_name(const std::uint8_t *const at, const std::size_t size_t_size) {
+                  return read_string(at, size_t_size);
+            }
+      };
+
+      /* A loaded chunk, owns the mapping every view points into. */
+      class file {
+          public:
+            /* Maps `path` and validates the header. */
+            static std::unique_ptr<file> open(const std::string &path, const load_mode mode = load_mode::eager) {
+                  auto result = std::unique_ptr<file>(new file());
+                  result->mapping = io::mapped_file(path);
+                  result->mapping.advise_sequential();
+                  result->load(result->mapping.data(), result->mapping.size(), mode);
+                  return result;
+            }
+
+            /* Chunk already in memory, `bytes` must outlive the file. */
+            static std::unique_ptr<file> view(const void *const bytes, const std::size_t size, const load_mode mode = load_mode::eager) {
+                  auto result = std::unique_ptr<file>(new file());
+                  result->load(static_cast<const std::uint8_t *>(bytes), size, mode);
+                  return result;
+            }
+
+            const header_info &header() const {
+                  return info;
+            }
+
+            const proto &main() const {
+                  return root;
+            }
+
+            load_mode mode() const {
+                  return loading;
+            }
+
+            const std::uint8_t *data() const {
+                  return bytes;
+            }
+
+            std::size_t size() const {
+                  return length;
+            }
+
+          private:
+            friend class proto;
+
+            io::mapped_file mapping;
+            const std::uint8_t *bytes = nullptr;
+            std::size_t length = 0u;
+            header_info info{};
+            load_mode loading = load_mode::eager;
+            proto root;
+
+            file() = default;
+
+            void load(const std::uint8_t *const data, const std::size_t size, const load_mode mode) {
+                  bytes = data;
+                  length = size;
+                  loading = mode;
+
+                  constexpr auto fixed = 4u + 2u + 6u + 5u + 8u + 8u + 1u;
+                  if (data == nullptr || size < fixed)
+                        throw load_error("truncated header");
+                  if (std::memcmp(data, signature, 4u) != 0)
+                        throw load_error("not a precompiled chunk");
+
+                  auto at = data + 4u;
+                  info.version = *at++;
+                  info.format = *at++;
+                  if (info.version != version)
+                        throw load_error("version mismatch");
+                  if (info.format != format)
+                        throw load_error("format mismatch");
+                  if (std::memcmp(at, luac_data, 6u) != 0)
+                        throw load_error("corrupted chunk");
+                  at += 6u;
+
+                  info.int_size = *at++;
+                  info.size_t_size = *at++;
+                  info.instruction_size = *at++;
+                  info.integer_size = *at++;
+                  info.number_size = *at++;
+                  if (info.int_size != 4u || (info.size_t_size != 4u && info.size_t_size != 8u) || info.instruction_size != 4u || info.integer_size != 8u || info.number_size != 8u)
+                        throw load_error("unsupported type sizes");
+                  if (detail::load<std::int64_t>(at) != luac_int)
+                        throw load_error("endianness mismatch");
+                  at += 8u;
+                  if (detail::load<double>(at) != luac_num)
+                        throw load_error("float format mismatch");
+                  at += 8u;
+                  info.upvalue_count = *at++;
+
+                  root.owner = this;
+                  parser(data, data + size, info).parse(root, static_cast<std::size_t>(at - data), {}, mode);
+            }
+      };
+
+      inline const proto &proto::child(const std::size_t i) const {
+            auto &slot = children.at(i);
+            if (const auto ready = slot.parsed.load(std::memory_order_acquire))
+                  return *ready;
+            auto parsed = std::make_unique<proto>();
+            parsed->owner = owner;
+            parser(owner->data(), owner->data() + owner->size(), owner->header()).parse(*parsed, slot.offset, source, owner->mode());
+            proto *expected = nullptr;
+            if (slot.parsed.compare_exchange_strong(expected, parsed.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+                  return *parsed.release();
+            return *expected;
+      }
+
+} // namespace chunk
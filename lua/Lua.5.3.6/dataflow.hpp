@@ -0,0 +1,556 @@
+#pragma once
+
+#include "bits.hpp"
+#include "cfg.hpp"
+#include "chunk.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+/*
+      Register def-use and liveness over the cfg.
+      Operand kinds from optable decide which registers an instruction reads and writes, register sets are 256 bit wide (a Lua frame never has more).
+*/
+namespace dataflow {
+
+      constexpr std::uint32_t register_max = 256u;
+
+      /*
+            One bit per register.
+            Word operations go through AVX2 / SSE2 when the build targets them, unlike the decoder these are too small to pay for runtime dispatch.
+      */
+      struct alignas(32) regset {
+            std::uint64_t words[register_max / 64u];
+
+            static regset range(const std::uint32_t first, const std::uint32_t end) {
+                  regset result{};
+                  result.set_range(first, end);
+                  return result;
+            }
+
+            void set(const std::uint32_t r) {
+                  if (r < register_max)
+                        words[r >> 6u] |= 1ull << (r & 63u);
+            }
+
+            void reset(const std::uint32_t r) {
+                  if (r < register_max)
+                        words[r >> 6u] &= ~(1ull << (r & 63u));
+            }
+
+            bool test(const std::uint32_t r) const {
+                  return r < register_max && (words[r >> 6u] >> (r & 63u)) & 1u;
+            }
+
+            /* Registers [first, end), clamped to the frame limit. */
+            void set_range(const std::uint32_t first, std::uint32_t end) {
+                  if (end > register_max)
+                        end = register_max;
+                  for (auto r = first; r < end;) {
+                        const auto bit = r & 63u;
+                        const auto n = (end - r < 64u - bit) ? end - r : 64u - bit;
+                        words[r >> 6u] |= ((n == 64u) ? ~0ull : ((1ull << n) - 1u)) << bit;
+                        r += n;
+                  }
+            }
+
+            bool empty() const {
+                  return (words[0] | words[1] | words[2] | words[3]) == 0u;
+            }
+
+            std::uint32_t count() const {
+                  auto n = 0u;
+                  for (const auto w : words)
+                        n += bits::popcount(w);
+                  return n;
+            }
+
+            /* this |= other */
+            regset &operator|=(const regset &other) {
+#if defined(__AVX2__)
+                  const auto x = _mm256_load_si256(reinterpret_cast<const __m256i *>(words));
+                  const auto y = _mm256_load_si256(reinterpret_cast<const __m256i *>(other.words));
+                  _mm256_store_si256(reinterpret_cast<__m256i *>(words), _mm256_or_si256(x, y));
+#elif defined(__SSE2__) || defined(_M_X64)
+                  for (auto i = 0u; i < 4u; i += 2u) {
+                        const auto x = _mm_load_si128(reinterpret_cast<const __m128i *>(words + i));
+                        const auto y = _mm_load_si128(reinterpret_cast<const __m128i *>(other.words + i));
+                        _mm_store_si128(reinterpret_cast<__m128i *>(words + i), _mm_or_si128(x, y));
+                  }
+#else
+                  for (auto i = 0u; i < 4u; ++i)
+                        words[i] |= other.words[i];
+#endif
+                  return *this;
+            }
+
+            /* this &= ~other */
+            regset &operator-=(const regset &other) {
+#if defined(__AVX2__)
+                  const auto x = _mm256_load_si256(reinterpret_cast<const __m256i *>(words));
+                  const auto y = _mm256_load_si256(reinterpret_cast<const __m256i *>(other.words));
+                  _mm256_store_si256(reinterpret_cast<__m256i *>(words), _mm256_andnot_si256(y, x));
+#elif defined(__SSE2__) || defined(_M_X64)
+                  for (auto i = 0u; i < 4u; i += 2u) {
+                        const auto x = _mm_load_si128(reinterpret_cast<const __m128i *>(words + i));
+                        const auto y = _mm_load_si128(reinterpret_cast<const __m128i *>(other.words + i));
+                        _mm_store_si128(reinterpret_cast<__m128i *>(words + i), _mm_andnot_si128(y, x));
+                  }
+#else
+                  for (auto i = 0u; i < 4u; ++i)
+                        words[i] &= ~other.words[i];
+#endif
+                  return *this;
+            }
+
+            friend regset operator|(const regset &lhs, const regset &rhs) {
+                  auto result = lhs;
+                  return result |= rhs;
+            }
+
+            friend regset operator-(const regset &lhs, const regset &rhs) {
+                  auto result = lhs;
+                  return result -= rhs;
+            }
+
+            friend bool operator==(const regset &lhs, const regset &rhs) {
+#if defined(__AVX2__)
+                  const auto x = _mm256_load_si256(reinterpret_cast<const __m256i *>(lhs.words));
+                  const auto y = _mm256_load_si256(reinterpret_cast<const __m256i *>(rhs.words));
+                  return _mm256_testz_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, y)) != 0;
+#else
+                  return ((lhs.words[0] ^ rhs.words[0]) | (lhs.words[1] ^ rhs.words[1]) | (lhs.words[2] ^ rhs.words[2]) | (lhs.words[3] ^ rhs.words[3])) == 0u;
+#endif
+            }
+
+            friend bool operator!=(const regset &lhs, const regset &rhs) {
+                  return !(lhs == rhs);
+            }
+      };
+
+      /*
+            How an instruction touches registers.
+            `generic` reads it straight off the operand kinds (dest writes, reg reads, val/reg in an RK slot reads unless it is a kvalue),
+            the rest are opcodes whose footprint is a register range or whose kinds describe something other than registers.
+      */
+      enum class shape : std::uint8_t {
+            generic,
+            none,        /* OP_JMP, OP_EXTRAARG. */
+            def_a,       /* OP_LOADKX. */
+            closure,     /* def A, use every register the child captures (upvalues with instack set). */
+            use_a,       /* OP_SETUPVAL. */
+            loadnil,     /* def A .. A+B */
+            table_b,     /* OP_GETTABLE: def A, use B, RK(C). */
+            self,        /* def A, A+1, use B, RK(C). */
+            concat,      /* def A, use B .. C */
+            testset,     /* use B, A is only written when the skip is not taken so it is not a kill. */
+            call,        /* use A .. A+B-1, def A .. A+C-2, B/C == 0 are open ranges. */
+            tailcall,    /* use A .. A+B-1 */
+            ret,         /* use A .. A+B-2 */
+            forloop,     /* use A .. A+2, def A, A+3 is only written on the taken edge so it is not a kill. */
+            forprep,     /* use A .. A+2, def A */
+            tforcall,    /* use A .. A+2, def A+3 .. A+2+C */
+            tforloop,    /* use A+1, A is only written on the taken edge so it is not a kill. */
+            setlist,     /* use A .. A+B */
+            vararg       /* def A .. A+B-2 */
+      };
+
+      constexpr shape shape_of(const opcodes op) {
+            switch (op) {
+                  case opcodes::OP_JMP:
+                  case opcodes::OP_EXTRAARG:
+                        return shape::none;
+                  case opcodes::OP_LOADKX:
+                        return shape::def_a;
+                  case opcodes::OP_CLOSURE:
+                        return shape::closure;
+                  case opcodes::OP_SETUPVAL:
+                        return shape::use_a;
+                  case opcodes::OP_LOADNIL:
+                        return shape::loadnil;
+                  case opcodes::OP_GETTABLE:
+                        return shape::table_b;
+                  case opcodes::OP_SELF:
+                        return shape::self;
+                  case opcodes::OP_CONCAT:
+                        return shape::concat;
+                  case opcodes::OP_TESTSET:
+                        return shape::testset;
+                  case opcodes::OP_CALL:
+                        return shape::call;
+                  case opcodes::OP_TAILCALL:
+                        return shape::tailcall;
+                  case opcodes::OP_RETURN:
+                        return shape::ret;
+                  case opcodes::OP_FORLOOP:
+                        return shape::forloop;
+                  case opcodes::OP_FORPREP:
+                        return shape::forprep;
+                  case opcodes::OP_TFORCALL:
+                        return shape::tforcall;
+                  case opcodes::OP_TFORLOOP:
+                        return shape::tforloop;
+                  case opcodes::OP_SETLIST:
+                        return shape::setlist;
+                  case opcodes::OP_VARARG:
+                        return shape::vararg;
+                  default:
+                        return shape::generic;
+            }
+      }
+
+      /* Registers one instruction reads and writes. */
+      struct access {
+            regset def;
+            regset use;
+      };
+
+      /* Registers each child proto captures from the enclosing frame, by child index. */
+      using captures = std::vector<regset>;
+
+      inline captures captured_registers(const chunk::proto &p) {
+            captures result(p.proto_count());
+            for (auto i = std::size_t{0u}; i < result.size(); ++i) {
+                  const auto &upvalues = p.child(i).upvalues;
+                  for (auto u = std::size_t{0u}; u < upvalues.size(); ++u) {
+                        const auto upvalue = upvalues[u];
+                        if (upvalue.instack != 0u)
+                              result[i].set(upvalue.idx);
+                  }
+            }
+            return result;
+      }
+
+      /*
+            `frame` is the proto's max stack size, open ranges (B or C of 0 on OP_CALL, OP_RETURN, ...) read up to it.
+            An open result count writes an unknown number of registers, so it is left out of `def` to keep liveness conservative.
+            Without `closures` an OP_CLOSURE is taken to capture the whole frame.
+      */
+      inline void effect(const std::uint8_t op, const std::uint32_t a, const std::uint32_t b, const std::uint32_t c, const std::uint8_t rk, const std::uint32_t frame, access &out, const captures *const closures = nullptr) {
+            out.def = regset{};
+            out.use = regset{};
+            const auto code = static_cast<opcodes>(op);
+            if (!opcode_valid(code))
+                  return;
+            switch (shape_of(code)) {
+                  case shape::generic: {
+                        const auto &entry = optable[op];
+                        for (auto i = 0u; i < entry.operand_count; ++i) {
+                              const auto &operand = entry.operands[i];
+                              const auto value = (operand.encoding == operand_encoding::A) ? a : (operand.encoding == operand_encoding::B) ? b : (operand.encoding == operand_encoding::C) ? c : register_max;
+                              const auto slot = (operand.encoding == operand_encoding::B) ? decoder::rk_b : (operand.encoding == operand_encoding::C) ? decoder::rk_c : 0u;
+                              if (operand.kind == operand_kind::dest) {
+                                    out.def.set(value);
+                              } else if (slot != 0u && (decoder::rk_masks.masks[op] & slot)) {
+                                    if (!(rk & slot))
+                                          out.use.set(value);
+                              } else if (operand.kind == operand_kind::reg) {
+                                    out.use.set(value);
+                              }
+                        }
+                        break;
+                  }
+                  case shape::none:
+                        break;
+                  case shape::def_a:
+                        out.def.set(a);
+                        break;
+                  case shape::closure: {
+                        /* Bx spans B:C. */
+                        const auto child = (b << 9u) | c;
+                        if (closures != nullptr && child < closures->size())
+                              out.use = (*closures)[child];
+                        else
+                              out.use.set_range(0u, frame);
+                        out.def.set(a);
+                        break;
+                  }
+                  case shape::use_a:
+                        out.use.set(a);
+                        break;
+                  case shape::loadnil:
+                        out.def.set_range(a, a + b + 1u);
+                        break;
+                  case shape::table_b:
+                        out.def.set(a);
+                        out.use.set(b);
+                        if (!(rk & decoder::rk_c))
+                              out.use.set(c);
+                        break;
+                  case shape::self:
+                        out.def.set_range(a, a + 2u);
+                        out.use.set(b);
+                        if (!(rk & decoder::rk_c))
+                              out.use.set(c);
+                        break;
+                  case shape::concat:
+                        out.def.set(a);
+                        out.use.set_range(b, c + 1u);
+                        break;
+                  case shape::testset:
+                        out.use.set(b);
+                        break;
+                  case shape::call:
+                        out.use.set_range(a, (b != 0u) ? a + b : frame);
+                        if (c != 0u)
+                              out.def.set_range(a, a + c - 1u);
+                        break;
+                  case shape::tailcall:
+                        out.use.set_range(a, (b != 0u) ? a + b : frame);
+                        break;
+                  case shape::ret:
+                        out.use.set_range(a, (b != 0u) ? a + b - 1u : frame);
+                        break;
+                  case shape::forloop:
+                        out.use.set_range(a, a + 3u);
+                        out.def.set(a);
+                        break;
+                  case shape::forprep:
+                        out.use.set_range(a, a + 3u);
+                        out.def.set(a);
+                        break;
+                  case shape::tforcall:
+                        out.use.set_range(a, a + 3u);
+                        out.def.set_range(a + 3u, a + 3u + c);
+                        break;
+                  case shape::tforloop:
+                        out.use.set(a + 1u);
+                        break;
+                  case shape::setlist:
+                        out.use.set_range(a, (b != 0u) ? a + b + 1u : frame);
+                        break;
+                  case shape::vararg:
+                        if (b != 0u)
+                              out.def.set_range(a, a + b - 1u);
+                        break;
+            }
+      }
+
+      inline void effect(const decoder::decoded &code, const std::size_t pc, const std::uint32_t frame, access &out, const captures *const closures = nullptr) {
+            effect(code.op[pc], code.a[pc], code.b[pc], code.c[pc], code.rk[pc], frame, out, closures);
+      }
+
+      /*
+            Backward liveness per block, solved with a worklist.
+            Owns a copy of the decoded code so edit() can patch single instructions and only re-solve what the edit can reach.
+      */
+      class liveness {
+          public:
+            /* Full solve. */
+            void solve(const chunk::proto &p) {
+                  p.code.decode(code);
+                  closures = captured_registers(p);
+                  closures_known = true;
+                  solve(static_cast<std::uint32_t>(p.max_stack_size));
+            }
+
+            /* Without `captured` (see captured_registers) closures count as reading the whole frame. */
+            void solve(const decoder::decoded &decoded, const std::uint32_t frame_size = register_max, const captures *const captured = nullptr) {
+                  code = decoded;
+                  closures_known = captured != nullptr;
+                  if (closures_known)
+                        closures = *captured;
+                  solve(frame_size);
+            }
+
+            /*
+                  Replaces the instruction at `pc`.
+                  When the control flow is untouched only the edited block and the blocks that can reach it are re-solved,
+                  otherwise the graph is rebuilt and everything is solved again. Returns whether the incremental path was taken.
+            */
+            bool edit(const std::size_t pc, const std::uint32_t word) {
+                  const auto before = flow_key(pc);
+                  auto view = code.view();
+                  decoder::decode_scalar(&word, 1u, {view.op + pc, view.a + pc, view.b + pc, view.c + pc, view.bx + pc, view.sbx + pc, view.ax + pc, view.rk + pc});
+                  if (flow_key(pc) != before) {
+                        solve(frame);
+                        return false;
+                  }
+
+                  const auto changed = graph->block_of[pc];
+                  summarize(changed);
+
+                  /* Everything that can reach the edit, nothing else can see a different answer. */
+                  queued.assign(queued.size(), 0u);
+                  worklist.clear();
+                  worklist.push_back(changed);
+                  queued[changed] = 1u;
+                  for (auto i = std::size_t{0u}; i < worklist.size(); ++i) {
+                        for (auto e = graph->blocks[worklist[i]]->preds; e != nullptr; e = e->next_pred) {
+                              if (!queued[e->from->id]) {
+                                    queued[e->from->id] = 1u;
+                                    worklist.push_back(e->from->id);
+                              }
+                        }
+                  }
+                  for (const auto b : worklist) {
+                        live_in_sets[b] = regset{};
+                        live_out_sets[b] = regset{};
+                  }
+                  std::reverse(worklist.begin(), worklist.end());
+                  iterate();
+                  return true;
+            }
+
+            const cfg::graph &blocks() const {
+                  return *graph;
+            }
+
+            const decoder::decoded &instructions() const {
+                  return code;
+            }
+
+            const regset &live_in(const std::uint32_t block) const {
+                  return live_in_sets[block];
+            }
+
+            const regset &live_out(const std::uint32_t block) const {
+                  return live_out_sets[block];
+            }
+
+            /* Registers read in the block before any write to them, and registers the block writes. */
+            const regset &uses(const std::uint32_t block) const {
+                  return gen[block];
+            }
+
+            const regset &defs(const std::uint32_t block) const {
+                  return kill[block];
+            }
+
+            /* Live right after `pc` executes, walks back from the end of its block. */
+            regset live_after(const std::size_t pc) const {
+                  const auto &b = *graph->blocks[graph->block_of[pc]];
+                  auto live = live_out_sets[b.id];
+                  access step;
+                  for (auto at = static_cast<std::size_t>(b.end); at-- > pc + 1u;) {
+                        effect(code, at, frame, step, known());
+                        live -= step.def;
+                        live |= step.use;
+                  }
+                  return live;
+            }
+
+            regset live_before(const std::size_t pc) const {
+                  auto live = live_after(pc);
+                  access step;
+                  effect(code, pc, frame, step, known());
+                  live -= step.def;
+                  live |= step.use;
+                  return live;
+            }
+
+            /* Blocks the last solve or edit evaluated, a measure of how much work an edit cost. */
+            std::size_t visits() const {
+                  return visit_count;
+            }
+
+          private:
+            cfg::builder builder;
+            const cfg::graph *graph = nullptr;
+            decoder::decoded code;
+            std::uint32_t frame = register_max;
+            captures closures;
+            bool closures_known = false;
+            std::vector<regset> gen;
+            std::vector<regset> kill;
+            std::vector<regset> live_in_sets;
+            std::vector<regset> live_out_sets;
+            std::vector<std::uint32_t> worklist;
+            std::vector<std::uint8_t> queued;
+            std::size_t visit_count = 0u;
+
+            const captures *known() const {
+                  return closures_known ? &closures : nullptr;
+            }
+
+            void solve(const std::uint32_t frame_size) {
+                  frame = (frame_size < register_max) ? frame_size : register_max;
+                  graph = &builder.build(code);
+                  const auto count = graph->block_count;
+                  gen.assign(count, regset{});
+                  kill.assign(count, regset{});
+                  live_in_sets.assign(count, regset{});
+                  live_out_sets.assign(count, regset{});
+                  queued.assign(count, 1u);
+                  worklist.clear();
+                  for (auto b = 0u; b < count; ++b) {
+                        summarize(b);
+                        worklist.push_back(b);
+                  }
+                  iterate();
+            }
+
+            void summarize(const std::uint32_t id) {
+                  const auto &b = *graph->blocks[id];
+                  regset live{};
+                  regset written{};
+                  access step;
+                  for (auto pc = b.end; pc-- > b.start;) {
+                        effect(code, pc, frame, step, known());
+                        live -= step.def;
+                        live |= step.use;
+                        written |= step.def;
+                  }
+                  gen[id] = live;
+                  kill[id] = written;
+            }
+
+            /* Pops the highest block first, so straight-line code converges in one backward sweep. */
+            void iterate() {
+                  visit_count = 0u;
+                  while (!worklist.empty()) {
+                        const auto id = worklist.back();
+                        worklist.pop_back();
+                        queued[id] = 0u;
+                        ++visit_count;
+
+                        const auto &b = *graph->blocks[id];
+                        regset out{};
+                        for (auto e = b.succs; e != nullptr; e = e->next_succ)
+                              out |= live_in_sets[e->to->id];
+                        live_out_sets[id] = out;
+                        const auto in = gen[id] | (out - kill[id]);
+                        if (in == live_in_sets[id])
+                              continue;
+                        live_in_sets[id] = in;
+                        for (auto e = b.preds; e != nullptr; e = e->next_pred) {
+                              if (!queued[e->from->id]) {
+                                    queued[e->from->id] = 1u;
+                                    worklist.push_back(e->from->id);
+                              }
+                        }
+                  }
+            }
+
+            /* Everything about an instruction that the cfg builder looks at. */
+            struct flow_state {
+                  cfg::flow flow;
+                  std::int32_t target;
+                  bool flag;
+                  bool extra; /* OP_EXTRAARG, pairs with OP_LOADKX / OP_SETLIST before it. */
+
+                  bool operator!=(const flow_state &other) const {
+                        return flow != other.flow || target != other.target || flag != other.flag || extra != other.extra;
+                  }
+            };
+
+            flow_state flow_key(const std::size_t pc) const {
+                  const auto op = static_cast<opcodes>(code.op[pc]);
+                  if (!opcode_valid(op))
+                        return {cfg::flow::next, 0, false, false};
+                  const auto flow = cfg::flow_of(op);
+                  const auto jumps = flow == cfg::flow::jump || flow == cfg::flow::loop;
+                  const auto flagged = flow == cfg::flow::skip_if_c || op == opcodes::OP_SETLIST;
+                  return {flow, jumps ? code.sbx[pc] : 0, flagged && code.c[pc] != 0u, op == opcodes::OP_EXTRAARG};
+            }
+      };
+
+} // namespace dataflow
@@ -0,0 +1,374 @@
+#pragma once
+
+#include "header.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DECODER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define DECODER_TARGET(isa)
+#else
+#define DECODER_TARGET(isa) __attribute__((target(isa)))
+#endif
+#else
+#define DECODER_X86 0
+#endif
+
+/*
+      Batch decoder for Lua 5.3.6 instruction words.
+      Fills struct-of-arrays output (op, A, B, C, Bx, sBx, Ax) and flags RK constant operands, the kernel is picked at runtime.
+*/
+namespace decoder {
+
+      constexpr std::uint32_t rk_bit = 1u << 8u; /* BITRK, B/C high bit marks a kvalue index. */
+      constexpr std::uint8_t rk_b = 1u << 0u;    /* B is a kvalue index. */
+      constexpr std::uint8_t rk_c = 1u << 1u;    /* C is a kvalue index. */
+
+      /* Which of B/C are RK operands (OP_GETTABLE C, OP_ADD B and C, ...), words past OP_EXTRAARG never flag. */
+      constexpr std::uint8_t rk_mask_of(const opcodes op) {
+            switch (op) {
+                  case opcodes::OP_GETTABUP:
+                  case opcodes::OP_GETTABLE:
+                  case opcodes::OP_SELF:
+                        return rk_c;
+                  case opcodes::OP_SETTABUP:
+                  case opcodes::OP_SETTABLE:
+                  case opcodes::OP_ADD:
+                  case opcodes::OP_SUB:
+                  case opcodes::OP_MUL:
+                  case opcodes::OP_MOD:
+                  case opcodes::OP_POW:
+                  case opcodes::OP_DIV:
+                  case opcodes::OP_IDIV:
+                  case opcodes::OP_BAND:
+                  case opcodes::OP_BOR:
+                  case opcodes::OP_BXOR:
+                  case opcodes::OP_SHL:
+                  case opcodes::OP_SHR:
+                  case opcodes::OP_EQ:
+                  case opcodes::OP_LT:
+                  case opcodes::OP_LE:
+                        return rk_b | rk_c;
+                  default:
+                        return 0u;
+            }
+      }
+
+      /* rk_mask_of for every 6 bit opcode value, 16 byte rows so SIMD kernels can pshufb it. */
+      struct rk_table {
+            alignas(16) std::uint8_t masks[1u << op_bits];
+      };
+      constexpr rk_table make_rk_table() {
+            rk_table table{};
+            for (auto i = 0u; i < (1u << op_bits); ++i)
+                  table.masks[i] = rk_mask_of(static_cast<opcodes>(i));
+            return table;
+      }
+      inline constexpr rk_table rk_masks = make_rk_table();
+
+      /* Caller owned output arrays, each must hold at least the decoded count. */
+      struct soa_view {
+            std::uint8_t *op;
+            std::uint8_t *a;
+            std::uint16_t *b;
+            std::uint16_t *c;
+            std::uint32_t *bx;
+            std::int32_t *sbx;
+            std::uint32_t *ax;
+            std::uint8_t *rk;
+      };
+
+      /* Owning struct-of-arrays storage. */
+      class decoded {
+          public:
+            std::vector<std::uint8_t> op;
+            std::vector<std::uint8_t> a;
+            std::vector<std::uint16_t> b;
+            std::vector<std::uint16_t> c;
+            std::vector<std::uint32_t> bx;
+            std::vector<std::int32_t> sbx;
+            std::vector<std::uint32_t> ax;
+            std::vector<std::uint8_t> rk;
+
+            void resize(const std::size_t count) {
+                  op.resize(count);
+                  a.resize(count);
+                  b.resize(count);
+                  c.resize(count);
+                  bx.resize(count);
+                  sbx.resize(count);
+                  ax.resize(count);
+                  rk.resize(count);
+            }
+
+            std::size_t size() const {
+                  return op.size();
+            }
+
+            soa_view view() {
+                  return {op.data(), a.data(), b.data(), c.data(), bx.data(), sbx.data(), ax.data(), rk.data()};
+            }
+
+            opcodes opcode(const std::size_t pc) const {
+                  return static_cast<opcodes>(op[pc]);
+            }
+
+            /* Operand by encoding, sBx comes back unbiased. */
+            std::int32_t operand(const std::size_t pc, const operand_encoding encoding) const {
+                  switch (encoding) {
+                        case operand_encoding::A:
+                              return a[pc];
+                        case operand_encoding::B:
+                              return b[pc];
+                        case operand_encoding::C:
+                              return c[pc];
+                        case operand_encoding::Bx:
+                              return static_cast<std::int32_t>(bx[pc]);
+                        case operand_encoding::Ax:
+                              return static_cast<std::int32_t>(ax[pc]);
+                        case operand_encoding::sBx:
+                              return sbx[pc];
+                  }
+                  return 0;
+            }
+      };
+
+      enum class kernel {
+            scalar,
+            sse4,
+            avx2
+      };
+
+      inline const char *kernel_name(const kernel k) {
+            switch (k) {
+                  case kernel::scalar:
+                        return "scalar";
+                  case kernel::sse4:
+                        return "sse4";
+                  case kernel::avx2:
+                        return "avx2";
+            }
+            return "unknown";
+      }
+
+      /* Best kernel this CPU supports. */
+      inline kernel detect() {
+#if DECODER_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+            std::int32_t info[4];
+            __cpuid(info, 0);
+            const auto max_leaf = info[0];
+            __cpuid(info, 1);
+            const auto sse41 = (info[2] & (1 << 19)) != 0;
+            const auto osxsave = (info[2] & (1 << 27)) != 0;
+            auto avx2 = false;
+            if (max_leaf >= 7 && osxsave && (_xgetbv(0) & 6u) == 6u) {
+                  __cpuidex(info, 7, 0);
+                  avx2 = (info[1] & (1 << 5)) != 0;
+            }
+#else
+            __builtin_cpu_init();
+            const auto sse41 = __builtin_cpu_supports("sse4.1") != 0;
+            const auto avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+            if (avx2)
+                  return kernel::avx2;
+            if (sse41)
+                  return kernel::sse4;
+#endif
+            return kernel::scalar;
+      }
+
+      namespace detail {
+
+            inline std::atomic<kernel> &selected() {
+                  static std::atomic<kernel> k{detect()};
+                  return k;
+            }
+
+            inline std::uint32_t load_word(const std::uint8_t *const bytes) {
+                  std::uint32_t word;
+                  std::memcpy(&word, bytes, sizeof(word));
+                  return word;
+            }
+
+      } // namespace detail
+
+      /* Kernel decode() dispatches to. */
+      inline kernel active() {
+            return detail::selected().load(std::memory_order_relaxed);
+      }
+
+      /* Forces a kernel, anything the CPU lacks falls back to the best supported one. */
+      inline void select(const kernel k) {
+            detail::selected().store((static_cast<std::int32_t>(k) <= static_cast<std::int32_t>(detect())) ? k : detect(), std::memory_order_relaxed);
+      }
+
+      /* Words may be unaligned (e.g. straight out of a mapped chunk). */
+      inline void decode_scalar(const void *const code, const std::size_t count, const soa_view &out) {
+            const auto bytes = static_cast<const std::uint8_t *>(code);
+            for (auto i = std::size_t{0u}; i < count; ++i) {
+                  const auto word = detail::load_word(bytes + i * 4u);
+                  const auto op = word & op_mask;
+                  const auto b = static_cast<std::uint16_t>(word >> 23u);
+                  const auto c = static_cast<std::uint16_t>((word >> 14u) & 0x1FFu);
+                  const auto bx = word >> 14u;
+                  out.op[i] = static_cast<std::uint8_t>(op);
+                  out.a[i] = static_cast<std::uint8_t>(word >> 6u);
+                  out.b[i] = b;
+                  out.c[i] = c;
+                  out.bx[i] = bx;
+                  out.sbx[i] = static_cast<std::int32_t>(bx) - field_of(operand_encoding::sBx).bias;
+                  out.ax[i] = word >> 6u;
+                  out.rk[i] = static_cast<std::uint8_t>((((b >> 8u) & 1u) | ((c >> 7u) & 2u)) & rk_masks.masks[op]);
+            }
+      }
+
+#if DECODER_X86
+
+      namespace detail {
+
+            /* rk_masks[ops] for 16 opcode bytes (all below 64): one pshufb per 16 entry row, picked by the top two bits. */
+            DECODER_TARGET("sse4.1")
+            inline __m128i rk_lookup(const __m128i ops) {
+                  const auto low = _mm_and_si128(ops, _mm_set1_epi8(0x0F));
+                  const auto row = _mm_and_si128(_mm_srli_epi16(ops, 4), _mm_set1_epi8(0x03));
+                  auto result = _mm_setzero_si128();
+                  for (auto r = 0; r < 4; ++r) {
+                        const auto table = _mm_load_si128(reinterpret_cast<const __m128i *>(rk_masks.masks + r * 16));
+                        const auto hit = _mm_cmpeq_epi8(row, _mm_set1_epi8(static_cast<char>(r)));
+                        result = _mm_or_si128(result, _mm_and_si128(hit, _mm_shuffle_epi8(table, low)));
+                  }
+                  return result;
+            }
+
+            DECODER_TARGET("sse2")
+            inline void store_bytes(std::uint8_t *const dst, const __m128i v, const std::size_t n) {
+                  alignas(16) std::uint8_t lanes[16];
+                  _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+                  std::memcpy(dst, lanes, n);
+            }
+
+      } // namespace detail
+
+      DECODER_TARGET("sse4.1")
+      inline void decode_sse4(const void *const code, const std::size_t count, const soa_view &out) {
+            const auto bytes = static_cast<const std::uint8_t *>(code);
+            const auto m6 = _mm_set1_epi32(0x3F);
+            const auto m8 = _mm_set1_epi32(0xFF);
+            const auto m9 = _mm_set1_epi32(0x1FF);
+            const auto one = _mm_set1_epi32(1);
+            const auto bias = _mm_set1_epi32(field_of(operand_encoding::sBx).bias);
+
+            auto i = std::size_t{0u};
+            for (; i + 4u <= count; i += 4u) {
+                  const auto w = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i * 4u));
+                  const auto op = _mm_and_si128(w, m6);
+                  const auto a = _mm_and_si128(_mm_srli_epi32(w, 6), m8);
+                  const auto c = _mm_and_si128(_mm_srli_epi32(w, 14), m9);
+                  const auto b = _mm_srli_epi32(w, 23);
+                  const auto bx = _mm_srli_epi32(w, 14);
+                  const auto ax = _mm_srli_epi32(w, 6);
+
+                  _mm_storeu_si128(reinterpret_cast<__m128i *>(out.bx + i), bx);
+                  _mm_storeu_si128(reinterpret_cast<__m128i *>(out.sbx + i), _mm_sub_epi32(bx, bias));
+                  _mm_storeu_si128(reinterpret_cast<__m128i *>(out.ax + i), ax);
+                  _mm_storel_epi64(reinterpret_cast<__m128i *>(out.b + i), _mm_packus_epi32(b, b));
+                  _mm_storel_epi64(reinterpret_cast<__m128i *>(out.c + i), _mm_packus_epi32(c, c));
+
+                  const auto op8 = _mm_packus_epi16(_mm_packus_epi32(op, op), _mm_setzero_si128());
+                  const auto a8 = _mm_packus_epi16(_mm_packus_epi32(a, a), _mm_setzero_si128());
+                  const auto raw = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(b, 8), one), _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(c, 8), one), 1));
+                  const auto raw8 = _mm_packus_epi16(_mm_packus_epi32(raw, raw), _mm_setzero_si128());
+                  detail::store_bytes(out.op + i, op8, 4u);
+                  detail::store_bytes(out.a + i, a8, 4u);
+                  detail::store_bytes(out.rk + i, _mm_and_si128(raw8, detail::rk_lookup(op8)), 4u);
+            }
+
+            const soa_view tail = {out.op + i, out.a + i, out.b + i, out.c + i, out.bx + i, out.sbx + i, out.ax + i, out.rk + i};
+            decode_scalar(bytes + i * 4u, count - i, tail);
+      }
+
+      namespace detail {
+
+            /* 8 dwords (below 65536) to 8 words in the low half. */
+            DECODER_TARGET("avx2")
+            inline __m128i pack_u16(const __m256i v) {
+                  return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08));
+            }
+
+      } // namespace detail
+
+      DECODER_TARGET("avx2")
+      inline void decode_avx2(const void *const code, const std::size_t count, const soa_view &out) {
+            const auto bytes = static_cast<const std::uint8_t *>(code);
+            const auto m6 = _mm256_set1_epi32(0x3F);
+            const auto m8 = _mm256_set1_epi32(0xFF);
+            const auto m9 = _mm256_set1_epi32(0x1FF);
+            const auto one = _mm256_set1_epi32(1);
+            const auto bias = _mm256_set1_epi32(field_of(operand_encoding::sBx).bias);
+
+            auto i = std::size_t{0u};
+            for (; i + 8u <= count; i += 8u) {
+                  const auto w = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bytes + i * 4u));
+                  const auto op = _mm256_and_si256(w, m6);
+                  const auto a = _mm256_and_si256(_mm256_srli_epi32(w, 6), m8);
+                  const auto c = _mm256_and_si256(_mm256_srli_epi32(w, 14), m9);
+                  const auto b = _mm256_srli_epi32(w, 23);
+                  const auto bx = _mm256_srli_epi32(w, 14);
+                  const auto ax = _mm256_srli_epi32(w, 6);
+
+                  _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.bx + i), bx);
+                  _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.sbx + i), _mm256_sub_epi32(bx, bias));
+                  _mm256_storeu_si256(reinterpret_cast<__m256i *>(out.ax + i), ax);
+
+                  const auto b16 = detail::pack_u16(b);
+                  const auto c16 = detail::pack_u16(c);
+                  _mm_storeu_si128(reinterpret_cast<__m128i *>(out.b + i), b16);
+                  _mm_storeu_si128(reinterpret_cast<__m128i *>(out.c + i), c16);
+
+                  const auto op8 = _mm_packus_epi16(detail::pack_u16(op), _mm_setzero_si128());
+                  const auto a8 = _mm_packus_epi16(detail::pack_u16(a), _mm_setzero_si128());
+                  const auto raw = _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(b, 8), one), _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(c, 8), one), 1));
+                  const auto raw8 = _mm_packus_epi16(detail::pack_u16(raw), _mm_setzero_si128());
+                  _mm_storel_epi64(reinterpret_cast<__m128i *>(out.op + i), op8);
+                  _mm_storel_epi64(reinterpret_cast<__m128i *>(out.a + i), a8);
+                  _mm_storel_epi64(reinterpret_cast<__m128i *>(out.rk + i), _mm_and_si128(raw8, detail::rk_lookup(op8)));
+            }
+
+            const soa_view tail = {out.op + i, out.a + i, out.b + i, out.c + i, out.bx + i, out.sbx + i, out.ax + i, out.rk + i};
+            decode_scalar(bytes + i * 4u, count - i, tail);
+      }
+
+#endif
+
+      /* Decodes `count` words with the active kernel. */
+      inline void decode(const void *const code, const std::size_t count, const soa_view &out) {
+            switch (active()) {
+#if DECODER_X86
+                  case kernel::avx2:
+                        decode_avx2(code, count, out);
+                        return;
+                  case kernel::sse4:
+                        decode_sse4(code, count, out);
+                        return;
+#endif
+                  default:
+                        decode_scalar(code, count, out);
+                        return;
+            }
+      }
+
+      inline void decode(const std::uint32_t *const code, const std::size_t count, decoded &out) {
+            out.resize(count);
+            decode(static_cast<const void *>(code), count, out.view());
+      }
+
+} // namespace decoder
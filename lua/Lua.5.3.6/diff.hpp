@@ -0,0 +1,640 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+#include "search.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+      Structural diff between two versions of a chunk.
+
+      Instructions are aligned on a register-free form: register operands (operand_kind dest / reg, RK operands holding
+      a register) are only marked as registers, constant operands become a hash of the constant's value, OP_CLOSURE names
+      the child by its structural hash and jumps keep their offset. An edit early in a proto so never shifts the rest.
+      A second pass over the aligned pairs picks the register bijection most pairs vote for, pairs that follow it are
+      equal or renamed, pairs that contradict it are changed. A consistent renaming of registers or a reordered constant
+      table is therefore no change, different dataflow or control flow is.
+
+      Protos are matched by structural hash (the register-free code plus registers numbered by first occurrence, so equal
+      exactly up to renaming, and of the whole subtree), then by MinHash similarity of register-free 4-instruction
+      shingles through LSH buckets, then by position under matched parents. Matched pairs that differ are aligned with
+      Myers' linear space algorithm.
+*/
+namespace diff {
+
+      constexpr std::uint32_t npos = ~0u;
+      constexpr std::size_t minhash_size = 16u;
+      constexpr std::size_t band_rows = 4u;
+      constexpr std::size_t shingle_length = 4u;
+
+      enum class edit_kind : std::uint8_t {
+            equal,
+            renamed,   /* Follows the register bijection, the raw words differ (registers renamed, constants renumbered). */
+            changed,   /* Same opcode, different operands or registers against the bijection. */
+            inserted,
+            deleted
+      };
+
+      struct edit {
+            edit_kind kind;
+            std::uint32_t old_pc; /* npos for inserted. */
+            std::uint32_t new_pc; /* npos for deleted. */
+            opcodes old_op;
+            opcodes new_op;
+      };
+
+      enum class function_status : std::uint8_t {
+            unchanged, /* Same structural hash, registers may still be renamed. */
+            modified,
+            inserted,
+            deleted
+      };
+
+      struct function_diff {
+            function_status status = function_status::unchanged;
+            std::uint32_t old_index = npos; /* Preorder index, 0 is the main function. */
+            std::uint32_t new_index = npos;
+            std::string old_name;
+            std::string new_name;
+            double similarity = 1.0; /* MinHash estimate of shingle overlap. */
+            std::uint32_t equal = 0u;
+            std::uint32_t renamed = 0u;
+            std::uint32_t changed = 0u;
+            std::uint32_t inserted = 0u;
+            std::uint32_t deleted = 0u;
+            std::vector<edit> edits; /* Everything except plain equal instructions, in order. */
+      };
+
+      struct report {
+            std::vector<function_diff> functions; /* Old preorder first, inserted functions after. */
+            std::uint32_t unchanged = 0u;
+            std::uint32_t modified = 0u;
+            std::uint32_t inserted = 0u;
+            std::uint32_t deleted = 0u;
+      };
+
+      struct options {
+            double threshold = 0.25;  /* Least MinHash similarity for a fuzzy match. */
+            bool keep_edits = true;
+      };
+
+      namespace detail {
+
+            inline std::uint64_t mix(std::uint64_t h, const std::uint64_t v) {
+                  h = (h ^ v) * 0x9E3779B97F4A7C15ull;
+                  return h ^ (h >> 29u);
+            }
+
+            constexpr std::uint64_t blank = 0x5eed;
+            constexpr std::uint64_t register_tag = 0x7e6;
+
+            /* One proto of a flattened chunk. */
+            struct function {
+                  const chunk::proto *proto;
+                  std::string name;
+                  std::uint32_t parent;
+                  std::uint32_t child_index;
+                  std::vector<std::uint64_t> normalized;  /* Register-free, what Myers aligns. */
+                  std::vector<std::uint16_t> registers;   /* Register operands of every instruction, in operand order. */
+                  std::vector<std::uint32_t> register_at; /* Per pc, where its registers start, one past the end last. */
+                  std::uint64_t structure;
+                  std::uint64_t minhash[minhash_size];
+                  std::uint32_t match;
+            };
+
+            /* Children first so OP_CLOSURE can name them by structure, indices stay preorder. */
+            inline void flatten(const chunk::proto &p, std::string name, const std::uint32_t parent, const std::uint32_t child_index, std::vector<function> &out, decoder::decoded &scratch) {
+                  const auto self = static_cast<std::uint32_t>(out.size());
+                  out.push_back(function{&p, std::move(name), parent, child_index, {}, {}, {}, 0u, {}, npos});
+                  std::vector<std::uint32_t> children;
+                  for (auto i = 0u; i < p.proto_count(); ++i) {
+                        children.push_back(static_cast<std::uint32_t>(out.size()));
+                        flatten(p.child(i), out[self].name + "." + std::to_string(i), self, i, out, scratch);
+                  }
+
+                  p.code.decode(scratch);
+                  const auto count = scratch.size();
+                  const auto constants = p.constants.size();
+                  std::vector<std::uint64_t> values(constants);
+                  for (auto i = std::size_t{0u}; i < constants; ++i)
+                        values[i] = search::constant_term(p.constants[i]);
+                  const auto constant = [&](const std::uint32_t index) {
+                        return (index < constants) ? values[index] : mix(blank, index);
+                  };
+
+                  auto &f = out[self];
+                  f.normalized.resize(count);
+                  f.registers.clear();
+                  f.register_at.resize(count + 1u);
+                  auto structure = mix(0u, count);
+
+                  /* Only the structure sees register numbers, alpha-renamed: the n-th distinct register the proto mentions becomes n. */
+                  std::uint16_t renamed[512];
+                  std::fill(std::begin(renamed), std::end(renamed), std::uint16_t{0xFFFFu});
+                  auto next_register = std::uint16_t{0u};
+                  const auto reg = [&](const std::uint32_t r) {
+                        if (r >= std::size(renamed))
+                              return mix(blank, r);
+                        if (renamed[r] == 0xFFFFu)
+                              renamed[r] = next_register++;
+                        structure = mix(structure, renamed[r]);
+                        f.registers.push_back(static_cast<std::uint16_t>(r));
+                        return register_tag;
+                  };
+
+                  for (auto pc = std::size_t{0u}; pc < count; ++pc) {
+                        f.register_at[pc] = static_cast<std::uint32_t>(f.registers.size());
+                        const auto raw = scratch.op[pc];
+                        const auto op = static_cast<opcodes>(raw);
+                        auto h = mix(0u, raw);
+                        if (!opcode_valid(op)) {
+                              h = mix(h, scratch.ax[pc]);
+                        } else if (op == opcodes::OP_EXTRAARG && pc > 0u && static_cast<opcodes>(scratch.op[pc - 1u]) == opcodes::OP_LOADKX) {
+                              h = mix(h, constant(scratch.ax[pc]));
+                        } else {
+                              const auto &entry = optable[raw];
+                              const auto rk = decoder::rk_masks.masks[raw];
+                              for (auto i = 0u; i < entry.operand_count; ++i) {
+                                    const auto &operand = entry.operands[i];
+                                    const auto value = static_cast<std::uint32_t>(scratch.operand(pc, operand.encoding));
+                                    const auto slot = (operand.encoding == operand_encoding::B) ? decoder::rk_b : (operand.encoding == operand_encoding::C) ? decoder::rk_c : 0u;
+                                    if (rk & slot) {
+                                          h = mix(h, (value & decoder::rk_bit) ? constant(value & ~decoder::rk_bit) : reg(value));
+                                          continue;
+                                    }
+                                    switch (operand.kind) {
+                                          case operand_kind::dest:
+                                          case operand_kind::reg:
+                                                h = mix(h, reg(value));
+                                                break;
+                                          case operand_kind::k_idx:
+                                                h = mix(h, constant(value));
+                                                break;
+                                          case operand_kind::k_idx_p:
+                                                h = mix(h, (value < children.size()) ? out[children[value]].structure : mix(blank, value));
+                                                break;
+                                          case operand_kind::jmp:
+                                                h = mix(h, value);
+                                                break;
+                                          default:
+                                                h = mix(h, value);
+                                                break;
+                                    }
+                              }
+                        }
+                        f.normalized[pc] = h;
+                        structure = mix(structure, h);
+                  }
+                  f.register_at[count] = static_cast<std::uint32_t>(f.registers.size());
+                  f.structure = structure;
+            }
+
+            /* MinHash over shingles, a proto shorter than one shingle is a single shingle. Only unmatched protos need it. */
+            inline void sketch(function &f) {
+                  const auto count = f.normalized.size();
+                  std::fill(std::begin(f.minhash), std::end(f.minhash), ~0ull);
+                  const auto shingles = (count >= shingle_length) ? count - shingle_length + 1u : std::size_t{1u};
+                  for (auto s = std::size_t{0u}; s < shingles; ++s) {
+                        auto shingle = std::uint64_t{0u};
+                        for (auto i = s; i < std::min(count, s + shingle_length); ++i)
+                              shingle = mix(shingle, f.normalized[i]);
+                        for (auto j = std::size_t{0u}; j < minhash_size; ++j)
+                              f.minhash[j] = std::min(f.minhash[j], mix(shingle, j * 0xD6E8FEB86659FD93ull + 1u));
+                  }
+            }
+
+            inline double similarity(const function &a, const function &b) {
+                  auto same = 0u;
+                  for (auto j = std::size_t{0u}; j < minhash_size; ++j)
+                        same += (a.minhash[j] == b.minhash[j]) ? 1u : 0u;
+                  return static_cast<double>(same) / static_cast<double>(minhash_size);
+            }
+
+            inline std::uint64_t band(const function &f, const std::size_t b) {
+                  auto h = mix(0u, b);
+                  for (auto r = b * band_rows; r < (b + 1u) * band_rows; ++r)
+                        h = mix(h, f.minhash[r]);
+                  return h;
+            }
+
+            /*
+                  Register renaming between two aligned protos: every aligned pair votes for its (old, new) register
+                  pairs, the most voted pairs bind first and a register binds at most once on each side.
+            */
+            class bijection {
+                public:
+                  void bind(const function &a, const function &b, const std::vector<edit> &script) {
+                        votes.clear();
+                        for (const auto &e : script) {
+                              if (e.kind != edit_kind::equal)
+                                    continue;
+                              const auto n = a.register_at[e.old_pc + 1u] - a.register_at[e.old_pc];
+                              if (n != b.register_at[e.new_pc + 1u] - b.register_at[e.new_pc])
+                                    continue;
+                              for (auto i = 0u; i < n; ++i)
+                                    votes.push_back((static_cast<std::uint32_t>(a.registers[a.register_at[e.old_pc] + i]) << 16u) | b.registers[b.register_at[e.new_pc] + i]);
+                        }
+                        std::sort(votes.begin(), votes.end());
+                        ranked.clear();
+                        for (auto i = std::size_t{0u}; i < votes.size();) {
+                              auto j = i;
+                              while (j < votes.size() && votes[j] == votes[i])
+                                    ++j;
+                              ranked.emplace_back(static_cast<std::uint32_t>(j - i), votes[i]);
+                              i = j;
+                        }
+                        std::sort(ranked.begin(), ranked.end(), [](const auto &l, const auto &r) { return l.first > r.first || (l.first == r.first && l.second < r.second); });
+                        std::fill(std::begin(old_to_new), std::end(old_to_new), unbound);
+                        std::fill(std::begin(new_to_old), std::end(new_to_old), unbound);
+                        for (const auto &vote : ranked) {
+                              const auto from = vote.second >> 16u;
+                              const auto to = vote.second & 0xFFFFu;
+                              if (old_to_new[from] == unbound && new_to_old[to] == unbound) {
+                                    old_to_new[from] = static_cast<std::uint16_t>(to);
+                                    new_to_old[to] = static_cast<std::uint16_t>(from);
+                              }
+                        }
+                  }
+
+                  /* Whether every register of the aligned pair maps through the bijection. */
+                  bool follows(const function &a, const function &b, const std::uint32_t old_pc, const std::uint32_t new_pc) const {
+                        const auto n = a.register_at[old_pc + 1u] - a.register_at[old_pc];
+                        if (n != b.register_at[new_pc + 1u] - b.register_at[new_pc])
+                              return false;
+                        for (auto i = 0u; i < n; ++i) {
+                              if (old_to_new[a.registers[a.register_at[old_pc] + i]] != b.registers[b.register_at[new_pc] + i])
+                                    return false;
+                        }
+                        return true;
+                  }
+
+                private:
+                  static constexpr std::uint16_t unbound = 0xFFFFu;
+
+                  std::vector<std::uint32_t> votes;
+                  std::vector<std::pair<std::uint32_t, std::uint32_t>> ranked; /* Votes, (old << 16 | new). */
+                  std::uint16_t old_to_new[512];
+                  std::uint16_t new_to_old[512];
+            };
+
+      } // namespace detail
+
+      /*
+            Shortest edit script in O((N + M) D) time and linear space: trim common ends, find the middle snake,
+            recurse on both halves. emit(kind, old_pc, new_pc) runs in order with kind equal, inserted or deleted.
+      */
+      class myers {
+          public:
+            template <typename Emit>
+            void run(const std::uint64_t *const a, const std::uint32_t n, const std::uint64_t *const b, const std::uint32_t m, Emit &&emit) {
+                  old_code = a;
+                  new_code = b;
+                  const auto size = 2u * (static_cast<std::size_t>(n) + m) + 4u;
+                  forward.resize(size);
+                  backward.resize(size);
+                  compare(0u, n, 0u, m, emit);
+            }
+
+          private:
+            const std::uint64_t *old_code = nullptr;
+            const std::uint64_t *new_code = nullptr;
+            std::vector<std::int64_t> forward;
+            std::vector<std::int64_t> backward;
+
+            struct snake {
+                  std::int64_t x0, y0, x1, y1;
+            };
+
+            template <typename Emit>
+            void compare(std::uint32_t a0, std::uint32_t a1, std::uint32_t b0, std::uint32_t b1, Emit &emit) {
+                  while (a0 < a1 && b0 < b1 && old_code[a0] == new_code[b0])
+                        emit(edit_kind::equal, a0++, b0++);
+                  auto tail = 0u;
+                  while (a1 > a0 && b1 > b0 && old_code[a1 - 1u] == new_code[b1 - 1u]) {
+                        --a1;
+                        --b1;
+                        ++tail;
+                  }
+                  if (a0 == a1) {
+                        for (auto y = b0; y < b1; ++y)
+                              emit(edit_kind::inserted, npos, y);
+                  } else if (b0 == b1) {
+                        for (auto x = a0; x < a1; ++x)
+                              emit(edit_kind::deleted, x, npos);
+                  } else {
+                        const auto s = middle(a0, a1 - a0, b0, b1 - b0);
+                        compare(a0, a0 + static_cast<std::uint32_t>(s.x0), b0, b0 + static_cast<std::uint32_t>(s.y0), emit);
+                        for (auto i = 0; i < s.x1 - s.x0; ++i)
+                              emit(edit_kind::equal, a0 + static_cast<std::uint32_t>(s.x0 + i), b0 + static_cast<std::uint32_t>(s.y0 + i));
+                        compare(a0 + static_cast<std::uint32_t>(s.x1), a1, b0 + static_cast<std::uint32_t>(s.y1), b1, emit);
+                  }
+                  for (auto i = 0u; i < tail; ++i)
+                        emit(edit_kind::equal, a1 + i, b1 + i);
+            }
+
+            /* Middle snake of A[a0, a0 + n) against B[b0, b0 + m), coordinates relative to (a0, b0). */
+            snake middle(const std::uint32_t a0, const std::int64_t n, const std::uint32_t b0, const std::int64_t m) {
+                  const auto delta = n - m;
+                  const auto odd = (delta & 1) != 0;
+                  const auto limit = (n + m + 1) / 2;
+                  const auto offset = limit + 1;
+                  const auto f = forward.data() + offset;
+                  const auto r = backward.data() + offset;
+                  f[1] = 0;
+                  r[1] = 0;
+                  for (auto d = std::int64_t{0}; d <= limit; ++d) {
+                        for (auto k = -d; k <= d; k += 2) {
+                              auto x = (k == -d || (k != d && f[k - 1] < f[k + 1])) ? f[k + 1] : f[k - 1] + 1;
+                              auto y = x - k;
+                              const auto x0 = x;
+                              const auto y0 = y;
+                              while (x < n && y < m && old_code[a0 + x] == new_code[b0 + y]) {
+                                    ++x;
+                                    ++y;
+                              }
+                              f[k] = x;
+                              const auto reverse = delta - k;
+                              if (odd && reverse >= -(d - 1) && reverse <= d - 1 && f[k] + r[reverse] >= n)
+                                    return {x0, y0, x, y};
+                        }
+                        for (auto k = -d; k <= d; k += 2) {
+                              auto x = (k == -d || (k != d && r[k - 1] < r[k + 1])) ? r[k + 1] : r[k - 1] + 1;
+                              auto y = x - k;
+                              const auto x0 = x;
+                              const auto y0 = y;
+                              while (x < n && y < m && old_code[a0 + n - 1 - x] == new_code[b0 + m - 1 - y]) {
+                                    ++x;
+                                    ++y;
+                              }
+                              r[k] = x;
+                              const auto ahead = delta - k;
+                              if (!odd && ahead >= -d && ahead <= d && f[ahead] + r[k] >= n)
+                                    return {n - x, m - y, n - x0, m - y0};
+                        }
+                  }
+                  return {0, 0, 0, 0}; /* Unreachable, the paths meet by d = ceil((n + m) / 2). */
+            }
+      };
+
+      /* Diffs `before` against `after`. */
+      inline report compare(const chunk::file &before, const chunk::file &after, const options &settings = {}) {
+            decoder::decoded scratch;
+            std::vector<detail::function> olds;
+            std::vector<detail::function> news;
+            detail::flatten(before.main(), "main", npos, 0u, olds, scratch);
+            detail::flatten(after.main(), "main", npos, 0u, news, scratch);
+
+            /* Exact structure, duplicates pair up in preorder. */
+            std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> by_structure;
+            for (auto i = static_cast<std::uint32_t>(news.size()); i-- > 0u;)
+                  by_structure[news[i].structure].push_back(i);
+            std::vector<double> similarity(olds.size(), 1.0);
+            for (auto i = 0u; i < olds.size(); ++i) {
+                  const auto found = by_structure.find(olds[i].structure);
+                  if (found == by_structure.end() || found->second.empty())
+                        continue;
+                  olds[i].match = found->second.back();
+                  news[found->second.back()].match = i;
+                  found->second.pop_back();
+            }
+
+            /* Fuzzy: LSH bands over MinHash pick candidates, best similarity first. */
+            for (auto *const side : {&olds, &news}) {
+                  for (auto &f : *side) {
+                        if (f.match == npos)
+                              detail::sketch(f);
+                  }
+            }
+            std::unordered_map<std::uint64_t, std::vector<std::uint32_t>> buckets;
+            for (auto j = 0u; j < news.size(); ++j) {
+                  if (news[j].match != npos)
+                        continue;
+                  for (auto b = std::size_t{0u}; b < minhash_size / band_rows; ++b)
+                        buckets[detail::band(news[j], b)].push_back(j);
+            }
+            struct candidate {
+                  double score;
+                  std::uint32_t old_index;
+                  std::uint32_t new_index;
+            };
+            std::vector<candidate> candidates;
+            for (auto i = 0u; i < olds.size(); ++i) {
+                  if (olds[i].match != npos)
+                        continue;
+                  for (auto b = std::size_t{0u}; b < minhash_size / band_rows; ++b) {
+                        const auto found = buckets.find(detail::band(olds[i], b));
+                        if (found == buckets.end())
+                              continue;
+                        for (const auto j : found->second) {
+                              const auto score = detail::similarity(olds[i], news[j]);
+                              if (score >= settings.threshold)
+                                    candidates.push_back({score, i, j});
+                        }
+                  }
+            }
+            std::sort(candidates.begin(), candidates.end(), [&](const candidate &l, const candidate &r) {
+                  if (l.score != r.score)
+                        return l.score > r.score;
+                  const auto l_named = olds[l.old_index].name == news[l.new_index].name;
+                  const auto r_named = olds[r.old_index].name == news[r.new_index].name;
+                  if (l_named != r_named)
+                        return l_named;
+                  return (l.old_index != r.old_index) ? l.old_index < r.old_index : l.new_index < r.new_index;
+            });
+            for (const auto &c : candidates) {
+                  if (olds[c.old_index].match != npos || news[c.new_index].match != npos)
+                        continue;
+                  olds[c.old_index].match = c.new_index;
+                  news[c.new_index].match = c.old_index;
+                  similarity[c.old_index] = c.score;
+            }
+
+            /* Positional: same child slot under matched parents, preorder so parents settle first. */
+            std::vector<std::vector<std::uint32_t>> children(news.size());
+            for (auto j = 1u; j < news.size(); ++j)
+                  children[news[j].parent].push_back(j);
+            for (auto i = 0u; i < olds.size(); ++i) {
+                  if (olds[i].match != npos)
+                        continue;
+                  auto candidate = npos;
+                  if (i == 0u)
+                        candidate = 0u;
+                  else if (olds[olds[i].parent].match != npos && olds[i].child_index < children[olds[olds[i].parent].match].size())
+                        candidate = children[olds[olds[i].parent].match][olds[i].child_index];
+                  if (candidate == npos || news[candidate].match != npos)
+                        continue;
+                  olds[i].match = candidate;
+                  news[candidate].match = i;
+                  similarity[i] = detail::similarity(olds[i], news[candidate]);
+            }
+
+            /* Instruction diffs */
+            report out;
+            myers engine;
+            detail::bijection binding;
+            std::vector<edit> script;
+            for (auto i = 0u; i < olds.size(); ++i) {
+                  function_diff fd;
+                  fd.old_index = i;
+                  fd.old_name = olds[i].name;
+                  const auto &a = olds[i];
+                  if (a.match == npos) {
+                        fd.status = function_status::deleted;
+                        fd.deleted = static_cast<std::uint32_t>(a.normalized.size());
+                        ++out.deleted;
+                        out.functions.push_back(std::move(fd));
+                        continue;
+                  }
+                  const auto &b = news[a.match];
+                  fd.new_index = a.match;
+                  fd.new_name = b.name;
+                  fd.similarity = similarity[i];
+                  const auto old_words = a.proto->code.data();
+                  const auto new_words = b.proto->code.data();
+                  const auto old_op = [&](const std::uint32_t pc) {
+                        return static_cast<opcodes>(decoder::detail::load_word(old_words + pc * 4u) & op_mask);
+                  };
+                  const auto new_op = [&](const std::uint32_t pc) {
+                        return static_cast<opcodes>(decoder::detail::load_word(new_words + pc * 4u) & op_mask);
+                  };
+
+                  script.clear();
+                  engine.run(a.normalized.data(), static_cast<std::uint32_t>(a.normalized.size()), b.normalized.data(), static_cast<std::uint32_t>(b.normalized.size()),
+                             [&](const edit_kind kind, const std::uint32_t x, const std::uint32_t y) {
+                                   script.push_back(edit{kind, x, y, (x != npos) ? old_op(x) : opcodes::OP_MOVE, (y != npos) ? new_op(y) : opcodes::OP_MOVE});
+                             });
+
+                  binding.bind(a, b, script);
+
+                  /* Aligned pairs split by the bijection, deletions pair with insertions of the same opcode inside each hunk as changes. */
+                  for (auto at = std::size_t{0u}; at < script.size();) {
+                        const auto &e = script[at];
+                        if (e.kind == edit_kind::equal) {
+                              if (!binding.follows(a, b, e.old_pc, e.new_pc)) {
+                                    ++fd.changed;
+                                    if (settings.keep_edits)
+                                          fd.edits.push_back(edit{edit_kind::changed, e.old_pc, e.new_pc, e.old_op, e.new_op});
+                              } else if (decoder::detail::load_word(old_words + e.old_pc * 4u) != decoder::detail::load_word(new_words + e.new_pc * 4u)) {
+                                    ++fd.renamed;
+                                    if (settings.keep_edits)
+                                          fd.edits.push_back(edit{edit_kind::renamed, e.old_pc, e.new_pc, e.old_op, e.new_op});
+                              } else {
+                                    ++fd.equal;
+                              }
+                              ++at;
+                              continue;
+                        }
+                        auto end = at;
+                        while (end < script.size() && script[end].kind != edit_kind::equal)
+                              ++end;
+                        std::vector<edit> deletions;
+                        std::vector<edit> insertions;
+                        for (auto k = at; k < end; ++k)
+                              (script[k].kind == edit_kind::deleted ? deletions : insertions).push_back(script[k]);
+                        auto d = std::size_t{0u};
+                        auto n = std::size_t{0u};
+                        const auto add = [&](const edit &x) {
+                              if (x.kind == edit_kind::changed)
+                                    ++fd.changed;
+                              else if (x.kind == edit_kind::inserted)
+                                    ++fd.inserted;
+                              else
+                                    ++fd.deleted;
+                              if (settings.keep_edits)
+                                    fd.edits.push_back(x);
+                        };
+                        while (d < deletions.size() || n < insertions.size()) {
+                              if (d < deletions.size() && n < insertions.size() && deletions[d].old_op == insertions[n].new_op) {
+                                    add(edit{edit_kind::changed, deletions[d].old_pc, insertions[n].new_pc, deletions[d].old_op, insertions[n].new_op});
+                                    ++d;
+                                    ++n;
+                              } else if (d < deletions.size() && (n == insertions.size() || deletions.size() - d >= insertions.size() - n)) {
+                                    add(deletions[d++]);
+                              } else {
+                                    add(insertions[n++]);
+                              }
+                        }
+                        at = end;
+                  }
+                  const auto same = fd.changed == 0u && fd.inserted == 0u && fd.deleted == 0u;
+                  fd.status = same ? function_status::unchanged : function_status::modified;
+                  ++(same ? out.unchanged : out.modified);
+                  out.functions.push_back(std::move(fd));
+            }
+            for (auto j = 0u; j < news.size(); ++j) {
+                  if (news[j].match != npos)
+                        continue;
+                  function_diff fd;
+                  fd.status = function_status::inserted;
+                  fd.new_index = j;
+                  fd.new_name = news[j].name;
+                  fd.inserted = static_cast<std::uint32_t>(news[j].normalized.size());
+                  ++out.inserted;
+                  out.functions.push_back(std::move(fd));
+            }
+            return out;
+      }
+
+      namespace detail {
+
+            inline const char *mnemonic(const opcodes op) {
+                  return opcode_valid(op) ? opentry(op).mnemonic : "?";
+            }
+
+      } // namespace detail
+
+      /* One line per changed function, then its edits indented. */
+      inline std::string render(const report &r) {
+            std::string out;
+            char line[256];
+            std::snprintf(line, sizeof(line), "functions: %u unchanged, %u modified, %u inserted, %u deleted\n", r.unchanged, r.modified, r.inserted, r.deleted);
+            out += line;
+            for (const auto &f : r.functions) {
+                  switch (f.status) {
+                        case function_status::unchanged:
+                              continue;
+                        case function_status::inserted:
+                              std::snprintf(line, sizeof(line), "+ %s (%u instructions)\n", f.new_name.c_str(), f.inserted);
+                              out += line;
+                              continue;
+                        case function_status::deleted:
+                              std::snprintf(line, sizeof(line), "- %s (%u instructions)\n", f.old_name.c_str(), f.deleted);
+                              out += line;
+                              continue;
+                        default:
+                              break;
+                  }
+                  std::snprintf(line, sizeof(line), "~ %s -> %s: %u changed, %u inserted, %u deleted, %u renamed (similarity %.2f)\n", f.old_name.c_str(), f.new_name.c_str(), f.changed, f.inserted, f.deleted, f.renamed, f.similarity);
+                  out += line;
+                  for (const auto &e : f.edits) {
+                        switch (e.kind) {
+                              case edit_kind::changed:
+                                    std::snprintf(line, sizeof(line), "    ~ [%u] -> [%u] %s\n", e.old_pc, e.new_pc, detail::mnemonic(e.old_op));
+                                    break;
+                              case edit_kind::inserted:
+                                    std::snprintf(line, sizeof(line), "    + [%u] %s\n", e.new_pc, detail::mnemonic(e.new_op));
+                                    break;
+                              case edit_kind::deleted:
+                                    std::snprintf(line, sizeof(line), "    - [%u] %s\n", e.old_pc, detail::mnemonic(e.old_op));
+                                    break;
+                              default:
+                                    continue;
+                        }
+                        out += line;
+                  }
+            }
+            return out;
+      }
+
+} // namespace diff
@@ -0,0 +1,372 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/*
+      Streaming text disassembler.
+      Per-opcode text is pre-rendered at compile time from optable, output goes through one reusable buffer.
+*/
+namespace disasm {
+
+      /*
+            Bounded output buffer, drains into a sink whenever it fills up.
+            A sink returns 0 or an errno value, the first failure sticks in error() and later output is dropped.
+      */
+      class writer {
+          public:
+            using drain = int (*)(void *context, const char *data, std::size_t size);
+
+            static constexpr std::size_t default_capacity = 64u * 1024u;
+            /* Smaller capacities get rounded up so a whole instruction line always fits one reserve(). */
+            static constexpr std::size_t min_capacity = 512u;
+
+            writer(const drain sink, void *const context, const std::size_t capacity = default_capacity)
+                : sink(sink), context(context), buffer(new char[(capacity < min_capacity) ? min_capacity : capacity]), capacity((capacity < min_capacity) ? min_capacity : capacity) {}
+
+            /* Writes to a file descriptor (stdout is 1). */
+            static writer to_fd(const int fd, const std::size_t capacity = default_capacity) {
+                  return writer(&drain_fd, reinterpret_cast<void *>(static_cast<std::intptr_t>(fd)), capacity);
+            }
+
+            /* Appends to a string. */
+            static writer to_string(std::string &out, const std::size_t capacity = default_capacity) {
+                  return writer(&drain_string, &out, capacity);
+            }
+
+            writer(const writer &) = delete;
+            writer &operator=(const writer &) = delete;
+            writer(writer &&) = default;
+
+            /* Drains what this writer still holds before taking over `other`. */
+            writer &operator=(writer &&other) {
+                  if (this == &other)
+                        return *this;
+                  if (buffer != nullptr)
+                        flush();
+                  sink = other.sink;
+                  context = other.context;
+                  buffer = std::move(other.buffer);
+                  capacity = other.capacity;
+                  used = other.used;
+                  failure = other.failure;
+                  other.used = 0u;
+                  return *this;
+            }
+
+            ~writer() {
+                  if (buffer != nullptr)
+                        flush();
+            }
+
+            void flush() {
+                  if (used != 0u && failure == 0)
+                        failure = sink(context, buffer.get(), used);
+                  used = 0u;
+            }
+
+            /* First sink failure as an errno value, 0 while everything got through. */
+            int error() const {
+                  return failure;
+            }
+
+            /* Guarantees `n` free bytes (n <= min_capacity). */
+            char *reserve(const std::size_t n) {
+                  if (capacity - used < n)
+                        flush();
+                  return buffer.get() + used;
+            }
+
+            void commit(const std::size_t n) {
+                  used += n;
+            }
+
+            void write(const char *data, std::size_t size) {
+                  while (size != 0u) {
+                        if (used == capacity)
+                              flush();
+                        const auto n = (capacity - used < size) ? capacity - used : size;
+                        std::memcpy(buffer.get() + used, data, n);
+                        used += n;
+                        data += n;
+                        size -= n;
+                  }
+            }
+
+            void write(const std::string_view text) {
+                  write(text.data(), text.size());
+            }
+
+            void put(const char c) {
+                  *reserve(1u) = c;
+                  ++used;
+            }
+
+          private:
+            drain sink;
+            void *context;
+            std::unique_ptr<char[]> buffer;
+            std::size_t capacity;
+            std::size_t used = 0u;
+            int failure = 0;
+
+            /* Short writes continue and EINTR retries, anything else is the writer's error. */
+            static int drain_fd(void *const context, const char *data, std::size_t size) {
+                  const auto fd = static_cast<int>(reinterpret_cast<std::intptr_t>(context));
+                  while (size != 0u) {
+#if defined(_WIN32)
+                        const auto written = ::_write(fd, data, static_cast<unsigned>(size));
+#else
+                        const auto written = ::write(fd, data, size);
+#endif
+                        if (written < 0 && errno == EINTR)
+                              continue;
+                        if (written < 0)
+                              return errno;
+                        if (written == 0)
+                              return EIO;
+                        data += written;
+                        size -= static_cast<std::size_t>(written);
+                  }
+                  return 0;
+            }
+
+            static int drain_string(void *const context, const char *const data, const std::size_t size) {
+                  static_cast<std::string *>(context)->append(data, size);
+                  return 0;
+            }
+      };
+
+      namespace detail {
+
+            constexpr char digit_pairs[] =
+                "00010203040506070809"
+                "10111213141516171819"
+                "20212223242526272829"
+                "30313233343536373839"
+                "40414243444546474849"
+                "50515253545556575859"
+                "60616263646566676869"
+                "70717273747576777879"
+                "80818283848586878889"
+                "90919293949596979899";
+
+      } // namespace detail
+
+      /* Writes `value` in decimal to `out` (at least 20 bytes), returns the length. */
+      inline std::size_t format_uint(std::uint64_t value, char *const out) {
+            char digits[20];
+            auto at = 20u;
+            while (value >= 100u) {
+                  const auto pair = static_cast<std::size_t>(value % 100u) * 2u;
+                  value /= 100u;
+                  digits[--at] = detail::digit_pairs[pair + 1u];
+                  digits[--at] = detail::digit_pairs[pair];
+            }
+            if (value >= 10u) {
+                  const auto pair = static_cast<std::size_t>(value) * 2u;
+                  digits[--at] = detail::digit_pairs[pair + 1u];
+                  digits[--at] = detail::digit_pairs[pair];
+            } else {
+                  digits[--at] = static_cast<char>('0' + value);
+            }
+            const auto length = 20u - at;
+            std::memcpy(out, digits + at, length);
+            return length;
+      }
+
+      inline std::size_t format_int(const std::int64_t value, char *const out) {
+            if (value >= 0)
+                  return format_uint(static_cast<std::uint64_t>(value), out);
+            out[0] = '-';
+            return 1u + format_uint(0u - static_cast<std::uint64_t>(value), out + 1u);
+      }
+
+      inline void write_uint(writer &w, const std::uint64_t value) {
+            w.commit(format_uint(value, w.reserve(20u)));
+      }
+
+      inline void write_int(writer &w, const std::int64_t value) {
+            w.commit(format_int(value, w.reserve(21u)));
+      }
+
+      /* Text of one opcode, laid out as it gets written: "mnemonic\t" then "desc ", ", desc ", ... */
+      struct op_format {
+            char mnemonic[16];
+            std::uint8_t mnemonic_length;
+            char operands[operand_max][32];
+            std::uint8_t operand_lengths[operand_max];
+            std::uint8_t operand_rk[operand_max]; /* decoder::rk_b / rk_c when the operand is B / C. */
+            std::uint8_t operand_count;
+      };
+
+      namespace detail {
+
+            constexpr std::size_t copy(char *const out, std::size_t at, const char *text) {
+                  while (*text != '\0')
+                        out[at++] = *text++;
+                  return at;
+            }
+
+            constexpr op_format make_format(const optable_entry &entry) {
+                  op_format format{};
+                  auto length = copy(format.mnemonic, 0u, entry.mnemonic);
+                  format.mnemonic[length++] = '\t';
+                  format.mnemonic_length = static_cast<std::uint8_t>(length);
+                  for (auto i = 0u; i < entry.operand_count; ++i) {
+                        auto at = std::size_t{0u};
+                        if (i != 0u) {
+                              format.operands[i][at++] = ',';
+                              format.operands[i][at++] = ' ';
+                        }
+                        at = copy(format.operands[i], at, entry.operands[i].descriptor);
+                        format.operands[i][at++] = ' ';
+                        format.operand_lengths[i] = static_cast<std::uint8_t>(at);
+                        format.operand_rk[i] = (entry.operands[i].encoding == operand_encoding::B) ? decoder::rk_b : (entry.operands[i].encoding == operand_encoding::C) ? decoder::rk_c : 0u;
+                  }
+                  format.operand_count = entry.operand_count;
+                  return format;
+            }
+
+            struct format_table {
+                  op_format formats[opcode_count];
+            };
+
+            constexpr format_table make_formats() {
+                  format_table table{};
+                  for (auto i = 0u; i < opcode_count; ++i)
+                        table.formats[i] = make_format(optable[i]);
+                  return table;
+            }
+
+      } // namespace detail
+
+      inline constexpr detail::format_table formats = detail::make_formats();
+
+      /* Decoded block size, listing memory stays bounded however large a proto is. */
+      constexpr std::size_t block_size = 1024u;
+
+      /* Reusable per-thread state, keep one around to render any number of protos without allocating. */
+      class renderer {
+          public:
+            renderer() {
+                  block.resize(block_size);
+            }
+
+            /* "function <name> <source:line,last> (n instructions, n constants, n functions)" followed by one line per instruction. */
+            void proto(writer &w, const chunk::proto &p, const std::string_view name) {
+                  w.write("function ");
+                  w.write(name);
+                  w.write(" <");
+                  w.write(p.source);
+                  w.put(':');
+                  write_int(w, p.line_defined);
+                  w.put(',');
+                  write_int(w, p.last_line_defined);
+                  w.write("> (");
+                  write_uint(w, p.code.size());
+                  w.write(" instructions, ");
+                  write_uint(w, p.constants.size());
+                  w.write(" constants, ");
+                  write_uint(w, p.proto_count());
+                  w.write(" functions)\n");
+
+                  for (auto base = std::size_t{0u}; base < p.code.size(); base += block_size) {
+                        const auto count = (p.code.size() - base < block_size) ? p.code.size() - base : block_size;
+                        decoder::decode(p.code.data() + base * 4u, count, block.view());
+                        for (auto i = 0u; i < count; ++i)
+                              instruction(w, p.code[base + i], block.rk[i], base + i, (base + i < p.line_info.size()) ? p.line_info[base + i] : -1);
+                  }
+                  w.put('\n');
+            }
+
+            /* Whole tree in preorder, names are dotted paths ("main", "main.0", "main.0.2", ...). */
+            void tree(writer &w, const chunk::proto &p, std::string &name) {
+                  proto(w, p, name);
+                  const auto length = name.size();
+                  char digits[20];
+                  for (auto i = 0u; i < p.proto_count(); ++i) {
+                        name += '.';
+                        name.append(digits, format_uint(i, digits));
+                        tree(w, p.child(i), name);
+                        name.resize(length);
+                  }
+            }
+
+            /* "\tpc\t[line]\tmnemonic\tdesc value, desc kN ...", `rk` as flagged by the decoder, line < 0 prints "-". */
+            static void instruction(writer &w, const std::uint32_t word, const std::uint8_t rk, const std::size_t pc, const std::int32_t line) {
+                  auto out = w.reserve(line_max);
+                  auto at = std::size_t{0u};
+                  out[at++] = '\t';
+                  at += format_uint(pc, out + at);
+                  out[at++] = '\t';
+                  out[at++] = '[';
+                  if (line < 0)
+                        out[at++] = '-';
+                  else
+                        at += format_uint(static_cast<std::uint32_t>(line), out + at);
+                  out[at++] = ']';
+                  out[at++] = '\t';
+
+                  const auto op = word & op_mask;
+                  if (op >= opcode_count) {
+                        std::memcpy(out + at, "unknown(", 8u);
+                        at += 8u;
+                        at += format_uint(op, out + at);
+                        out[at++] = ')';
+                        out[at++] = '\n';
+                        w.commit(at);
+                        return;
+                  }
+
+                  /* Fixed size copies of the padded templates, line_max leaves room for the overrun. */
+                  const auto &format = formats.formats[op];
+                  std::memcpy(out + at, format.mnemonic, sizeof(format.mnemonic));
+                  at += format.mnemonic_length;
+                  for (auto n = 0u; n < format.operand_count; ++n) {
+                        std::memcpy(out + at, format.operands[n], sizeof(format.operands[n]));
+                        at += format.operand_lengths[n];
+                        const auto &field = optable[op].operands[n].field;
+                        if (rk & format.operand_rk[n]) {
+                              out[at++] = 'k';
+                              at += format_uint(((word >> field.shift) & field.mask) & ~decoder::rk_bit, out + at);
+                        } else {
+                              at += format_int(instruction_operand(word, field), out + at);
+                        }
+                  }
+                  out[at++] = '\n';
+                  w.commit(at);
+            }
+
+          private:
+            /* Longest line instruction() can produce. */
+            static constexpr std::size_t line_max = 1u + 20u + 2u + 20u + 2u + sizeof(op_format::mnemonic) + operand_max * (32u + 21u) + 1u;
+            static_assert(line_max <= writer::min_capacity, "an instruction line must fit any writer.");
+
+            decoder::decoded block;
+      };
+
+      /* Streams a whole chunk. */
+      inline void disassemble(writer &w, const chunk::file &file) {
+            renderer r;
+            std::string name = "main";
+            r.tree(w, file.main(), name);
+      }
+
+} // namespace disasm
@@ -1,5 +1,10 @@
-#include <map>
-#include <vector>
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
 
 enum class opcodes {
       OP_MOVE,     /* (0) | Move source register to dest register. | * dest(8_Bits), * src(9_Bits) */
@@ -72,166 +77,292 @@ enum class operand_kind {
       k_idx_p
 };
 
-struct optable_encoding {
+constexpr std::size_t opcode_count = 47u; /* OP_MOVE .. OP_EXTRAARG */
+constexpr std::size_t operand_max = 3u;   /* Most operands any opcode takes. */
+
+/* Position of an operand inside a 32 bit instruction word, signed fields are stored with a bias (excess-K). */
+struct operand_field {
+      std::uint8_t shift;
+      std::uint8_t bits;
+      bool is_signed;
+      std::uint32_t mask;
+      std::int32_t bias;
+};
+
+constexpr std::uint8_t op_shift = 0u;
+constexpr std::uint8_t op_bits = 6u;
+constexpr std::uint32_t op_mask = (1u << op_bits) - 1u;
+
+constexpr operand_field make_field(const std::uint8_t shift, const std::uint8_t bits, const bool is_signed) {
+      const auto mask = (bits >= 32u) ? ~0u : ((1u << bits) - 1u);
+      return {shift, bits, is_signed, mask, is_signed ? static_cast<std::int32_t>(mask >> 1u) : 0};
+}
+
+constexpr operand_field field_of(const operand_encoding encoding) {
+      switch (encoding) {
+            case operand_encoding::A:
+                  return make_field(6u, 8u, false);
+            case operand_encoding::B:
+                  return make_field(23u, 9u, false);
+            case operand_encoding::C:
+                  return make_field(14u, 9u, false);
+            case operand_encoding::Bx:
+                  return make_field(14u, 18u, false);
+            case operand_encoding::Ax:
+                  return make_field(6u, 26u, false);
+            case operand_encoding::sBx:
+                  return make_field(14u, 18u, true);
+      }
+      return {};
+}
+
+/* Extracts opcode of an instruction word. */
+constexpr opcodes instruction_op(const std::uint32_t instruction) {
+      return static_cast<opcodes>((instruction >> op_shift) & op_mask);
+}
+
+/* Extracts an operand of an instruction word, sBx gets returned unbiased. */
+constexpr std::int32_t instruction_operand(const std::uint32_t instruction, const operand_field &field) {
+      return static_cast<std::int32_t>((instruction >> field.shift) & field.mask) - field.bias;
+}
+
+constexpr std::int32_t instruction_operand(const std::uint32_t instruction, const operand_encoding encoding) {
+      return instruction_operand(instruction, field_of(encoding));
+}
+
+struct optable_operand {
+      operand_encoding encoding;
+      operand_kind kind;
+      operand_field field;
+      const char *name;       /* "dest" */
+      const char *hint;       /* "Register" */
+      const char *descriptor; /* "dest(Register)" */
+};
+
+constexpr optable_operand make_operand(const operand_encoding encoding, const operand_kind kind, const char *const name, const char *const hint, const char *const descriptor) {
+      return {encoding, kind, field_of(encoding), name, hint, descriptor};
+}
+
+/* Same operands main.cpp feeds to iscreate. */
+namespace opoperands {
+      inline constexpr optable_operand A_dest_reg         = make_operand(operand_encoding::A, operand_kind::dest, "dest", "Register", "dest(Register)");
+      inline constexpr optable_operand A_src_reg          = make_operand(operand_encoding::A, operand_kind::reg, "src", "Register", "src(Register)");
+      inline constexpr optable_operand A_val_val          = make_operand(operand_encoding::A, operand_kind::val, "va;", "Value", "va;(Value)");
+      inline constexpr optable_operand A_upv_upvalue      = make_operand(operand_encoding::A, operand_kind::upvalue, "upv", "Upvalue", "upv(Upvalue)");
+      inline constexpr optable_operand Ax_dest_reg        = make_operand(operand_encoding::Ax, operand_kind::dest, "dest", "Register", "dest(Register)");
+      inline constexpr optable_operand Ax_src_reg         = make_operand(operand_encoding::Ax, operand_kind::reg, "src", "Register", "src(Register)");
+      inline constexpr optable_operand B_src_reg          = make_operand(operand_encoding::B, operand_kind::reg, "src", "Register", "src(Register)");
+      inline constexpr optable_operand B_val_val          = make_operand(operand_encoding::B, operand_kind::val, "val", "Value", "val(Value)");
+      inline constexpr optable_operand B_multret_mulret   = make_operand(operand_encoding::B, operand_kind::val_multret, "multret", "Multret Value", "multret(Multret Value)");
+      inline constexpr optable_operand B_upv_upvalue      = make_operand(operand_encoding::B, operand_kind::upvalue, "upv", "Upvalue", "upv(Upvalue)");
+      inline constexpr optable_operand B_tsize_table_size = make_operand(operand_encoding::B, operand_kind::table_size, "tsize", "Table Size", "tsize(Table Size)");
+      inline constexpr optable_operand Bx_kidx_k_idx      = make_operand(operand_encoding::Bx, operand_kind::k_idx, "kidx", "Kvalue Index", "kidx(Kvalue Index)");
+      inline constexpr optable_operand Bx_kidxp_k_idx_p   = make_operand(operand_encoding::Bx, operand_kind::k_idx_p, "kidxp", "Kvalue Proto Index", "kidxp(Kvalue Proto Index)");
+      inline constexpr optable_operand sBx_jmp_jmp        = make_operand(operand_encoding::sBx, operand_kind::jmp, "jmp", "Jump", "jmp(Jump)");
+      inline constexpr optable_operand C_src_reg          = make_operand(operand_encoding::C, operand_kind::reg, "src", "Register", "src(Register)");
+      inline constexpr optable_operand C_val_val          = make_operand(operand_encoding::C, operand_kind::val, "val", "Value", "val(Value)");
+      inline constexpr optable_operand C_tsize_table_size = make_operand(operand_encoding::C, operand_kind::table_size, "tsize", "Table Size", "tsize(Table Size)");
+      inline constexpr optable_operand C_multret_mulret   = make_operand(operand_encoding::C, operand_kind::val_multret, "multret", "Multret Value", "multret(Multret Value)");
+      inline constexpr optable_operand C_jmp_jmp          = make_operand(operand_encoding::C, operand_kind::jmp, "jmp", "Jump", "jmp(Jump)");
+} // namespace opoperands
+
+struct optable_entry {
       opcodes op;
-      std::vector<operand_encoding> encodings;
+      const char *opname;
+      const char *mnemonic;
+      const char *hint;
+      std::uint8_t operand_count;
+      optable_operand operands[operand_max];
 };
-static std::map<opcodes, optable_encoding> opencodings = {
-    {opcodes::OP_MOVE, {opcodes::OP_MOVE, {operand_encoding::A, operand_encoding::B}}},                              /* 0 */
-    {opcodes::OP_LOADK, {opcodes::OP_LOADK, {operand_encoding::A, operand_encoding::Bx}}},                           /* 1 */
-    {opcodes::OP_LOADKX, {opcodes::OP_LOADKX, {operand_encoding::Ax}}},                                              /* 2 */
-    {opcodes::OP_LOADBOOL, {opcodes::OP_LOADBOOL, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* 3 */
-    {opcodes::OP_LOADNIL, {opcodes::OP_LOADNIL, {operand_encoding::A, operand_encoding::B}}},                        /* 4 */
-    {opcodes::OP_GETUPVAL, {opcodes::OP_GETUPVAL, {operand_encoding::A, operand_encoding::B}}},                      /* 5 */
-    {opcodes::OP_GETTABUP, {opcodes::OP_GETTABUP, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* 6 */
-    {opcodes::OP_GETTABLE, {opcodes::OP_GETTABLE, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* 7 */
-    {opcodes::OP_SETTABUP, {opcodes::OP_SETTABUP, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* 8 */
-    {opcodes::OP_SETUPVAL, {opcodes::OP_SETUPVAL, {operand_encoding::A, operand_encoding::B}}},                      /* 9 */
-    {opcodes::OP_SETTABLE, {opcodes::OP_SETTABLE, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* a */
-    {opcodes::OP_NEWTABLE, {opcodes::OP_NEWTABLE, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* b */
-    {opcodes::OP_SELF, {opcodes::OP_SELF, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},         /* c */
-    {opcodes::OP_ADD, {opcodes::OP_ADD, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* d */
-    {opcodes::OP_SUB, {opcodes::OP_SUB, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* e */
-    {opcodes::OP_MUL, {opcodes::OP_MUL, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* f */
-    {opcodes::OP_MOD, {opcodes::OP_MOD, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 10 */
-    {opcodes::OP_POW, {opcodes::OP_POW, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 11 */
-    {opcodes::OP_DIV, {opcodes::OP_DIV, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 12 */
-    {opcodes::OP_IDIV, {opcodes::OP_IDIV, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},         /* 13 */
-    {opcodes::OP_BAND, {opcodes::OP_BAND, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},         /* 14 */
-    {opcodes::OP_BOR, {opcodes::OP_BOR, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 15 */
-    {opcodes::OP_BXOR, {opcodes::OP_BXOR, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},         /* 16 */
-    {opcodes::OP_SHL, {opcodes::OP_SHL, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 17 */
-    {opcodes::OP_SHR, {opcodes::OP_SHR, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},           /* 18 */
-    {opcodes::OP_UNM, {opcodes::OP_UNM, {operand_encoding::A, operand_encoding::B}}},                                /* 19 */
-    {opcodes::OP_BNOT, {opcodes::OP_BNOT, {operand_encoding::A, operand_encoding::B}}},                              /* 1a */
-    {opcodes::OP_NOT, {opcodes::OP_NOT, {operand_encoding::A, operand_encoding::B}}},                                /* 1b */
-    {opcodes::OP_LEN, {opcodes::OP_LEN, {operand_encoding::A, operand_encoding::B}}},                                /* 1c */
-    {opcodes::OP_CONCAT, {opcodes::OP_CONCAT, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},     /* 1d */
-    {opcodes::OP_JMP, {opcodes::OP_JMP, {operand_encoding::A, operand_encoding::sBx}}},                              /* 1e */
-    {opcodes::OP_EQ, {opcodes::OP_EQ, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},             /* 1f */
-    {opcodes::OP_LT, {opcodes::OP_LT, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},             /* 20 */
-    {opcodes::OP_LE, {opcodes::OP_LE, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},             /* 21 */
-    {opcodes::OP_TEST, {opcodes::OP_TEST, {operand_encoding::A, operand_encoding::C}}},                              /* 22 */
-    {opcodes::OP_TESTSET, {opcodes::OP_TESTSET, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},   /* 23 */
-    {opcodes::OP_CALL, {opcodes::OP_CALL, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},         /* 24 */
-    {opcodes::OP_TAILCALL, {opcodes::OP_TAILCALL, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}}, /* 25 */
-    {opcodes::OP_RETURN, {opcodes::OP_RETURN, {operand_encoding::A, operand_encoding::B}}},                          /* 26 */
-    {opcodes::OP_FORLOOP, {opcodes::OP_FORLOOP, {operand_encoding::A, operand_encoding::sBx}}},                      /* 27 */
-    {opcodes::OP_FORPREP, {opcodes::OP_FORPREP, {operand_encoding::A, operand_encoding::sBx}}},                      /* 28 */
-    {opcodes::OP_TFORCALL, {opcodes::OP_TFORCALL, {operand_encoding::A, operand_encoding::C}}},                      /* 29 */
-    {opcodes::OP_TFORLOOP, {opcodes::OP_TFORLOOP, {operand_encoding::A, operand_encoding::sBx}}},                    /* 2a */
-    {opcodes::OP_SETLIST, {opcodes::OP_SETLIST, {operand_encoding::A, operand_encoding::B, operand_encoding::C}}},   /* 2b */
-    {opcodes::OP_CLOSURE, {opcodes::OP_CLOSURE, {operand_encoding::A, operand_encoding::Bx}}},                       /* 2c */
-    {opcodes::OP_VARARG, {opcodes::OP_VARARG, {operand_encoding::A, operand_encoding::B}}},                          /* 2d */
-    {opcodes::OP_EXTRAARG, {opcodes::OP_EXTRAARG, {operand_encoding::Ax}}}                                           /* 2e */
+
+/* Flat table indexed directly by opcodes, everything is resolved at compile time. */
+inline constexpr optable_entry optable[opcode_count] = {
+    {opcodes::OP_MOVE, "OP_MOVE", "move", "Move source register to dest register.", 2, {opoperands::A_dest_reg, opoperands::B_src_reg}},                                                                                                                                                             /* 0 */
+    {opcodes::OP_LOADK, "OP_LOADK", "loadk", "Load kvalue to destination register.", 2, {opoperands::A_dest_reg, opoperands::Bx_kidx_k_idx}},                                                                                                                                                        /* 1 */
+    {opcodes::OP_LOADKX, "OP_LOADKX", "loadkx", "Load kvalue extended.", 1, {opoperands::Ax_dest_reg}},                                                                                                                                                                                              /* 2 */
+    {opcodes::OP_LOADBOOL, "OP_LOADBOOL", "loadbool", "Load boolean to register and take jump.", 3, {opoperands::A_dest_reg, opoperands::B_val_val, opoperands::C_jmp_jmp}},                                                                                                                         /* 3 */
+    {opcodes::OP_LOADNIL, "OP_LOADNIL", "loadnil", "Iteration start at first target register then increments above the stack and fills with NIL set by source value.", 2, {opoperands::A_dest_reg, opoperands::B_val_val}},                                                                          /* 4 */
+    {opcodes::OP_GETUPVAL, "OP_GETUPVAL", "getupval", "Load upvalue to destination register.", 2, {opoperands::A_dest_reg, opoperands::B_upv_upvalue}},                                                                                                                                              /* 5 */
+    {opcodes::OP_GETTABUP, "OP_GETTABUP", "gettabup", "Gets table upvalue as B and index element as C which gets load to A.", 3, {opoperands::A_dest_reg, opoperands::B_upv_upvalue, opoperands::C_val_val}},                                                                                        /* 6 */
+    {opcodes::OP_GETTABLE, "OP_GETTABLE", "gettable", "Gets table as B and index element as C which gets load to A.", 3, {opoperands::A_dest_reg, opoperands::B_val_val, opoperands::C_val_val}},                                                                                                    /* 7 */
+    {opcodes::OP_SETTABUP, "OP_SETTABUP", "settabup", "Gets table upvalue as A and index element as B and sets A to the index.", 3, {opoperands::A_upv_upvalue, opoperands::B_val_val, opoperands::C_val_val}},                                                                                      /* 8 */
+    {opcodes::OP_SETUPVAL, "OP_SETUPVAL", "setupval", "", 2, {opoperands::A_upv_upvalue, opoperands::B_val_val}},                                                                                                                                                                                    /* 9 */
+    {opcodes::OP_SETTABLE, "OP_SETTABLE", "settable", "", 3, {opoperands::A_src_reg, opoperands::B_val_val, opoperands::C_val_val}},                                                                                                                                                                 /* a */
+    {opcodes::OP_NEWTABLE, "OP_NEWTABLE", "newtable", "Creates new table with B being array size and C being hash size.", 3, {opoperands::A_dest_reg, opoperands::B_tsize_table_size, opoperands::C_tsize_table_size}},                                                                              /* b */
+    {opcodes::OP_SELF, "OP_SELF", "self", "Call to self.", 3, {opoperands::A_dest_reg, opoperands::B_val_val, opoperands::C_val_val}},                                                                                                                                                               /* c */
+    {opcodes::OP_ADD, "OP_ADD", "add", "Add B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                              /* d */
+    {opcodes::OP_SUB, "OP_SUB", "sub", "Sub B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                              /* e */
+    {opcodes::OP_MUL, "OP_MUL", "mul", "Multiply B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                         /* f */
+    {opcodes::OP_MOD, "OP_MOD", "mod", "Modulus B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                          /* 10 */
+    {opcodes::OP_POW, "OP_POW", "pow", "Power B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                            /* 11 */
+    {opcodes::OP_DIV, "OP_DIV", "div", "Divide B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                           /* 12 */
+    {opcodes::OP_IDIV, "OP_IDIV", "idiv", "Floor division B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                /* 13 */
+    {opcodes::OP_BAND, "OP_BAND", "band", "Bitwise and B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                   /* 14 */
+    {opcodes::OP_BOR, "OP_BOR", "bor", "Bitwise or B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                       /* 15 */
+    {opcodes::OP_BXOR, "OP_BXOR", "bxor", "Bitwise xor division B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                          /* 16 */
+    {opcodes::OP_SHL, "OP_SHL", "shl", "Shift left B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                       /* 17 */
+    {opcodes::OP_SHR, "OP_SHR", "shr", "Shift right B to C and load results to A.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                                      /* 18 */
+    {opcodes::OP_UNM, "OP_UNM", "unm", "Unary minus A to B and load results to A.", 2, {opoperands::A_dest_reg, opoperands::B_src_reg}},                                                                                                                                                             /* 19 */
+    {opcodes::OP_BNOT, "OP_BNOT", "bnot", "Binary not A to B and load results to A.", 2, {opoperands::A_dest_reg, opoperands::B_src_reg}},                                                                                                                                                           /* 1a */
+    {opcodes::OP_NOT, "OP_NOT", "not", "Unary not A to B and load results to A.", 2, {opoperands::A_dest_reg, opoperands::B_src_reg}},                                                                                                                                                               /* 1b */
+    {opcodes::OP_LEN, "OP_LEN", "len", "Unary length of table B and load results to A.", 2, {opoperands::A_dest_reg, opoperands::B_src_reg}},                                                                                                                                                        /* 1c */
+    {opcodes::OP_CONCAT, "OP_CONCAT", "concat", "Concat string where start of stack B to C.", 3, {opoperands::A_dest_reg, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                                            /* 1d */
+    {opcodes::OP_JMP, "OP_JMP", "jmp", "Jump to sBx if A is not 0 then all upvalues >= A - 1 will be closed.", 2, {opoperands::A_val_val, opoperands::sBx_jmp_jmp}},                                                                                                                                 /* 1e */
+    {opcodes::OP_EQ, "OP_EQ", "eq", "Compare equal B to C and if comparision is not A skip next instruction.", 3, {opoperands::A_val_val, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                            /* 1f */
+    {opcodes::OP_LT, "OP_LT", "lt", "Compare less than B to C and if comparision is not A skip next instruction.", 3, {opoperands::A_val_val, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                        /* 20 */
+    {opcodes::OP_LE, "OP_LE", "le", "Compare less than equal B to C and if comparision is not A skip next instruction.", 3, {opoperands::A_val_val, opoperands::B_src_reg, opoperands::C_src_reg}},                                                                                                  /* 21 */
+    {opcodes::OP_TEST, "OP_TEST", "test", "Compare A to C and if false skip next instruction", 2, {opoperands::A_src_reg, opoperands::C_val_val}},                                                                                                                                                   /* 22 */
+    {opcodes::OP_TESTSET, "OP_TESTSET", "testset", "Compare B to C and if false skip next instruction else set A to B.", 3, {opoperands::A_src_reg, opoperands::B_src_reg, opoperands::C_val_val}},                                                                                                  /* 23 */
+    {opcodes::OP_CALL, "OP_CALL", "call", "Call A with B args and C return.", 3, {opoperands::A_src_reg, opoperands::B_multret_mulret, opoperands::C_multret_mulret}},                                                                                                                               /* 24 */
+    {opcodes::OP_TAILCALL, "OP_TAILCALL", "tailcall", "Return call A with B args and C return.", 3, {opoperands::A_src_reg, opoperands::B_multret_mulret, opoperands::C_multret_mulret}},                                                                                                            /* 25 */
+    {opcodes::OP_RETURN, "OP_RETURN", "return", "Return from start A to A + B - 2.", 2, {opoperands::A_src_reg, opoperands::B_multret_mulret}},                                                                                                                                                      /* 26 */
+    {opcodes::OP_FORLOOP, "OP_FORLOOP", "forloop", "For loop follows for format starting A with sBx jump.", 2, {opoperands::A_src_reg, opoperands::sBx_jmp_jmp}},                                                                                                                                    /* 27 */
+    {opcodes::OP_FORPREP, "OP_FORPREP", "forprep", "For loop follows for format starting A with sBx jump.", 2, {opoperands::A_src_reg, opoperands::sBx_jmp_jmp}},                                                                                                                                    /* 28 */
+    {opcodes::OP_TFORCALL, "OP_TFORCALL", "tforcall", "For prep calls iterator function.", 2, {opoperands::A_src_reg, opoperands::C_val_val}},                                                                                                                                                       /* 29 */
+    {opcodes::OP_TFORLOOP, "OP_TFORLOOP", "tforloop", "For loop follows T for format starting A with sBx jump.", 2, {opoperands::A_src_reg, opoperands::sBx_jmp_jmp}},                                                                                                                               /* 2a */
+    {opcodes::OP_SETLIST, "OP_SETLIST", "setlist", "Sets the values for a range of array elements in a table referenced by A, B is the number of elements to set, C encodes the block number initialized.", 3, {opoperands::A_src_reg, opoperands::B_multret_mulret, opoperands::C_multret_mulret}}, /* 2b */
+    {opcodes::OP_CLOSURE, "OP_CLOSURE", "closure", "Set to kvalue proto.", 2, {opoperands::A_src_reg, opoperands::Bx_kidxp_k_idx_p}},                                                                                                                                                                /* 2c */
+    {opcodes::OP_VARARG, "OP_VARARG", "vararg", "Set range A + 1 to A + B - e1 to vararg.", 2, {opoperands::A_src_reg, opoperands::B_multret_mulret}},                                                                                                                                               /* 2d */
+    {opcodes::OP_EXTRAARG, "OP_EXTRAARG", "extraarg", "Extra arg Ax for previous opcode.", 1, {opoperands::Ax_src_reg}}                                                                                                                                                                              /* 2e */
 };
 
-struct optable_kind {
+constexpr bool optable_is_dense() {
+      for (auto i = 0u; i < opcode_count; ++i) {
+            if (static_cast<std::size_t>(optable[i].op) != i)
+                  return false;
+      }
+      return true;
+}
+static_assert(optable_is_dense(), "optable must be indexed by opcodes.");
+
+constexpr bool opcode_valid(const opcodes op) {
+      return static_cast<std::size_t>(op) < opcode_count;
+}
+
+constexpr const optable_entry &opentry(const opcodes op) {
+      return optable[static_cast<std::size_t>(op)];
+}
+
+/*
+      Compatibility layer for the old std::map tables (opencodings, opkinds, opdescriptor).
+      Same lookup API (at, [], find, count, iteration over {op, entry} pairs) but backed by constexpr arrays.
+*/
+
+template <typename T, std::size_t N>
+struct fixed_list {
+      T items[N]{};
+      std::size_t count = 0u;
+
+      constexpr const T *begin() const {
+            return items;
+      }
+      constexpr const T *end() const {
+            return items + count;
+      }
+      constexpr std::size_t size() const {
+            return count;
+      }
+      constexpr bool empty() const {
+            return count == 0u;
+      }
+      constexpr const T &operator[](const std::size_t i) const {
+            return items[i];
+      }
+      constexpr const T &at(const std::size_t i) const {
+            if (i >= count)
+                  throw std::out_of_range("fixed_list::at");
+            return items[i];
+      }
+      constexpr const T &front() const {
+            return items[0];
+      }
+      constexpr const T &back() const {
+            return items[count - 1u];
+      }
+};
+
+template <typename T>
+struct optable_map {
+      using key_type = opcodes;
+      using mapped_type = T;
+      using value_type = std::pair<const opcodes, T>;
+      using const_iterator = const value_type *;
+      using iterator = const_iterator;
+
+      value_type entries[opcode_count];
+
+      constexpr const_iterator begin() const {
+            return entries;
+      }
+      constexpr const_iterator end() const {
+            return entries + opcode_count;
+      }
+      constexpr std::size_t size() const {
+            return opcode_count;
+      }
+      constexpr bool empty() const {
+            return false;
+      }
+      constexpr const_iterator find(const opcodes op) const {
+            return opcode_valid(op) ? entries + static_cast<std::size_t>(op) : end();
+      }
+      constexpr std::size_t count(const opcodes op) const {
+            return opcode_valid(op) ? 1u : 0u;
+      }
+      constexpr const T &operator[](const opcodes op) const {
+            return entries[static_cast<std::size_t>(op)].second;
+      }
+      constexpr const T &at(const opcodes op) const {
+            if (!opcode_valid(op))
+                  throw std::out_of_range("optable_map::at");
+            return entries[static_cast<std::size_t>(op)].second;
+      }
+};
+
+template <typename T, typename F, std::size_t... I>
+constexpr optable_map<T> make_optable_map(const F &convert, std::index_sequence<I...>) {
+      return {{{static_cast<opcodes>(I), convert(optable[I])}...}};
+}
+
+template <typename T, typename F>
+constexpr optable_map<T> make_optable_map(const F &convert) {
+      return make_optable_map<T>(convert, std::make_index_sequence<opcode_count>{});
+}
+
+struct optable_encoding {
       opcodes op;
-      std::vector<operand_kind> kinds;
+      fixed_list<operand_encoding, operand_max> encodings;
 };
-static std::map<opcodes, optable_kind> opkinds = {
-    {opcodes::OP_MOVE, {opcodes::OP_MOVE, {operand_kind::dest, operand_kind::reg}}},                                           /* 0 */
-    {opcodes::OP_LOADK, {opcodes::OP_LOADK, {operand_kind::dest, operand_kind::k_idx}}},                                       /* 1 */
-    {opcodes::OP_LOADKX, {opcodes::OP_LOADKX, {operand_kind::dest}}},                                                          /* 2 */
-    {opcodes::OP_LOADBOOL, {opcodes::OP_LOADBOOL, {operand_kind::dest, operand_kind::val, operand_kind::jmp}}},                /* 3 */
-    {opcodes::OP_LOADNIL, {opcodes::OP_LOADNIL, {operand_kind::dest, operand_kind::val}}},                                     /* 4 */
-    {opcodes::OP_GETUPVAL, {opcodes::OP_GETUPVAL, {operand_kind::dest, operand_kind::upvalue}}},                               /* 5 */
-    {opcodes::OP_GETTABUP, {opcodes::OP_GETTABUP, {operand_kind::dest, operand_kind::upvalue, operand_kind::val}}},            /* 6 */
-    {opcodes::OP_GETTABLE, {opcodes::OP_GETTABLE, {operand_kind::dest, operand_kind::val, operand_kind::val}}},                /* 7 */
-    {opcodes::OP_SETTABUP, {opcodes::OP_SETTABUP, {operand_kind::upvalue, operand_kind::val, operand_kind::val}}},             /* 8 */
-    {opcodes::OP_SETUPVAL, {opcodes::OP_SETUPVAL, {operand_kind::upvalue, operand_kind::val}}},                                /* 9 */
-    {opcodes::OP_SETTABLE, {opcodes::OP_SETTABLE, {operand_kind::reg, operand_kind::val, operand_kind::val}}},                 /* a */
-    {opcodes::OP_NEWTABLE, {opcodes::OP_NEWTABLE, {operand_kind::dest, operand_kind::table_size, operand_kind::table_size}}},  /* b */
-    {opcodes::OP_SELF, {opcodes::OP_SELF, {operand_kind::dest, operand_kind::val, operand_kind::val}}},                        /* c */
-    {opcodes::OP_ADD, {opcodes::OP_ADD, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* d */
-    {opcodes::OP_SUB, {opcodes::OP_SUB, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* e */
-    {opcodes::OP_MUL, {opcodes::OP_MUL, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* f */
-    {opcodes::OP_MOD, {opcodes::OP_MOD, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 10 */
-    {opcodes::OP_POW, {opcodes::OP_POW, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 11 */
-    {opcodes::OP_DIV, {opcodes::OP_DIV, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 12 */
-    {opcodes::OP_IDIV, {opcodes::OP_IDIV, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                        /* 13 */
-    {opcodes::OP_BAND, {opcodes::OP_BAND, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                        /* 14 */
-    {opcodes::OP_BOR, {opcodes::OP_BOR, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 15 */
-    {opcodes::OP_BXOR, {opcodes::OP_BXOR, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                        /* 16 */
-    {opcodes::OP_SHL, {opcodes::OP_SHL, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 17 */
-    {opcodes::OP_SHR, {opcodes::OP_SHR, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                          /* 18 */
-    {opcodes::OP_UNM, {opcodes::OP_UNM, {operand_kind::dest, operand_kind::reg}}},                                             /* 19 */
-    {opcodes::OP_BNOT, {opcodes::OP_BNOT, {operand_kind::dest, operand_kind::reg}}},                                           /* 1a */
-    {opcodes::OP_NOT, {opcodes::OP_NOT, {operand_kind::dest, operand_kind::reg}}},                                             /* 1b */
-    {opcodes::OP_LEN, {opcodes::OP_LEN, {operand_kind::dest, operand_kind::reg}}},                                             /* 1c */
-    {opcodes::OP_CONCAT, {opcodes::OP_CONCAT, {operand_kind::dest, operand_kind::reg, operand_kind::reg}}},                    /* 1d */
-    {opcodes::OP_JMP, {opcodes::OP_JMP, {operand_kind::val, operand_kind::jmp}}},                                              /* 1e */
-    {opcodes::OP_EQ, {opcodes::OP_EQ, {operand_kind::val, operand_kind::reg, operand_kind::reg}}},                             /* 1f */
-    {opcodes::OP_LT, {opcodes::OP_LT, {operand_kind::val, operand_kind::reg, operand_kind::reg}}},                             /* 20 */
-    {opcodes::OP_LE, {opcodes::OP_LE, {operand_kind::val, operand_kind::reg, operand_kind::reg}}},                             /* 21 */
-    {opcodes::OP_TEST, {opcodes::OP_TEST, {operand_kind::reg, operand_kind::val}}},                                            /* 22 */
-    {opcodes::OP_TESTSET, {opcodes::OP_TESTSET, {operand_kind::reg, operand_kind::reg, operand_kind::val}}},                   /* 23 */
-    {opcodes::OP_CALL, {opcodes::OP_CALL, {operand_kind::reg, operand_kind::val_multret, operand_kind::val_multret}}},         /* 24 */
-    {opcodes::OP_TAILCALL, {opcodes::OP_TAILCALL, {operand_kind::reg, operand_kind::val_multret, operand_kind::val_multret}}}, /* 25 */
-    {opcodes::OP_RETURN, {opcodes::OP_RETURN, {operand_kind::reg, operand_kind::val_multret}}},                                /* 26 */
-    {opcodes::OP_FORLOOP, {opcodes::OP_FORLOOP, {operand_kind::reg, operand_kind::jmp}}},                                      /* 27 */
-    {opcodes::OP_FORPREP, {opcodes::OP_FORPREP, {operand_kind::reg, operand_kind::jmp}}},                                      /* 28 */
-    {opcodes::OP_TFORCALL, {opcodes::OP_TFORCALL, {operand_kind::reg, operand_kind::val}}},                                    /* 29 */
-    {opcodes::OP_TFORLOOP, {opcodes::OP_TFORLOOP, {operand_kind::reg, operand_kind::jmp}}},                                    /* 2a */
-    {opcodes::OP_SETLIST, {opcodes::OP_SETLIST, {operand_kind::reg, operand_kind::val_multret, operand_kind::val_multret}}},   /* 2b */
-    {opcodes::OP_CLOSURE, {opcodes::OP_CLOSURE, {operand_kind::reg, operand_kind::k_idx_p}}},                                  /* 2c */
-    {opcodes::OP_VARARG, {opcodes::OP_VARARG, {operand_kind::reg, operand_kind::val_multret}}},                                /* 2d */
-    {opcodes::OP_EXTRAARG, {opcodes::OP_EXTRAARG, {operand_kind::reg}}}                                                        /* 2e */
+inline constexpr auto opencodings = make_optable_map<optable_encoding>([](const optable_entry &entry) {
+      optable_encoding result{entry.op, {}};
+      for (auto i = 0u; i < entry.operand_count; ++i)
+            result.encodings.items[i] = entry.operands[i].encoding;
+      result.encodings.count = entry.operand_count;
+      return result;
+});
+
+struct optable_kind {
+      opcodes op;
+      fixed_list<operand_kind, operand_max> kinds;
 };
+inline constexpr auto opkinds = make_optable_map<optable_kind>([](const optable_entry &entry) {
+      optable_kind result{entry.op, {}};
+      for (auto i = 0u; i < entry.operand_count; ++i)
+            result.kinds.items[i] = entry.operands[i].kind;
+      result.kinds.count = entry.operand_count;
+      return result;
+});
 
 struct optable_descriptor {
       const char *const opname;
       const char *const mnemonic;
       const char *const hint;
-      std::vector<const char *> operand_encodings;
+      fixed_list<const char *, operand_max> operand_encodings;
 };
-static std::map<opcodes, optable_descriptor> opdescriptor = {
-    {opcodes::OP_MOVE, {"OP_MOVE", "move", "Move source register to dest register.", {"dest(Register)", "src(Register)"}}},                                                                                                                                                           /* 0 */
-    {opcodes::OP_LOADK, {"OP_LOADK", "loadk", "Load kvalue to destination register.", {"dest(Register)", "kidx(Kvalue Index)"}}},                                                                                                                                                     /* 1 */
-    {opcodes::OP_LOADKX, {"OP_LOADKX", "loadkx", "Load kvalue extended.", {"dest(Register)"}}},                                                                                                                                                                                       /* 2 */
-    {opcodes::OP_LOADBOOL, {"OP_LOADBOOL", "loadbool", "Load boolean to register and take jump.", {"dest(Register)", "val(Value)", "jmp(Jump)"}}},                                                                                                                                    /* 3 */
-    {opcodes::OP_LOADNIL, {"OP_LOADNIL", "loadnil", "Iteration start at first target register then increments above the stack and fills with NIL set by source value.", {"dest(Register)", "val(Value)"}}},                                                                           /* 4 */
-    {opcodes::OP_GETUPVAL, {"OP_GETUPVAL", "getupval", "Load upvalue to destination register.", {"dest(Register)", "upv(Upvalue)"}}},                                                                                                                                                 /* 5 */
-    {opcodes::OP_GETTABUP, {"OP_GETTABUP", "gettabup", "Gets table upvalue as B and index element as C which gets load to A.", {"dest(Register)", "upv(Upvalue)", "val(Value)"}}},                                                                                                    /* 6 */
-    {opcodes::OP_GETTABLE, {"OP_GETTABLE", "gettable", "Gets table as B and index element as C which gets load to A.", {"dest(Register)", "val(Value)", "val(Value)"}}},                                                                                                              /* 7 */
-    {opcodes::OP_SETTABUP, {"OP_SETTABUP", "settabup", "Gets table upvalue as A and index element as B and sets A to the index.", {"upv(Upvalue)", "val(Value)", "val(Value)"}}},                                                                                                     /* 8 */
-    {opcodes::OP_SETUPVAL, {"OP_SETUPVAL", "setupval", "", {"upv(Upvalue)", "val(Value)"}}},                                                                                                                                                                                          /* 9 */
-    {opcodes::OP_SETTABLE, {"OP_SETTABLE", "settable", "", {"src(Register)", "val(Value)", "val(Value)"}}},                                                                                                                                                                           /* a */
-    {opcodes::OP_NEWTABLE, {"OP_NEWTABLE", "newtable", "Creates new table with B being array size and C being hash size.", {"dest(Register)", "tsize(Table Size)", "tsize(Table Size)"}}},                                                                                            /* b */
-    {opcodes::OP_SELF, {"OP_SELF", "self", "Call to self.", {"dest(Register)", "val(Value)", "val(Value)"}}},                                                                                                                                                                         /* c */
-    {opcodes::OP_ADD, {"OP_ADD", "add", "Add B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                                  /* d */
-    {opcodes::OP_SUB, {"OP_SUB", "sub", "Sub B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                                  /* e */
-    {opcodes::OP_MUL, {"OP_MUL", "mul", "Multiply B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                             /* f */
-    {opcodes::OP_MOD, {"OP_MOD", "mod", "Modulus B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                              /* 10 */
-    {opcodes::OP_POW, {"OP_POW", "pow", "Power B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                                /* 11 */
-    {opcodes::OP_DIV, {"OP_DIV", "div", "Divide B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                               /* 12 */
-    {opcodes::OP_IDIV, {"OP_IDIV", "idiv", "Floor division B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                    /* 13 */
-    {opcodes::OP_BAND, {"OP_BAND", "band", "Bitwise and B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                       /* 14 */
-    {opcodes::OP_BOR, {"OP_BOR", "bor", "Bitwise or B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                           /* 15 */
-    {opcodes::OP_BXOR, {"OP_BXOR", "bxor", "Bitwise xor division B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                              /* 16 */
-    {opcodes::OP_SHL, {"OP_SHL", "shl", "Shift left B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                           /* 17 */
-    {opcodes::OP_SHR, {"OP_SHR", "shr", "Shift right B to C and load results to A.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                          /* 18 */
-    {opcodes::OP_UNM, {"OP_UNM", "unm", "Unary minus A to B and load results to A.", {"dest(Register)", "src(Register)"}}},                                                                                                                                                           /* 19 */
-    {opcodes::OP_BNOT, {"OP_BNOT", "bnot", "Binary not A to B and load results to A.", {"dest(Register)", "src(Register)"}}},                                                                                                                                                         /* 1a */
-    {opcodes::OP_NOT, {"OP_NOT", "not", "Unary not A to B and load results to A.", {"dest(Register)", "src(Register)"}}},                                                                                                                                                             /* 1b */
-    {opcodes::OP_LEN, {"OP_LEN", "len", "Unary length of table B and load results to A.", {"dest(Register)", "src(Register)"}}},                                                                                                                                                      /* 1c */
-    {opcodes::OP_CONCAT, {"OP_CONCAT", "concat", "Concat string where start of stack B to C.", {"dest(Register)", "src(Register)", "src(Register)"}}},                                                                                                                                /* 1d */
-    {opcodes::OP_JMP, {"OP_JMP", "jmp", "Jump to sBx if A is not 0 then all upvalues >= A - 1 will be closed.", {"va;(Value)", "jmp(Jump)"}}},                                                                                                                                        /* 1e */
-    {opcodes::OP_EQ, {"OP_EQ", "eq", "Compare equal B to C and if comparision is not A skip next instruction.", {"va;(Value)", "src(Register)", "src(Register)"}}},                                                                                                                   /* 1f */
-    {opcodes::OP_LT, {"OP_LT", "lt", "Compare less than B to C and if comparision is not A skip next instruction.", {"va;(Value)", "src(Register)", "src(Register)"}}},                                                                                                               /* 20 */
-    {opcodes::OP_LE, {"OP_LE", "le", "Compare less than equal B to C and if comparision is not A skip next instruction.", {"va;(Value)", "src(Register)", "src(Register)"}}},                                                                                                         /* 21 */
-    {opcodes::OP_TEST, {"OP_TEST", "test", "Compare A to C and if false skip next instruction", {"src(Register)", "val(Value)"}}},                                                                                                                                                    /* 22 */
-    {opcodes::OP_TESTSET, {"OP_TESTSET", "testset", "Compare B to C and if false skip next instruction else set A to B.", {"src(Register)", "src(Register)", "val(Value)"}}},                                                                                                         /* 23 */
-    {opcodes::OP_CALL, {"OP_CALL", "call", "Call A with B args and C return.", {"src(Register)", "multret(Multret Value)", "multret(Multret Value)"}}},                                                                                                                               /* 24 */
-    {opcodes::OP_TAILCALL, {"OP_TAILCALL", "tailcall", "Return call A with B args and C return.", {"src(Register)", "multret(Multret Value)", "multret(Multret Value)"}}},                                                                                                            /* 25 */
-    {opcodes::OP_RETURN, {"OP_RETURN", "return", "Return from start A to A + B - 2.", {"src(Register)", "multret(Multret Value)"}}},                                                                                                                                                  /* 26 */
-    {opcodes::OP_FORLOOP, {"OP_FORLOOP", "forloop", "For loop follows for format starting A with sBx jump.", {"src(Register)", "jmp(Jump)"}}},                                                                                                                                        /* 27 */
-    {opcodes::OP_FORPREP, {"OP_FORPREP", "forprep", "For loop follows for format starting A with sBx jump.", {"src(Register)", "jmp(Jump)"}}},                                                                                                                                        /* 28 */
-    {opcodes::OP_TFORCALL, {"OP_TFORCALL", "tforcall", "For prep calls iterator function.", {"src(Register)", "val(Value)"}}},                                                                                                                                                        /* 29 */
-    {opcodes::OP_TFORLOOP, {"OP_TFORLOOP", "tforloop", "For loop follows T for format starting A with sBx jump.", {"src(Register)", "jmp(Jump)"}}},                                                                                                                                   /* 2a */
-    {opcodes::OP_SETLIST, {"OP_SETLIST", "setlist", "Sets the values for a range of array elements in a table referenced by A, B is the number of elements to set, C encodes the block number initialized.", {"src(Register)", "multret(Multret Value)", "multret(Multret Value)"}}}, /* 2b */
-    {opcodes::OP_CLOSURE, {"OP_CLOSURE", "closure", "Set to kvalue proto.", {"src(Register)", "kidxp(Kvalue Proto Index)"}}},                                                                                                                                                         /* 2c */
-    {opcodes::OP_VARARG, {"OP_VARARG", "vararg", "Set range A + 1 to A + B - e1 to vararg.", {"src(Register)", "multret(Multret Value)"}}},                                                                                                                                           /* 2d */
-    {opcodes::OP_EXTRAARG, {"OP_EXTRAARG", "extraarg", "Extra arg Ax for previous opcode.", {"src(Register)"}}}                                                                                                                                                                       /* 2e */
-};
\ No newline at end of file
+inline constexpr auto opdescriptor = make_optable_map<optable_descriptor>([](const optable_entry &entry) {
+      fixed_list<const char *, operand_max> descriptors{};
+      for (auto i = 0u; i < entry.operand_count; ++i)
+            descriptors.items[i] = entry.operands[i].descriptor;
+      descriptors.count = entry.operand_count;
+      return optable_descriptor{entry.opname, entry.mnemonic, entry.hint, descriptors};
+});
@@ -0,0 +1,570 @@
+#pragma once
+
+#include "header.hpp"
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+      Runtime loader for IS_*.json instruction sets.
+      Builds the same optable_entry rows header.hpp compiles in, with every string interned into one pool owned by the set.
+*/
+namespace isa {
+
+      struct load_error : std::runtime_error {
+            using std::runtime_error::runtime_error;
+      };
+
+      /* Single pass pull reader over a JSON text, strings are decoded into one reused buffer. */
+      class json_reader {
+          public:
+            explicit json_reader(const std::string_view text) : at(text.data()), end(text.data() + text.size()), begin(text.data()) {}
+
+            /* Next non-whitespace character without consuming it, 0 at the end. */
+            char peek() {
+                  skip_space();
+                  return (at < end) ? *at : '\0';
+            }
+
+            void expect(const char c) {
+                  if (peek() != c)
+                        fail(std::string("expected '") + c + "'");
+                  ++at;
+            }
+
+            /* After '[' or '{': false once the closing bracket is consumed, handles the ',' in between. */
+            bool next(const char close, bool &first) {
+                  if (peek() == close) {
+                        ++at;
+                        return false;
+                  }
+                  if (!first)
+                        expect(',');
+                  first = false;
+                  return true;
+            }
+
+            /* The view stays valid until the next string is read. */
+            std::string_view string() {
+                  expect('"');
+                  /* Fast path, no escapes means the text can be handed out as is. */
+                  const auto start = at;
+                  while (at < end && *at != '"' && *at != '\\')
+                        ++at;
+                  if (at < end && *at == '"')
+                        return {start, static_cast<std::size_t>(at++ - start)};
+
+                  scratch.assign(start, at);
+                  while (at < end && *at != '"') {
+                        if (*at != '\\') {
+                              scratch += *at++;
+                              continue;
+                        }
+                        if (++at == end)
+                              break;
+                        switch (*at++) {
+                              case '"':
+                                    scratch += '"';
+                                    break;
+                              case '\\':
+                                    scratch += '\\';
+                                    break;
+                              case '/':
+                                    scratch += '/';
+                                    break;
+                              case 'b':
+                                    scratch += '\b';
+                                    break;
+                              case 'f':
+                                    scratch += '\f';
+                                    break;
+                              case 'n':
+                                    scratch += '\n';
+                                    break;
+                              case 'r':
+                                    scratch += '\r';
+                                    break;
+                              case 't':
+                                    scratch += '\t';
+                                    break;
+                              case 'u':
+                                    utf8(codepoint());
+                                    break;
+                              default:
+                                    fail("bad escape");
+                        }
+                  }
+                  if (at == end)
+                        fail("unterminated string");
+                  ++at;
+                  return scratch;
+            }
+
+            std::int64_t integer() {
+                  peek();
+                  auto negative = false;
+                  if (at < end && *at == '-') {
+                        negative = true;
+                        ++at;
+                  }
+                  if (at == end || *at < '0' || *at > '9')
+                        fail("expected integer");
+                  auto value = std::int64_t{0};
+                  while (at < end && *at >= '0' && *at <= '9') {
+                        if (value > (INT64_MAX - 9) / 10)
+                              fail("integer out of range");
+                        value = value * 10 + (*at++ - '0');
+                  }
+                  if (at < end && (*at == '.' || *at == 'e' || *at == 'E'))
+                        fail("expected integer");
+                  return negative ? -value : value;
+            }
+
+            /* Skips any value, nested or not. */
+            void skip() {
+                  switch (peek()) {
+                        case '"':
+                              string();
+                              return;
+                        case '{':
+                        case '[': {
+                              const auto close = (*at == '{') ? '}' : ']';
+                              ++at;
+                              auto first = true;
+                              while (next(close, first)) {
+                                    if (close == '}') {
+                                          string();
+                                          expect(':');
+                                    }
+                                    skip();
+                              }
+                              return;
+                        }
+                        default:
+                              break;
+                  }
+                  const auto start = at;
+                  while (at < end && (std::strchr("+-.eE", *at) != nullptr || (*at >= '0' && *at <= '9') || (*at >= 'a' && *at <= 'z')))
+                        ++at;
+                  if (at == start)
+                        fail("unexpected character");
+            }
+
+            void finish() {
+                  if (peek() != '\0')
+                        fail("trailing data");
+            }
+
+            [[noreturn]] void fail(const std::string &what) const {
+                  throw load_error(what + " at offset " + std::to_string(at - begin));
+            }
+
+          private:
+            const char *at;
+            const char *end;
+            const char *begin;
+            std::string scratch;
+
+            void skip_space() {
+                  while (at < end && (*at == ' ' || *at == '\t' || *at == '\n' || *at == '\r'))
+                        ++at;
+            }
+
+            std::uint32_t hex4() {
+                  if (end - at < 4)
+                        fail("bad \\u escape");
+                  auto value = 0u;
+                  for (auto i = 0u; i < 4u; ++i) {
+                        const auto c = *at++;
+                        value <<= 4u;
+                        if (c >= '0' && c <= '9')
+                              value |= static_cast<std::uint32_t>(c - '0');
+                        else if (c >= 'a' && c <= 'f')
+                              value |= static_cast<std::uint32_t>(c - 'a' + 10);
+                        else if (c >= 'A' && c <= 'F')
+                              value |= static_cast<std::uint32_t>(c - 'A' + 10);
+                        else
+                              fail("bad \\u escape");
+                  }
+                  return value;
+            }
+
+            std::uint32_t codepoint() {
+                  const auto high = hex4();
+                  if (high < 0xD800u || high > 0xDBFFu)
+                        return high;
+                  if (end - at < 2 || at[0] != '\\' || at[1] != 'u')
+                        fail("unpaired surrogate");
+                  at += 2;
+                  const auto low = hex4();
+                  if (low < 0xDC00u || low > 0xDFFFu)
+                        fail("unpaired surrogate");
+                  return 0x10000u + ((high - 0xD800u) << 10u) + (low - 0xDC00u);
+            }
+
+            void utf8(const std::uint32_t cp) {
+                  if (cp < 0x80u) {
+                        scratch += static_cast<char>(cp);
+                  } else if (cp < 0x800u) {
+                        scratch += static_cast<char>(0xC0u | (cp >> 6u));
+                        scratch += static_cast<char>(0x80u | (cp & 0x3Fu));
+                  } else if (cp < 0x10000u) {
+                        scratch += static_cast<char>(0xE0u | (cp >> 12u));
+                        scratch += static_cast<char>(0x80u | ((cp >> 6u) & 0x3Fu));
+                        scratch += static_cast<char>(0x80u | (cp & 0x3Fu));
+                  } else {
+                        scratch += static_cast<char>(0xF0u | (cp >> 18u));
+                        scratch += static_cast<char>(0x80u | ((cp >> 12u) & 0x3Fu));
+                        scratch += static_cast<char>(0x80u | ((cp >> 6u) & 0x3Fu));
+                        scratch += static_cast<char>(0x80u | (cp & 0x3Fu));
+                  }
+            }
+      };
+
+      /* One contiguous block of NUL terminated strings, equal strings are stored once. */
+      class string_pool {
+          public:
+            using handle = std::uint32_t;
+
+            handle intern(const std::string_view text) {
+                  if ((count + 1u) * 2u > slots.size())
+                        rehash(slots.empty() ? 64u : slots.size() * 2u);
+                  const auto hash = hash_of(text);
+                  const auto length = static_cast<std::uint32_t>(text.size());
+                  auto index = hash & (slots.size() - 1u);
+                  for (; slots[index].offset != empty; index = (index + 1u) & (slots.size() - 1u)) {
+                        const auto &slot = slots[index];
+                        if (slot.hash == hash && slot.length == length && std::memcmp(bytes.data() + slot.offset, text.data(), length) == 0)
+                              return slot.offset;
+                  }
+                  const auto offset = static_cast<handle>(bytes.size());
+                  bytes.insert(bytes.end(), text.begin(), text.end());
+                  bytes.push_back('\0');
+                  slots[index] = {offset, length, hash};
+                  ++count;
+                  return offset;
+            }
+
+            /* Pointers are stable until the next intern(). */
+            const char *c_str(const handle h) const {
+                  return bytes.data() + h;
+            }
+
+            std::string_view view(const handle h) const {
+                  return {bytes.data() + h, std::strlen(bytes.data() + h)};
+            }
+
+            /* The whole pool, handles are offsets into it. */
+            const char *data() const {
+                  return bytes.data();
+            }
+
+            std::size_t size() const {
+                  return bytes.size();
+            }
+
+            std::size_t strings() const {
+                  return count;
+            }
+
+            void reserve(const std::size_t bytes_hint, const std::size_t strings_hint) {
+                  bytes.reserve(bytes_hint);
+                  auto n = std::size_t{16u};
+                  while (n < strings_hint * 2u)
+                        n *= 2u;
+                  if (n > slots.size())
+                        rehash(n);
+            }
+
+          private:
+            static constexpr handle empty = ~handle{0u};
+
+            struct slot {
+                  handle offset;
+                  std::uint32_t length;
+                  std::uint32_t hash;
+            };
+
+            std::vector<char> bytes;
+            std::vector<slot> slots;
+            std::size_t count = 0u;
+
+            static std::uint32_t hash_of(const std::string_view text) {
+                  auto hash = 2166136261u; /* FNV-1a */
+                  for (const auto c : text)
+                        hash = (hash ^ static_cast<std::uint8_t>(c)) * 16777619u;
+                  return hash;
+            }
+
+            void rehash(const std::size_t size) {
+                  std::vector<slot> fresh(size, slot{empty, 0u, 0u});
+                  for (const auto &s : slots) {
+                        if (s.offset == empty)
+                              continue;
+                        auto index = s.hash & (size - 1u);
+                        while (fresh[index].offset != empty)
+                              index = (index + 1u) & (size - 1u);
+                        fresh[index] = s;
+                  }
+                  slots.swap(fresh);
+            }
+      };
+
+      /* Spellings IS_*.json uses. */
+      inline constexpr std::pair<std::string_view, operand_encoding> encoding_names[] = {{"A", operand_encoding::A}, {"B", operand_encoding::B}, {"C", operand_encoding::C}, {"Bx", operand_encoding::Bx}, {"Ax", operand_encoding::Ax}, {"sBx", operand_encoding::sBx}};
+      inline constexpr std::pair<std::string_view, operand_kind> kind_names[] = {{"dest", operand_kind::dest}, {"reg", operand_kind::reg}, {"k_idx", operand_kind::k_idx}, {"val", operand_kind::val}, {"jmp", operand_kind::jmp}, {"upvalue", operand_kind::upvalue}, {"table_size", operand_kind::table_size}, {"val_multret", operand_kind::val_multret}, {"k_idx_p", operand_kind::k_idx_p}};
+
+      template <typename T, std::size_t N>
+      constexpr bool parse_name(const std::pair<std::string_view, T> (&names)[N], const std::string_view name, T &out) {
+            for (const auto &n : names) {
+                  if (n.first == name) {
+                        out = n.second;
+                        return true;
+                  }
+            }
+            return false;
+      }
+
+      template <typename T, std::size_t N>
+      constexpr std::string_view name_of(const std::pair<std::string_view, T> (&names)[N], const T value) {
+            for (const auto &n : names) {
+                  if (n.second == value)
+                        return n.first;
+            }
+            return {};
+      }
+
+      constexpr bool parse_encoding(const std::string_view name, operand_encoding &out) {
+            return parse_name(encoding_names, name, out);
+      }
+
+      constexpr bool parse_kind(const std::string_view name, operand_kind &out) {
+            return parse_name(kind_names, name, out);
+      }
+
+      /* "9Bits", "Signed 18Bits", the shift comes from the encoding's position in the word. */
+      constexpr bool parse_size(const std::string_view size, const operand_encoding encoding, operand_field &out) {
+            constexpr std::string_view signed_prefix = "Signed ";
+            constexpr std::string_view suffix = "Bits";
+            auto text = size;
+            const auto is_signed = text.substr(0u, signed_prefix.size()) == signed_prefix;
+            if (is_signed)
+                  text.remove_prefix(signed_prefix.size());
+            if (text.size() <= suffix.size() || text.substr(text.size() - suffix.size()) != suffix)
+                  return false;
+            text.remove_suffix(suffix.size());
+            auto bits = 0u;
+            for (const auto c : text) {
+                  if (c < '0' || c > '9')
+                        return false;
+                  bits = bits * 10u + static_cast<std::uint32_t>(c - '0');
+                  if (bits > 32u)
+                        return false;
+            }
+            const auto shift = field_of(encoding).shift;
+            if (bits == 0u || shift + bits > 32u)
+                  return false;
+            out = make_field(shift, static_cast<std::uint8_t>(bits), is_signed);
+            return true;
+      }
+
+      /*
+            A loaded instruction set: rows indexed by opcode like optable, holes for unused opcodes have a null mnemonic.
+            Rows point into the pool, moving the set keeps them valid.
+      */
+      class instruction_set {
+          public:
+            instruction_set() = default;
+            instruction_set(const instruction_set &) = delete;
+            instruction_set &operator=(const instruction_set &) = delete;
+            instruction_set(instruction_set &&) = default;
+            instruction_set &operator=(instruction_set &&) = default;
+
+            static instruction_set parse(const std::string_view json) {
+                  instruction_set set;
+                  set.read(json);
+                  return set;
+            }
+
+            static instruction_set load(const std::string &path) {
+                  const io::mapped_file file(path);
+                  return parse({reinterpret_cast<const char *>(file.data()), file.size()});
+            }
+
+            std::size_t size() const {
+                  return rows.size();
+            }
+
+            bool valid(const std::size_t op) const {
+                  return op < rows.size() && rows[op].mnemonic != nullptr;
+            }
+
+            const optable_entry &operator[](const std::size_t op) const {
+                  return rows[op];
+            }
+
+            const optable_entry &at(const std::size_t op) const {
+                  if (!valid(op))
+                        throw std::out_of_range("opcode not in instruction set");
+                  return rows[op];
+            }
+
+            const optable_entry *begin() const {
+                  return rows.data();
+            }
+
+            const optable_entry *end() const {
+                  return rows.data() + rows.size();
+            }
+
+            /* Opcode of a mnemonic, -1 when missing. */
+            std::int32_t find(const std::string_view mnemonic) const {
+                  for (auto i = 0u; i < rows.size(); ++i) {
+                        if (rows[i].mnemonic != nullptr && mnemonic == rows[i].mnemonic)
+                              return static_cast<std::int32_t>(i);
+                  }
+                  return -1;
+            }
+
+            const string_pool &strings() const {
+                  return pool;
+            }
+
+          private:
+            /* Rows as pool handles while parsing, the pool may still move. */
+            struct pending_operand {
+                  operand_encoding encoding;
+                  operand_kind kind;
+                  operand_field field;
+                  string_pool::handle name = 0u, hint = 0u, descriptor = 0u;
+            };
+
+            struct pending_row {
+                  std::int64_t op = -1;
+                  string_pool::handle opname = 0u, mnemonic = 0u, hint = 0u;
+                  std::uint8_t operand_count = 0u;
+                  pending_operand operands[operand_max];
+            };
+
+            string_pool pool;
+            std::vector<optable_entry> rows;
+
+            void read(const std::string_view json) {
+                  /* Each row interns a handful of mostly shared strings, the input size bounds the pool. */
+                  pool.reserve(json.size() / 2u, 256u);
+                  pool.intern(""); /* Handle 0, what missing strings point at. */
+                  std::vector<pending_row> pending;
+                  pending.reserve(64u);
+                  std::string scratch, size;
+
+                  json_reader in(json);
+                  in.expect('[');
+                  auto first = true;
+                  while (in.next(']', first)) {
+                        pending_row row;
+                        auto have_mnemonic = false;
+                        in.expect('{');
+                        auto first_key = true;
+                        while (in.next('}', first_key)) {
+                              const auto key = in.string();
+                              in.expect(':');
+                              if (key == "mnemonic") {
+                                    const auto mnemonic = in.string();
+                                    row.mnemonic = pool.intern(mnemonic);
+                                    scratch.assign("OP_");
+                                    for (const auto c : mnemonic)
+                                          scratch += (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+                                    row.opname = pool.intern(scratch);
+                                    have_mnemonic = true;
+                              } else if (key == "hint") {
+                                    row.hint = pool.intern(in.string());
+                              } else if (key == "opcode") {
+                                    row.op = in.integer();
+                                    if (row.op < 0 || row.op > static_cast<std::int64_t>(op_mask))
+                                          in.fail("opcode out of range");
+                              } else if (key == "operands") {
+                                    read_operands(in, row, scratch, size);
+                              } else {
+                                    in.skip();
+                              }
+                        }
+                        if (!have_mnemonic || row.op < 0)
+                              in.fail("instruction without mnemonic or opcode");
+                        pending.push_back(row);
+                  }
+                  in.finish();
+
+                  auto count = std::size_t{0u};
+                  for (const auto &row : pending)
+                        count = (static_cast<std::size_t>(row.op) + 1u > count) ? static_cast<std::size_t>(row.op) + 1u : count;
+                  rows.assign(count, optable_entry{});
+                  for (const auto &row : pending) {
+                        auto &out = rows[static_cast<std::size_t>(row.op)];
+                        if (out.mnemonic != nullptr)
+                              throw load_error("duplicate opcode " + std::to_string(row.op));
+                        out.op = static_cast<opcodes>(row.op);
+                        out.opname = pool.c_str(row.opname);
+                        out.mnemonic = pool.c_str(row.mnemonic);
+                        out.hint = pool.c_str(row.hint);
+                        out.operand_count = row.operand_count;
+                        for (auto i = 0u; i < row.operand_count; ++i) {
+                              const auto &o = row.operands[i];
+                              out.operands[i] = {o.encoding, o.kind, o.field, pool.c_str(o.name), pool.c_str(o.hint), pool.c_str(o.descriptor)};
+                        }
+                  }
+            }
+
+            void read_operands(json_reader &in, pending_row &row, std::string &scratch, std::string &size) {
+                  in.expect('[');
+                  auto first = true;
+                  while (in.next(']', first)) {
+                        if (row.operand_count == operand_max)
+                              in.fail("too many operands");
+                        auto &operand = row.operands[row.operand_count++];
+                        size.clear();
+                        auto have_encoding = false, have_kind = false;
+                        in.expect('{');
+                        auto first_key = true;
+                        while (in.next('}', first_key)) {
+                              const auto key = in.string();
+                              in.expect(':');
+                              if (key == "operand") {
+                                    operand.name = pool.intern(in.string());
+                              } else if (key == "hint") {
+                                    operand.hint = pool.intern(in.string());
+                              } else if (key == "encoding") {
+                                    if (!parse_encoding(in.string(), operand.encoding))
+                                          in.fail("unknown operand encoding");
+                                    have_encoding = true;
+                              } else if (key == "kind") {
+                                    if (!parse_kind(in.string(), operand.kind))
+                                          in.fail("unknown operand kind");
+                                    have_kind = true;
+                              } else if (key == "size") {
+                                    size.assign(in.string());
+                              } else {
+                                    in.skip();
+                              }
+                        }
+                        if (!have_encoding || !have_kind)
+                              in.fail("operand without encoding or kind");
+                        operand.field = field_of(operand.encoding);
+                        if (!size.empty() && !parse_size(size, operand.encoding, operand.field))
+                              in.fail("bad operand size \"" + size + "\"");
+                        scratch.assign(pool.view(operand.name));
+                        scratch += '(';
+                        scratch += pool.view(operand.hint);
+                        scratch += ')';
+                        operand.descriptor = pool.intern(scratch);
+                  }
+            }
+      };
+
+} // namespace isa
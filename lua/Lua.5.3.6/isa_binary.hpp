@@ -0,0 +1,365 @@
+#pragma once
+
+#include "header.hpp"
+#include "isa.hpp"
+#include "mapped_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*
+      Binary instruction set files, mapped and used in place.
+
+      Little endian, every offset is from the start of the file:
+            header    64 bytes  "LISB", version, counts, section offsets, source hash, checksum
+            opcodes   16 bytes each, indexed by opcode: opname, mnemonic, hint (string offsets), first operand, operand count, flags
+            operands  20 bytes each: encoding, kind, shift, bits, signed, name, hint, descriptor (string offsets)
+            strings   NUL terminated, offsets are relative to the section
+*/
+namespace isa::binary {
+
+      constexpr char magic[] = "LISB";
+      constexpr std::uint16_t version = 1u;
+      constexpr std::size_t header_size = 64u;
+      constexpr std::size_t opcode_record_size = 16u;
+      constexpr std::size_t operand_record_size = 20u;
+      constexpr std::size_t checksum_offset = 40u;
+      constexpr std::uint8_t opcode_present = 1u << 0u;
+
+      /* FNV-1a 64, also what the source hash of a JSON text is. */
+      inline std::uint64_t hash(const void *const data, const std::size_t size, std::uint64_t seed = 14695981039346656037ull) {
+            const auto bytes = static_cast<const std::uint8_t *>(data);
+            for (auto i = std::size_t{0u}; i < size; ++i)
+                  seed = (seed ^ bytes[i]) * 1099511628211ull;
+            return seed;
+      }
+
+      /* Over the whole file minus the checksum field itself. */
+      inline std::uint64_t checksum(const std::uint8_t *const bytes, const std::size_t size) {
+            const auto head = hash(bytes, checksum_offset);
+            return hash(bytes + checksum_offset + 8u, size - checksum_offset - 8u, head);
+      }
+
+      namespace detail {
+
+            template <typename T>
+            inline T load(const std::uint8_t *const bytes) {
+                  T value;
+                  std::memcpy(&value, bytes, sizeof(T));
+                  return value;
+            }
+
+            template <typename T>
+            inline void store(std::uint8_t *const bytes, const T value) {
+                  std::memcpy(bytes, &value, sizeof(T));
+            }
+
+      } // namespace detail
+
+      /*
+            Serializes any table shaped like instruction_set (size(), valid(op), operator[] giving optable_entry).
+            `source_hash` is hash() of the JSON the set came from, 0 when there was none.
+      */
+      template <typename Set>
+      std::vector<std::uint8_t> write(const Set &set, const std::uint64_t source_hash = 0u) {
+            string_pool strings;
+            strings.intern("");
+            std::vector<std::uint8_t> opcodes_section(set.size() * opcode_record_size);
+            std::vector<std::uint8_t> operands_section;
+            auto operand_count = 0u;
+
+            for (auto op = 0u; op < set.size(); ++op) {
+                  auto record = opcodes_section.data() + op * opcode_record_size;
+                  if (!set.valid(op))
+                        continue;
+                  const auto &entry = set[op];
+                  detail::store<std::uint32_t>(record + 0u, strings.intern(entry.opname));
+                  detail::store<std::uint32_t>(record + 4u, strings.intern(entry.mnemonic));
+                  detail::store<std::uint32_t>(record + 8u, strings.intern(entry.hint));
+                  detail::store<std::uint16_t>(record + 12u, static_cast<std::uint16_t>(operand_count));
+                  record[14] = entry.operand_count;
+                  record[15] = opcode_present;
+                  for (auto i = 0u; i < entry.operand_count; ++i, ++operand_count) {
+                        const auto &operand = entry.operands[i];
+                        std::uint8_t out[operand_record_size] = {};
+                        out[0] = static_cast<std::uint8_t>(operand.encoding);
+                        out[1] = static_cast<std::uint8_t>(operand.kind);
+                        out[2] = operand.field.shift;
+                        out[3] = operand.field.bits;
+                        out[4] = operand.field.is_signed ? 1u : 0u;
+                        detail::store<std::uint32_t>(out + 8u, strings.intern(operand.name));
+                        detail::store<std::uint32_t>(out + 12u, strings.intern(operand.hint));
+                        detail::store<std::uint32_t>(out + 16u, strings.intern(operand.descriptor));
+                        operands_section.insert(operands_section.end(), out, out + operand_record_size);
+                  }
+            }
+
+            const auto opcodes_offset = header_size;
+            const auto operands_offset = opcodes_offset + opcodes_section.size();
+            const auto strings_offset = operands_offset + operands_section.size();
+            std::vector<std::uint8_t> bytes(strings_offset + strings.size());
+            std::memcpy(bytes.data(), magic, 4u);
+            detail::store<std::uint16_t>(bytes.data() + 4u, version);
+            detail::store<std::uint16_t>(bytes.data() + 6u, static_cast<std::uint16_t>(header_size));
+            detail::store<std::uint32_t>(bytes.data() + 8u, static_cast<std::uint32_t>(set.size()));
+            detail::store<std::uint32_t>(bytes.data() + 12u, operand_count);
+            detail::store<std::uint32_t>(bytes.data() + 16u, static_cast<std::uint32_t>(opcodes_offset));
+            detail::store<std::uint32_t>(bytes.data() + 20u, static_cast<std::uint32_t>(operands_offset));
+            detail::store<std::uint32_t>(bytes.data() + 24u, static_cast<std::uint32_t>(strings_offset));
+            detail::store<std::uint32_t>(bytes.data() + 28u, static_cast<std::uint32_t>(strings.size()));
+            detail::store<std::uint64_t>(bytes.data() + 32u, source_hash);
+            std::memcpy(bytes.data() + opcodes_offset, opcodes_section.data(), opcodes_section.size());
+            if (!operands_section.empty())
+                  std::memcpy(bytes.data() + operands_offset, operands_section.data(), operands_section.size());
+            std::memcpy(bytes.data() + strings_offset, strings.data(), strings.size());
+            detail::store<std::uint64_t>(bytes.data() + checksum_offset, checksum(bytes.data(), bytes.size()));
+            return bytes;
+      }
+
+      /*
+            Read side, nothing gets copied or parsed: entries are assembled from the records on access.
+            Structure (bounds of every section, record and string offset) is always checked on open, the checksum on request.
+      */
+      class file {
+          public:
+            /* Maps `path`, `verify` also recomputes the checksum. */
+            static std::unique_ptr<file> open(const std::string &path, const bool verify = true) {
+                  std::unique_ptr<file> result(new file());
+                  result->mapping = io::mapped_file(path);
+                  result->attach(result->mapping.data(), result->mapping.size(), verify);
+                  return result;
+            }
+
+            /* Over caller owned bytes that outlive the file. */
+            static std::unique_ptr<file> view(const void *const data, const std::size_t size, const bool verify = true) {
+                  std::unique_ptr<file> result(new file());
+                  result->attach(static_cast<const std::uint8_t *>(data), size, verify);
+                  return result;
+            }
+
+            std::size_t size() const {
+                  return opcode_count;
+            }
+
+            bool valid(const std::size_t op) const {
+                  return op < opcode_count && (opcode_record(op)[15] & opcode_present);
+            }
+
+            /* Built on the fly, the strings point into the mapping. */
+            optable_entry operator[](const std::size_t op) const {
+                  const auto record = opcode_record(op);
+                  optable_entry entry{};
+                  if (!(record[15] & opcode_present))
+                        return entry;
+                  entry.op = static_cast<opcodes>(op);
+                  entry.opname = string(detail::load<std::uint32_t>(record + 0u));
+                  entry.mnemonic = string(detail::load<std::uint32_t>(record + 4u));
+                  entry.hint = string(detail::load<std::uint32_t>(record + 8u));
+                  entry.operand_count = record[14];
+                  const auto first = detail::load<std::uint16_t>(record + 12u);
+                  for (auto i = 0u; i < entry.operand_count; ++i)
+                        entry.operands[i] = operand(first + i);
+                  return entry;
+            }
+
+            optable_entry at(const std::size_t op) const {
+                  if (!valid(op))
+                        throw std::out_of_range("opcode not in instruction set");
+                  return (*this)[op];
+            }
+
+            optable_operand operand(const std::size_t index) const {
+                  const auto record = bytes + operands_offset + index * operand_record_size;
+                  const auto encoding = static_cast<operand_encoding>(record[0]);
+                  const auto field = make_field(record[2], record[3], record[4] != 0u);
+                  return {encoding, static_cast<operand_kind>(record[1]), field, string(detail::load<std::uint32_t>(record + 8u)), string(detail::load<std::uint32_t>(record + 12u)), string(detail::load<std::uint32_t>(record + 16u))};
+            }
+
+            std::string_view mnemonic(const std::size_t op) const {
+                  return string(detail::load<std::uint32_t>(opcode_record(op) + 4u));
+            }
+
+            /* Opcode of a mnemonic, -1 when missing. */
+            std::int32_t find(const std::string_view name) const {
+                  for (auto op = 0u; op < opcode_count; ++op) {
+                        if (valid(op) && mnemonic(op) == name)
+                              return static_cast<std::int32_t>(op);
+                  }
+                  return -1;
+            }
+
+            std::uint64_t source_hash() const {
+                  return detail::load<std::uint64_t>(bytes + 32u);
+            }
+
+            /* Whether this file was built from a different JSON text. */
+            bool stale(const std::string_view json) const {
+                  return source_hash() != hash(json.data(), json.size());
+            }
+
+            const std::uint8_t *data() const {
+                  return bytes;
+            }
+
+            std::size_t byte_size() const {
+                  return length;
+            }
+
+          private:
+            io::mapped_file mapping;
+            const std::uint8_t *bytes = nullptr;
+            std::size_t length = 0u;
+            std::uint32_t opcode_count = 0u;
+            std::uint32_t operand_count = 0u;
+            std::uint32_t opcodes_offset = 0u;
+            std::uint32_t operands_offset = 0u;
+            std::uint32_t strings_offset = 0u;
+            std::uint32_t strings_size = 0u;
+
+            file() = default;
+
+            const std::uint8_t *opcode_record(const std::size_t op) const {
+                  return bytes + opcodes_offset + op * opcode_record_size;
+            }
+
+            const char *string(const std::uint32_t offset) const {
+                  return reinterpret_cast<const char *>(bytes + strings_offset + offset);
+            }
+
+            void attach(const std::uint8_t *const data, const std::size_t size, const bool verify) {
+                  bytes = data;
+                  length = size;
+                  if (size < header_size || std::memcmp(data, magic, 4u) != 0)
+                        throw load_error("not a binary instruction set");
+                  if (detail::load<std::uint16_t>(data + 4u) != version)
+                        throw load_error("unsupported binary instruction set version " + std::to_string(detail::load<std::uint16_t>(data + 4u)));
+                  if (detail::load<std::uint16_t>(data + 6u) != header_size)
+                        throw load_error("bad header size");
+                  opcode_count = detail::load<std::uint32_t>(data + 8u);
+                  operand_count = detail::load<std::uint32_t>(data + 12u);
+                  opcodes_offset = detail::load<std::uint32_t>(data + 16u);
+                  operands_offset = detail::load<std::uint32_t>(data + 20u);
+                  strings_offset = detail::load<std::uint32_t>(data + 24u);
+                  strings_size = detail::load<std::uint32_t>(data + 28u);
+                  const auto within = [size](const std::uint64_t offset, const std::uint64_t bytes) { return offset <= size && bytes <= size - offset; };
+                  if (opcode_count > (1u << op_bits) || !within(opcodes_offset, std::uint64_t{opcode_count} * opcode_record_size) || !within(operands_offset, std::uint64_t{operand_count} * operand_record_size) || !within(strings_offset, strings_size) || strings_size == 0u || data[strings_offset + strings_size - 1u] != '\0')
+                        throw load_error("truncated binary instruction set");
+                  if (verify && checksum(data, size) != detail::load<std::uint64_t>(data + checksum_offset))
+                        throw load_error("binary instruction set checksum mismatch");
+
+                  /* Records are small and few, checking them up front is what lets every accessor skip it. */
+                  for (auto op = 0u; op < opcode_count; ++op) {
+                        const auto record = opcode_record(op);
+                        if (!(record[15] & opcode_present))
+                              continue;
+                        if (record[14] > operand_max || detail::load<std::uint16_t>(record + 12u) + std::uint32_t{record[14]} > operand_count)
+                              throw load_error("bad operand range for opcode " + std::to_string(op));
+                        for (const auto at : {0u, 4u, 8u})
+                              check_string(detail::load<std::uint32_t>(record + at));
+                  }
+                  for (auto i = 0u; i < operand_count; ++i) {
+                        const auto record = data + operands_offset + i * operand_record_size;
+                        if (name_of(encoding_names, static_cast<operand_encoding>(record[0])).empty() || name_of(kind_names, static_cast<operand_kind>(record[1])).empty())
+                              throw load_error("bad operand record " + std::to_string(i));
+                        if (record[3] == 0u || record[2] + record[3] > 32u)
+                              throw load_error("bad operand field " + std::to_string(i));
+                        for (const auto at : {8u, 12u, 16u})
+                              check_string(detail::load<std::uint32_t>(record + at));
+                  }
+            }
+
+            void check_string(const std::uint32_t offset) const {
+                  if (offset >= strings_size)
+                        throw load_error("string offset out of range");
+            }
+      };
+
+      /* IS_*.json text in the layout iscreate's save() writes, from any instruction_set shaped table. */
+      template <typename Set>
+      std::string to_json(const Set &set) {
+            std::string out;
+            const auto quoted = [&out](const std::string_view text) {
+                  out += '"';
+                  for (const auto c : text) {
+                        switch (c) {
+                              case '"':
+                                    out += "\\\"";
+                                    break;
+                              case '\\':
+                                    out += "\\\\";
+                                    break;
+                              case '\n':
+                                    out += "\\n";
+                                    break;
+                              case '\r':
+                                    out += "\\r";
+                                    break;
+                              case '\t':
+                                    out += "\\t";
+                                    break;
+                              default:
+                                    if (static_cast<std::uint8_t>(c) < 0x20u) {
+                                          constexpr char digits[] = "0123456789abcdef";
+                                          out += "\\u00";
+                                          out += digits[static_cast<std::uint8_t>(c) >> 4u];
+                                          out += digits[static_cast<std::uint8_t>(c) & 15u];
+                                    } else {
+                                          out += c;
+                                    }
+                        }
+                  }
+                  out += '"';
+            };
+
+            out += '[';
+            auto first = true;
+            for (auto op = 0u; op < set.size(); ++op) {
+                  if (!set.valid(op))
+                        continue;
+                  const auto entry = set[op];
+                  if (!first)
+                        out += ',';
+                  first = false;
+                  out += "{\"mnemonic\":";
+                  quoted(entry.mnemonic);
+                  out += ",\"hint\":";
+                  quoted(entry.hint);
+                  out += ",\"opcode\":";
+                  out += std::to_string(op);
+                  out += ",\"operands\":[";
+                  for (auto i = 0u; i < entry.operand_count; ++i) {
+                        const auto &operand = entry.operands[i];
+                        if (i != 0u)
+                              out += ',';
+                        out += "{\"operand\":";
+                        quoted(operand.name);
+                        out += ",\"encoding\":";
+                        quoted(name_of(encoding_names, operand.encoding));
+                        out += ",\"size\":\"";
+                        if (operand.field.is_signed)
+                              out += "Signed ";
+                        out += std::to_string(operand.field.bits);
+                        out += "Bits\",\"hint\":";
+                        quoted(operand.hint);
+                        out += ",\"kind\":";
+                        quoted(name_of(kind_names, operand.kind));
+                        out += '}';
+                  }
+                  out += "]}";
+            }
+            out += ']';
+            return out;
+      }
+
+      /* JSON text straight to the binary form, stamped with the text's hash. */
+      inline std::vector<std::uint8_t> from_json(const std::string_view json) {
+            return write(instruction_set::parse(json), hash(json.data(), json.size()));
+      }
+
+} // namespace isa::binary
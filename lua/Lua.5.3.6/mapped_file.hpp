@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace io {
+
+      struct map_error : std::runtime_error {
+            using std::runtime_error::runtime_error;
+      };
+
+      /* Read only mapping of a whole file, unmapped on destruction. */
+      class mapped_file {
+          public:
+            mapped_file() = default;
+
+            explicit mapped_file(const std::string &path) {
+#if defined(_WIN32)
+                  const auto file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+                  if (file == INVALID_HANDLE_VALUE)
+                        throw map_error("cannot open " + path);
+                  LARGE_INTEGER size;
+                  if (!GetFileSizeEx(file, &size)) {
+                        CloseHandle(file);
+                        throw map_error("cannot stat " + path);
+                  }
+                  length = static_cast<std::size_t>(size.QuadPart);
+                  if (length != 0u) {
+                        const auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                        if (mapping != nullptr) {
+                              base = static_cast<const std::uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                              CloseHandle(mapping);
+                        }
+                        if (base == nullptr) {
+                              CloseHandle(file);
+                              throw map_error("cannot map " + path);
+                        }
+                  }
+                  CloseHandle(file);
+#else
+                  const auto fd = ::open(path.c_str(), O_RDONLY);
+                  if (fd < 0)
+                        throw map_error("cannot open " + path);
+                  struct stat info;
+                  if (::fstat(fd, &info) != 0) {
+                        ::close(fd);
+                        throw map_error("cannot stat " + path);
+                  }
+                  length = static_cast<std::size_t>(info.st_size);
+                  if (length != 0u) {
+                        const auto address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                        if (address == MAP_FAILED) {
+                              ::close(fd);
+                              throw map_error("cannot map " + path);
+                        }
+                        base = static_cast<const std::uint8_t *>(address);
+                  }
+                  ::close(fd);
+#endif
+            }
+
+            mapped_file(const mapped_file &) = delete;
+            mapped_file &operator=(const mapped_file &) = delete;
+
+            mapped_file(mapped_file &&other) noexcept : base(std::exchange(other.base, nullptr)), length(std::exchange(other.length, 0u)) {}
+
+            mapped_file &operator=(mapped_file &&other) noexcept {
+                  if (this != &other) {
+                        release();
+                        base = std::exchange(other.base, nullptr);
+                        length = std::exchange(other.length, 0u);
+                  }
+                  return *this;
+            }
+
+            ~mapped_file() {
+                  release();
+            }
+
+            const std::uint8_t *data() const {
+                  return base;
+            }
+
+            std::size_t size() const {
+                  return length;
+            }
+
+            bool empty() const {
+                  return length == 0u;
+            }
+
+            /* Access pattern hint, the loader walks chunks front to back. */
+            void advise_sequential() const {
+#if !defined(_WIN32)
+                  if (base != nullptr)
+                        ::madvise(const_cast<std::uint8_t *>(base), length, MADV_SEQUENTIAL);
+#endif
+            }
+
+          private:
+            const std::uint8_t *base = nullptr;
+            std::size_t length = 0u;
+
+            void release() {
+                  if (base == nullptr)
+                        return;
+#if defined(_WIN32)
+                  UnmapViewOfFile(base);
+#else
+                  ::munmap(const_cast<std::uint8_t *>(base), length);
+#endif
+                  base = nullptr;
+                  length = 0u;
+            }
+      };
+
+} // namespace io
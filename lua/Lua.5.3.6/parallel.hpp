@@ -0,0 +1,281 @@
+#pragma once
+
+#include "chunk.hpp"
+#include "disasm.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+      Work-stealing parallel disassembly.
+      Work splits over chunk files and over the nested protos of each chunk, output always comes back in input order.
+*/
+namespace parallel {
+
+      /* Thread pool where every worker owns a deque, pops its own work LIFO and steals FIFO from the others when empty. */
+      class scheduler {
+          public:
+            using task = std::function<void()>;
+
+            explicit scheduler(std::size_t threads = std::thread::hardware_concurrency()) {
+                  if (threads == 0u)
+                        threads = 1u;
+                  queues = std::vector<queue>(threads);
+                  for (auto i = 0u; i < threads; ++i)
+                        workers.emplace_back([this, i] { work(i); });
+            }
+
+            scheduler(const scheduler &) = delete;
+            scheduler &operator=(const scheduler &) = delete;
+
+            ~scheduler() {
+                  {
+                        std::lock_guard<std::mutex> lock(sleep_mutex);
+                        stopping = true;
+                  }
+                  sleep_cv.notify_all();
+                  for (auto &worker : workers)
+                        worker.join();
+            }
+
+            std::size_t size() const {
+                  return workers.size();
+            }
+
+            /* From a task it lands on the calling worker's own deque, from outside it gets spread round robin. */
+            void spawn(task t) {
+                  pending.fetch_add(1u, std::memory_order_relaxed);
+                  const auto self = current();
+                  const auto target = (self.owner == this) ? self.index : next_queue.fetch_add(1u, std::memory_order_relaxed) % queues.size();
+                  {
+                        std::lock_guard<std::mutex> lock(queues[target].mutex);
+                        queues[target].tasks.push_back(std::move(t));
+                  }
+                  queued.fetch_add(1u, std::memory_order_release);
+                  {
+                        std::lock_guard<std::mutex> lock(sleep_mutex);
+                  }
+                  sleep_cv.notify_one();
+            }
+
+            /* Blocks until every spawned task (and whatever those spawned) has finished, rethrows the first failure. */
+            void wait() {
+                  std::unique_lock<std::mutex> lock(done_mutex);
+                  done_cv.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0u; });
+                  if (failure != nullptr)
+                        std::rethrow_exception(std::exchange(failure, nullptr));
+            }
+
+          private:
+            struct alignas(64) queue {
+                  std::mutex mutex;
+                  std::deque<task> tasks;
+            };
+
+            struct context {
+                  scheduler *owner = nullptr;
+                  std::size_t index = 0u;
+            };
+
+            std::vector<queue> queues;
+            std::vector<std::thread> workers;
+            std::atomic<std::size_t> pending{0u};
+            std::atomic<std::size_t> queued{0u};
+            std::atomic<std::size_t> next_queue{0u};
+
+            std::mutex sleep_mutex;
+            std::condition_variable sleep_cv;
+            bool stopping = false;
+
+            std::mutex done_mutex;
+            std::condition_variable done_cv;
+            std::exception_ptr failure;
+
+            static context &current() {
+                  static thread_local context self;
+                  return self;
+            }
+
+            bool pop(const std::size_t index, task &out) {
+                  auto &own = queues[index];
+                  std::lock_guard<std::mutex> lock(own.mutex);
+                  if (own.tasks.empty())
+                        return false;
+                  out = std::move(own.tasks.back());
+                  own.tasks.pop_back();
+                  return true;
+            }
+
+            bool steal(const std::size_t index, task &out) {
+                  for (auto i = 1u; i < queues.size(); ++i) {
+                        auto &victim = queues[(index + i) % queues.size()];
+                        std::lock_guard<std::mutex> lock(victim.mutex);
+                        if (victim.tasks.empty())
+                              continue;
+                        out = std::move(victim.tasks.front());
+                        victim.tasks.pop_front();
+                        return true;
+                  }
+                  return false;
+            }
+
+            void work(const std::size_t index) {
+                  current() = {this, index};
+                  task t;
+                  for (;;) {
+                        if (pop(index, t) || steal(index, t)) {
+                              queued.fetch_sub(1u, std::memory_order_relaxed);
+                              try {
+                                    t();
+                              } catch (...) {
+                                    std::lock_guard<std::mutex> lock(done_mutex);
+                                    if (failure == nullptr)
+                                          failure = std::current_exception();
+                              }
+                              t = nullptr;
+                              if (pending.fetch_sub(1u, std::memory_order_acq_rel) == 1u) {
+                                    {
+                                          std::lock_guard<std::mutex> lock(done_mutex);
+                                    }
+                                    done_cv.notify_all();
+                              }
+                              continue;
+                        }
+                        std::unique_lock<std::mutex> lock(sleep_mutex);
+                        sleep_cv.wait(lock, [this] { return stopping || queued.load(std::memory_order_acquire) != 0u; });
+                        if (stopping && queued.load(std::memory_order_acquire) == 0u)
+                              return;
+                  }
+            }
+      };
+
+      /* Protos in preorder with their dotted path ("main", "main.0", "main.0.2", ...). */
+      struct proto_ref {
+            const chunk::proto *proto;
+            std::string name;
+      };
+
+      inline void flatten(const chunk::proto &p, const std::string &name, std::vector<proto_ref> &out) {
+            out.push_back({&p, name});
+            for (auto i = 0u; i < p.proto_count(); ++i)
+                  flatten(p.child(i), name + "." + std::to_string(i), out);
+      }
+
+      /* Listing of one proto through the streaming formatter, one renderer per worker thread. */
+      inline void render_proto(const chunk::proto &p, const std::string &name, std::string &out) {
+            static thread_local disasm::renderer renderer;
+            auto w = disasm::writer::to_string(out, 4096u);
+            renderer.proto(w, p, name);
+      }
+
+      /* Whole chunk, one task per proto. */
+      inline std::string disassemble_chunk(scheduler &pool, const chunk::file &file) {
+            std::vector<proto_ref> protos;
+            flatten(file.main(), "main", protos);
+            std::vector<std::string> parts(protos.size());
+            for (auto i = 0u; i < protos.size(); ++i)
+                  pool.spawn([&, i] { render_proto(*protos[i].proto, protos[i].name, parts[i]); });
+            pool.wait();
+
+            std::string result;
+            for (const auto &part : parts)
+                  result += part;
+            return result;
+      }
+
+      struct listing {
+            std::string path;
+            std::string text;
+            std::string error; /* Set when the chunk failed to load or a proto failed to render, `text` then lacks that proto. */
+      };
+
+      /*
+            Many chunk files: one task per file which fans out into one task per proto.
+            `sink` sees listings strictly in input order, each one as soon as it and every earlier file are done.
+      */
+      inline void disassemble_files(scheduler &pool, const std::vector<std::string> &paths, const std::function<void(const listing &)> &sink) {
+            struct job {
+                  listing result;
+                  std::unique_ptr<chunk::file> file;
+                  std::vector<proto_ref> protos;
+                  std::vector<std::string> parts;
+                  std::vector<std::string> errors; /* One per proto, so failing tasks never share a string. */
+                  std::atomic<std::size_t> remaining{0u};
+                  bool done = false;
+            };
+
+            std::vector<job> jobs(paths.size());
+            std::mutex emit_mutex;
+            auto next = std::size_t{0u};
+
+            const auto finish = [&](const std::size_t index) {
+                  auto &j = jobs[index];
+                  for (const auto &part : j.parts)
+                        j.result.text += part;
+                  for (auto p = std::size_t{0u}; p < j.errors.size() && j.result.error.empty(); ++p)
+                        if (!j.errors[p].empty())
+                              j.result.error = j.protos[p].name + ": " + j.errors[p];
+                  j.parts.clear();
+                  j.parts.shrink_to_fit();
+                  j.errors.clear();
+                  j.errors.shrink_to_fit();
+                  j.protos.clear();
+                  j.file.reset();
+
+                  std::lock_guard<std::mutex> lock(emit_mutex);
+                  j.done = true;
+                  while (next < jobs.size() && jobs[next].done) {
+                        sink(jobs[next].result);
+                        jobs[next].result = {};
+                        ++next;
+                  }
+            };
+
+            for (auto i = 0u; i < paths.size(); ++i) {
+                  pool.spawn([&, i] {
+                        auto &j = jobs[i];
+                        j.result.path = paths[i];
+                        try {
+                              j.file = chunk::file::open(paths[i]);
+                        } catch (const std::exception &e) {
+                              j.result.error = e.what();
+                              finish(i);
+                              return;
+                        }
+                        flatten(j.file->main(), "main", j.protos);
+                        /* The last proto task tears the job down, so nothing of `j` may be touched once spawning starts. */
+                        const auto count = j.protos.size();
+                        j.parts.resize(count);
+                        j.errors.resize(count);
+                        j.remaining.store(count, std::memory_order_relaxed);
+                        for (auto p = 0u; p < count; ++p) {
+                              pool.spawn([&, i, p] {
+                                    auto &owner = jobs[i];
+                                    /* A throwing proto still counts down, or this file and every later one would never reach the sink. */
+                                    try {
+                                          render_proto(*owner.protos[p].proto, owner.protos[p].name, owner.parts[p]);
+                                    } catch (const std::exception &e) {
+                                          owner.parts[p].clear();
+                                          owner.errors[p] = e.what();
+                                    }
+                                    if (owner.remaining.fetch_sub(1u, std::memory_order_acq_rel) == 1u)
+                                          finish(i);
+                              });
+                        }
+                  });
+            }
+            pool.wait();
+      }
+
+} // namespace parallel
@@ -0,0 +1,534 @@
+#pragma once
+
+#include "bits.hpp"
+#include "cfg.hpp"
+#include "chunk.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+      Opcode, operand kind and opcode n-gram statistics over decoded code.
+      Every thread counts into its own shard without locks or atomics, merge() adds the shards up once the work is done.
+*/
+namespace profile {
+
+      constexpr std::size_t opcode_slots = 1u << op_bits; /* Every 6 bit value, invalid opcodes get counted too. */
+      constexpr std::size_t kind_count = 9u;              /* operand_kind::dest .. operand_kind::k_idx_p */
+      constexpr std::size_t value_buckets = 33u;          /* 0, then one per bit length of |value|. */
+      constexpr std::size_t ngram_max = 8u;               /* Longest n-gram the sketch mode tracks, 6 bits per opcode in a 64 bit key. */
+
+      enum class mode : std::uint8_t {
+            exact, /* Dense bigram and trigram tables, 2MB per thread. */
+            sketch /* Count-min sketch for 2 .. ngram_length grams plus a bounded candidate list per thread. */
+      };
+
+      struct options {
+            profile::mode mode = profile::mode::exact;
+            std::size_t ngram_length = 3u;        /* Sketch mode, 2 .. ngram_max. */
+            std::size_t sketch_width = 1u << 16u; /* Counters per row, rounded up to a power of two. */
+            std::size_t sketch_depth = 4u;
+            std::size_t candidates = 1024u; /* Heaviest n-grams each thread keeps keys for. */
+            bool block_local = true;        /* N-grams never run across a jump, branch or return. */
+      };
+
+      /* Key of an n-gram: opcodes 6 bits each, oldest in the highest bits, length in the top nibble. */
+      using ngram_key = std::uint64_t;
+
+      constexpr ngram_key make_key(const std::uint64_t window, const std::size_t n) {
+            return (window & ((1ull << (n * op_bits)) - 1u)) | (static_cast<std::uint64_t>(n) << 60u);
+      }
+
+      constexpr std::size_t key_length(const ngram_key key) {
+            return static_cast<std::size_t>(key >> 60u);
+      }
+
+      constexpr opcodes key_opcode(const ngram_key key, const std::size_t i) {
+            return static_cast<opcodes>((key >> ((key_length(key) - 1u - i) * op_bits)) & op_mask);
+      }
+
+      /* Bucket of an operand value, 0 holds zero and bucket b holds |value| in [2^(b-1), 2^b). */
+      inline std::size_t bucket_of(const std::int64_t value) {
+            const auto magnitude = static_cast<std::uint64_t>(value < 0 ? -value : value);
+            const auto width = std::size_t{bits::bit_width(magnitude)};
+            return (width < value_buckets) ? width : value_buckets - 1u;
+      }
+
+      struct kind_stats {
+            std::uint64_t count = 0u;
+            std::uint64_t constants = 0u; /* RK operands that held a kvalue index. */
+            std::uint64_t negative = 0u;  /* sBx below zero. */
+            std::array<std::uint64_t, value_buckets> buckets{};
+      };
+
+      namespace detail {
+
+            /* Per opcode operand layout flattened for the counting loop, unused slots count into a discarded kind. */
+            struct operand_plan {
+                  std::uint8_t kind[operand_max];
+                  std::uint8_t encoding[operand_max];
+                  std::uint8_t rk[operand_max];
+                  bool ends_run; /* Execution may not fall through to the next instruction. */
+            };
+
+            struct plan_table {
+                  operand_plan plans[opcode_slots];
+            };
+
+            constexpr plan_table make_plans() {
+                  plan_table table{};
+                  for (auto op = 0u; op < opcode_slots; ++op) {
+                        auto &plan = table.plans[op];
+                        for (auto i = 0u; i < operand_max; ++i)
+                              plan.kind[i] = static_cast<std::uint8_t>(kind_count);
+                        plan.ends_run = true;
+                        if (!opcode_valid(static_cast<opcodes>(op)))
+                              continue;
+                        const auto &entry = optable[op];
+                        for (auto i = 0u; i < entry.operand_count; ++i) {
+                              const auto encoding = entry.operands[i].encoding;
+                              plan.kind[i] = static_cast<std::uint8_t>(entry.operands[i].kind);
+                              plan.encoding[i] = static_cast<std::uint8_t>(encoding);
+                              plan.rk[i] = (encoding == operand_encoding::B) ? decoder::rk_b : (encoding == operand_encoding::C) ? decoder::rk_c : 0u;
+                        }
+                        const auto flow = cfg::flow_of(static_cast<opcodes>(op));
+                        plan.ends_run = flow != cfg::flow::next && flow != cfg::flow::extra_arg;
+                  }
+                  return table;
+            }
+
+      } // namespace detail
+
+      inline constexpr detail::plan_table plans = detail::make_plans();
+
+      /* Fixed memory frequency estimates, never below the true count. */
+      class count_min {
+          public:
+            static constexpr std::size_t depth_max = 16u;
+
+            count_min() = default;
+
+            /* `width` counters per row (rounded up to a power of two), `depth` rows. */
+            count_min(const std::size_t width, const std::size_t depth) : depth(std::min(depth, depth_max)) {
+                  auto w = std::size_t{1u};
+                  while (w < width)
+                        w *= 2u;
+                  mask = w - 1u;
+                  cells.assign(w * this->depth, 0u);
+            }
+
+            /* Conservative update: only the rows at the current minimum grow. Returns the new estimate. */
+            std::uint64_t add(const ngram_key key, const std::uint64_t by = 1u) {
+                  std::size_t slots[depth_max];
+                  locate(key, slots);
+                  auto estimate = ~std::uint64_t{0u};
+                  for (auto i = 0u; i < depth; ++i)
+                        estimate = std::min(estimate, cells[slots[i]]);
+                  const auto next = estimate + by;
+                  for (auto i = 0u; i < depth; ++i)
+                        cells[slots[i]] = std::max(cells[slots[i]], next);
+                  return next;
+            }
+
+            std::uint64_t estimate(const ngram_key key) const {
+                  std::size_t slots[depth_max];
+                  locate(key, slots);
+                  auto estimate = ~std::uint64_t{0u};
+                  for (auto i = 0u; i < depth; ++i)
+                        estimate = std::min(estimate, cells[slots[i]]);
+                  return estimate;
+            }
+
+            /* Same shape only, the sum is a valid sketch of both streams. */
+            void merge(const count_min &other) {
+                  for (auto i = std::size_t{0u}; i < cells.size(); ++i)
+                        cells[i] += other.cells[i];
+            }
+
+            std::size_t bytes() const {
+                  return cells.size() * sizeof(std::uint64_t);
+            }
+
+          private:
+            std::vector<std::uint64_t> cells;
+            std::size_t mask = 0u;
+            std::size_t depth = 0u;
+
+            static std::uint64_t mix(std::uint64_t x) {
+                  x ^= x >> 30u;
+                  x *= 0xBF58476D1CE4E5B9ull;
+                  x ^= x >> 27u;
+                  x *= 0x94D049BB133111EBull;
+                  return x ^ (x >> 31u);
+            }
+
+            /* Row i probes h1 + i * h2. */
+            void locate(const ngram_key key, std::size_t *const slots) const {
+                  const auto h = mix(key);
+                  const auto h1 = h & 0xFFFFFFFFu;
+                  const auto h2 = (h >> 32u) | 1u;
+                  for (auto i = 0u; i < depth; ++i)
+                        slots[i] = i * (mask + 1u) + ((h1 + i * h2) & mask);
+            }
+      };
+
+      /* Bounded set of the heaviest keys seen so far by sketch estimate, kept as a min-heap so the floor is always at hand. */
+      class candidate_set {
+          public:
+            explicit candidate_set(const std::size_t capacity = 0u) : capacity(capacity) {
+                  auto size = std::size_t{16u};
+                  while (size < capacity * 2u)
+                        size *= 2u;
+                  index.assign(size, empty);
+                  heap.reserve(capacity);
+            }
+
+            /* Estimates of a key only ever grow. */
+            void offer(const ngram_key key, const std::uint64_t estimate) {
+                  if (capacity == 0u || (heap.size() == capacity && estimate <= heap[0].second))
+                        return;
+                  const auto slot = find(key);
+                  if (index[slot] != empty) {
+                        const auto at = index[slot];
+                        heap[at].second = estimate;
+                        sift_down(at);
+                        return;
+                  }
+                  if (heap.size() < capacity) {
+                        index[slot] = static_cast<std::uint32_t>(heap.size());
+                        heap.emplace_back(key, estimate);
+                        sift_up(heap.size() - 1u);
+                        return;
+                  }
+                  /* Full: the lightest key makes room. */
+                  erase(find(heap[0].first));
+                  heap[0] = {key, estimate};
+                  index[find(key)] = 0u;
+                  sift_down(0u);
+            }
+
+            const std::vector<std::pair<ngram_key, std::uint64_t>> &items() const {
+                  return heap;
+            }
+
+          private:
+            static constexpr std::uint32_t empty = ~std::uint32_t{0u};
+
+            std::size_t capacity;
+            std::vector<std::uint32_t> index; /* Open addressing, linear probing, slots hold heap positions. */
+            std::vector<std::pair<ngram_key, std::uint64_t>> heap;
+
+            std::size_t home(const ngram_key key) const {
+                  return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> 32u) & (index.size() - 1u);
+            }
+
+            std::size_t find(const ngram_key key) const {
+                  auto slot = home(key);
+                  while (index[slot] != empty && heap[index[slot]].first != key)
+                        slot = (slot + 1u) & (index.size() - 1u);
+                  return slot;
+            }
+
+            /* Backward shift deletion keeps probe chains intact without tombstones. */
+            void erase(std::size_t slot) {
+                  index[slot] = empty;
+                  for (auto next = (slot + 1u) & (index.size() - 1u); index[next] != empty; next = (next + 1u) & (index.size() - 1u)) {
+                        const auto want = home(heap[index[next]].first);
+                        const auto between = (slot <= next) ? (slot < want && want <= next) : (slot < want || want <= next);
+                        if (between)
+                              continue;
+                        index[slot] = index[next];
+                        index[next] = empty;
+                        slot = next;
+                  }
+            }
+
+            /* Index slots are looked up before the move, find() matches through the heap. */
+            void swap(const std::size_t x, const std::size_t y) {
+                  const auto slot_x = find(heap[x].first);
+                  const auto slot_y = find(heap[y].first);
+                  std::swap(heap[x], heap[y]);
+                  index[slot_x] = static_cast<std::uint32_t>(y);
+                  index[slot_y] = static_cast<std::uint32_t>(x);
+            }
+
+            void sift_up(std::size_t at) {
+                  while (at != 0u && heap[(at - 1u) / 2u].second > heap[at].second) {
+                        swap(at, (at - 1u) / 2u);
+                        at = (at - 1u) / 2u;
+                  }
+            }
+
+            void sift_down(std::size_t at) {
+                  for (;;) {
+                        auto smallest = at;
+                        for (const auto child : {2u * at + 1u, 2u * at + 2u}) {
+                              if (child < heap.size() && heap[child].second < heap[smallest].second)
+                                    smallest = child;
+                        }
+                        if (smallest == at)
+                              return;
+                        swap(at, smallest);
+                        at = smallest;
+                  }
+            }
+      };
+
+      struct ngram_count {
+            ngram_key key;
+            std::uint64_t count;
+      };
+
+      /* Merged totals. */
+      struct report {
+            profile::options options;
+            std::uint64_t instructions = 0u;
+            std::uint64_t protos = 0u;
+            std::array<std::uint64_t, opcode_slots> opcode_counts{};
+            std::array<kind_stats, kind_count> kinds{};
+            std::vector<std::uint64_t> bigrams;  /* Exact mode, [first << 6 | second]. */
+            std::vector<std::uint64_t> trigrams; /* Exact mode, [first << 12 | second << 6 | third]. */
+            count_min sketch;                    /* Sketch mode. */
+            std::vector<ngram_key> candidates;   /* Sketch mode, union of every thread's heavy keys. */
+
+            /* Count of an n-gram, an upper bound in sketch mode. */
+            std::uint64_t count(const ngram_key key) const {
+                  const auto n = key_length(key);
+                  if (options.mode == mode::sketch)
+                        return sketch.estimate(key);
+                  const auto index = static_cast<std::size_t>(key & ((1ull << (n * op_bits)) - 1u));
+                  return (n == 2u) ? bigrams[index] : (n == 3u) ? trigrams[index] : 0u;
+            }
+
+            /* The `k` most frequent n-grams of length `n`, heaviest first. */
+            std::vector<ngram_count> top(const std::size_t n, const std::size_t k) const {
+                  std::vector<ngram_count> result;
+                  if (options.mode == mode::exact) {
+                        const auto &table = (n == 2u) ? bigrams : trigrams;
+                        if (n != 2u && n != 3u)
+                              return result;
+                        for (auto i = std::size_t{0u}; i < table.size(); ++i) {
+                              if (table[i] != 0u)
+                                    result.push_back({make_key(i, n), table[i]});
+                        }
+                  } else {
+                        for (const auto key : candidates) {
+                              if (key_length(key) == n)
+                                    result.push_back({key, sketch.estimate(key)});
+                        }
+                  }
+                  const auto keep = std::min(k, result.size());
+                  std::partial_sort(result.begin(), result.begin() + static_cast<std::ptrdiff_t>(keep), result.end(), [](const ngram_count &x, const ngram_count &y) { return x.count > y.count || (x.count == y.count && x.key < y.key); });
+                  result.resize(keep);
+                  return result;
+            }
+      };
+
+      /* One thread's counters, only ever touched by that thread until merge(). */
+      class shard {
+          public:
+            explicit shard(const profile::options &options) : options(options), candidates(options.mode == mode::sketch ? options.candidates : 0u) {
+                  if (options.mode == mode::exact) {
+                        bigrams.assign(opcode_slots * opcode_slots, 0u);
+                        trigrams.assign(opcode_slots * opcode_slots * opcode_slots, 0u);
+                  } else {
+                        sketch = count_min(options.sketch_width, options.sketch_depth);
+                  }
+            }
+
+            /* Straight from decoder output, `count` instructions of one proto (or the continuation of one when `resume`). */
+            void add(const decoder::soa_view &code, const std::size_t count, const bool resume = false) {
+                  if (!resume) {
+                        window = 0u;
+                        run = 0u;
+                  }
+                  instructions += count;
+                  const auto n_max = (options.mode == mode::exact) ? std::size_t{3u} : options.ngram_length;
+                  for (auto pc = std::size_t{0u}; pc < count; ++pc) {
+                        const auto op = code.op[pc];
+                        ++opcode_counts[op];
+                        window = (window << op_bits) | op;
+                        ++run;
+
+                        /* Indexed by operand_encoding. B and C lose the constant bit only where it means one, plain registers keep bit 8. */
+                        const auto &plan = plans.plans[op];
+                        const std::int64_t values[] = {code.a[pc], code.b[pc], code.bx[pc], code.ax[pc], code.c[pc], code.sbx[pc]};
+                        for (auto i = 0u; i < operand_max; ++i) {
+                              auto &stats = kinds[plan.kind[i]];
+                              const auto constant = (code.rk[pc] & plan.rk[i]) != 0u;
+                              const auto value = constant ? values[plan.encoding[i]] & ~std::int64_t{decoder::rk_bit} : values[plan.encoding[i]];
+                              ++stats.count;
+                              stats.constants += constant;
+                              stats.negative += value < 0;
+                              ++stats.buckets[bucket_of(value)];
+                        }
+
+                        if (options.mode == mode::exact) {
+                              if (run >= 2u)
+                                    ++bigrams[window & 0xFFFu];
+                              if (run >= 3u)
+                                    ++trigrams[window & 0x3FFFFu];
+                        } else {
+                              for (auto n = std::size_t{2u}; n <= n_max && n <= run; ++n) {
+                                    const auto key = make_key(window, n);
+                                    candidates.offer(key, sketch.add(key));
+                              }
+                        }
+
+                        if (options.block_local && plan.ends_run)
+                              run = 0u;
+                  }
+            }
+
+            /* Decodes in blocks, so memory stays flat however large the proto is. */
+            void add(const chunk::proto &p) {
+                  ++protos;
+                  for (auto base = std::size_t{0u}; base < p.code.size(); base += block_size) {
+                        const auto count = std::min(block_size, p.code.size() - base);
+                        if (scratch.size() < block_size)
+                              scratch.resize(block_size);
+                        decoder::decode(p.code.data() + base * 4u, count, scratch.view());
+                        add(scratch.view(), count, base != 0u);
+                  }
+            }
+
+            /* The proto and everything nested in it. */
+            void add_tree(const chunk::proto &p) {
+                  add(p);
+                  for (auto i = 0u; i < p.proto_count(); ++i)
+                        add_tree(p.child(i));
+            }
+
+          private:
+            friend class profiler;
+
+            static constexpr std::size_t block_size = 1024u;
+
+            profile::options options;
+            std::uint64_t instructions = 0u;
+            std::uint64_t protos = 0u;
+            std::array<std::uint64_t, opcode_slots> opcode_counts{};
+            std::array<kind_stats, kind_count + 1u> kinds{}; /* The extra one soaks up unused operand slots. */
+            std::vector<std::uint64_t> bigrams;
+            std::vector<std::uint64_t> trigrams;
+            count_min sketch;
+            candidate_set candidates;
+            std::uint64_t window = 0u;
+            std::size_t run = 0u;
+            decoder::decoded scratch;
+      };
+
+      /*
+            Hands every thread its own shard on first use, after that counting never synchronizes.
+            merge() must only run once no thread is adding any more.
+      */
+      class profiler {
+          public:
+            explicit profiler(const profile::options &options = {}) : options(normalize(options)), id(next_id().fetch_add(1u, std::memory_order_relaxed)) {}
+
+            profiler(const profiler &) = delete;
+            profiler &operator=(const profiler &) = delete;
+
+            /* Calling thread's shard, a thread switching between profilers takes the lock on every switch. */
+            shard &local() {
+                  auto &cache = thread_cache();
+                  if (cache.id == id)
+                        return *cache.owned;
+                  std::lock_guard<std::mutex> lock(shards_mutex);
+                  auto &owned = by_thread[std::this_thread::get_id()];
+                  if (owned == nullptr) {
+                        shards.push_back(std::make_unique<shard>(options));
+                        owned = shards.back().get();
+                  }
+                  cache = {id, owned};
+                  return *owned;
+            }
+
+            report merge() const {
+                  std::lock_guard<std::mutex> lock(shards_mutex);
+                  report result;
+                  result.options = options;
+                  if (options.mode == mode::exact) {
+                        result.bigrams.assign(opcode_slots * opcode_slots, 0u);
+                        result.trigrams.assign(opcode_slots * opcode_slots * opcode_slots, 0u);
+                  } else {
+                        result.sketch = count_min(options.sketch_width, options.sketch_depth);
+                  }
+                  for (const auto &s : shards) {
+                        result.instructions += s->instructions;
+                        result.protos += s->protos;
+                        for (auto i = 0u; i < opcode_slots; ++i)
+                              result.opcode_counts[i] += s->opcode_counts[i];
+                        for (auto k = 0u; k < kind_count; ++k) {
+                              auto &to = result.kinds[k];
+                              const auto &from = s->kinds[k];
+                              to.count += from.count;
+                              to.constants += from.constants;
+                              to.negative += from.negative;
+                              for (auto b = 0u; b < value_buckets; ++b)
+                                    to.buckets[b] += from.buckets[b];
+                        }
+                        if (options.mode == mode::exact) {
+                              for (auto i = std::size_t{0u}; i < result.bigrams.size(); ++i)
+                                    result.bigrams[i] += s->bigrams[i];
+                              for (auto i = std::size_t{0u}; i < result.trigrams.size(); ++i)
+                                    result.trigrams[i] += s->trigrams[i];
+                        } else {
+                              result.sketch.merge(s->sketch);
+                              for (const auto &item : s->candidates.items())
+                                    result.candidates.push_back(item.first);
+                        }
+                  }
+                  std::sort(result.candidates.begin(), result.candidates.end());
+                  result.candidates.erase(std::unique(result.candidates.begin(), result.candidates.end()), result.candidates.end());
+                  return result;
+            }
+
+            const profile::options &settings() const {
+                  return options;
+            }
+
+          private:
+            struct cached {
+                  std::uint64_t id = 0u;
+                  shard *owned = nullptr;
+            };
+
+            profile::options options;
+            std::uint64_t id;
+            mutable std::mutex shards_mutex;
+            std::vector<std::unique_ptr<shard>> shards;
+            std::unordered_map<std::thread::id, shard *> by_thread;
+
+            /* Ids are never reused, so the cache left behind by a destroyed profiler can never match. */
+            static std::atomic<std::uint64_t> &next_id() {
+                  static std::atomic<std::uint64_t> counter{1u};
+                  return counter;
+            }
+
+            /* Shard of the profiler this thread used last, one entry so nothing piles up across profilers. */
+            static cached &thread_cache() {
+                  static thread_local cached cache;
+                  return cache;
+            }
+
+            static profile::options normalize(profile::options options) {
+                  options.ngram_length = std::min(std::max(options.ngram_length, std::size_t{2u}), ngram_max);
+                  options.sketch_depth = std::min(std::max(options.sketch_depth, std::size_t{1u}), count_min::depth_max);
+                  options.sketch_width = std::max(options.sketch_width, std::size_t{64u});
+                  return options;
+            }
+      };
+
+} // namespace profile
@@ -0,0 +1,1020 @@
+#pragma once
+
+#include "bits.hpp"
+#include "chunk.hpp"
+#include "cfg.hpp"
+#include "dataflow.hpp"
+#include "decoder.hpp"
+#include "header.hpp"
+#include "mapped_file.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+      Inverted index over a corpus of chunks: term -> postings of (file, proto, pc).
+
+      Terms are 64 bit, the kind in the top 4 bits:
+            ngram     opcode n-grams of 1 to ngram_max instructions, never crossing a basic block leader
+            constant  constants read through k_idx / RK operands and OP_LOADKX, keyed by type and value
+            load      the subset of those loaded into a register by OP_LOADK / OP_LOADKX
+            global    _ENV fields read or written by OP_GETTABUP / OP_SETTABUP with a constant string key
+            call      OP_CALL whose function register was last loaded from that global in the same block
+
+      An index is a directory of immutable segments plus a MANIFEST listing them, oldest first.
+      Adding chunks writes a new segment, a path indexed again shadows its earlier postings, in older segments or the same one.
+      Commits merge the newest segments once enough of one size tier pile up, merge() rewrites all live postings into one segment.
+
+      Segment layout, little endian, offsets from the start of the file:
+            header      64 bytes  "LIDX", version, file count, term count, section offsets
+            files       u64 offsets[file count + 1] into the path bytes that follow
+            dictionary  24 bytes per term, sorted: term, postings offset, posting count, postings bytes
+            postings    LEB128 per posting: pc delta << 1 while file and proto repeat, otherwise
+                        file delta << 1 | 1, then proto (absolute when the file moved), then pc
+*/
+namespace search {
+
+      struct index_error : std::runtime_error {
+            using std::runtime_error::runtime_error;
+      };
+
+      /* Terms */
+
+      using term = std::uint64_t;
+
+      enum class term_kind : std::uint8_t {
+            ngram = 1u,
+            constant = 2u,
+            global = 3u,
+            call = 4u,
+            load = 5u
+      };
+
+      constexpr std::size_t ngram_max = 3u;
+      constexpr std::uint64_t payload_mask = (1ull << 60u) - 1u;
+
+      constexpr term make_term(const term_kind kind, const std::uint64_t payload) {
+            return (static_cast<std::uint64_t>(kind) << 60u) | (payload & payload_mask);
+      }
+
+      constexpr term_kind kind_of(const term t) {
+            return static_cast<term_kind>(t >> 60u);
+      }
+
+      /* Exact, 6 bits per opcode with the length above them. */
+      constexpr term ngram_term(const std::uint8_t *const ops, const std::size_t length) {
+            std::uint64_t payload = length;
+            for (auto i = std::size_t{0u}; i < length; ++i)
+                  payload = (payload << op_bits) | ops[i];
+            return make_term(term_kind::ngram, payload);
+      }
+
+      inline term ngram_term(const std::initializer_list<opcodes> ops) {
+            std::uint8_t raw[ngram_max]{};
+            auto length = std::size_t{0u};
+            for (const auto op : ops) {
+                  if (length == ngram_max)
+                        throw index_error("n-gram longer than ngram_max");
+                  raw[length++] = static_cast<std::uint8_t>(op);
+            }
+            return ngram_term(raw, length);
+      }
+
+      namespace detail {
+
+            /* FNV-1a 64 over a type tag then the value bytes. */
+            inline std::uint64_t hash(const char tag, const void *const data, const std::size_t size) {
+                  auto seed = (14695981039346656037ull ^ static_cast<std::uint8_t>(tag)) * 1099511628211ull;
+                  const auto bytes = static_cast<const std::uint8_t *>(data);
+                  for (auto i = std::size_t{0u}; i < size; ++i)
+                        seed = (seed ^ bytes[i]) * 1099511628211ull;
+                  return seed;
+            }
+
+            inline std::uint64_t string_payload(const std::string_view s) {
+                  return hash('s', s.data(), s.size());
+            }
+
+            inline std::uint64_t constant_payload(const chunk::constant &k) {
+                  switch (k.type) {
+                        case chunk::constant_type::boolean: {
+                              const std::uint8_t value = k.boolean ? 1u : 0u;
+                              return hash('b', &value, 1u);
+                        }
+                        case chunk::constant_type::integer:
+                              return hash('i', &k.integer, sizeof(k.integer));
+                        case chunk::constant_type::number:
+                              return hash('n', &k.number, sizeof(k.number));
+                        case chunk::constant_type::short_string:
+                        case chunk::constant_type::long_string:
+                              return string_payload(k.string);
+                        default:
+                              return hash('z', nullptr, 0u);
+                  }
+            }
+
+      } // namespace detail
+
+      inline term string_term(const std::string_view s) {
+            return make_term(term_kind::constant, detail::string_payload(s));
+      }
+
+      inline term integer_term(const std::int64_t value) {
+            return make_term(term_kind::constant, detail::hash('i', &value, sizeof(value)));
+      }
+
+      inline term number_term(const double value) {
+            return make_term(term_kind::constant, detail::hash('n', &value, sizeof(value)));
+      }
+
+      inline term constant_term(const chunk::constant &k) {
+            return make_term(term_kind::constant, detail::constant_payload(k));
+      }
+
+      /* Loads of the constant behind a constant term. */
+      constexpr term load_term(const term constant) {
+            return make_term(term_kind::load, constant);
+      }
+
+      inline term global_term(const std::string_view name) {
+            return make_term(term_kind::global, detail::string_payload(name));
+      }
+
+      inline term call_term(const std::string_view name) {
+            return make_term(term_kind::call, detail::string_payload(name));
+      }
+
+      /* Extraction */
+
+      /* Reused between protos so extraction does not allocate in steady state. */
+      struct extract_scratch {
+            decoder::decoded code;
+            std::vector<std::uint64_t> constants; /* Payload per constant index. */
+            std::vector<std::uint8_t> strings;    /* 1 when the constant is a string. */
+            std::vector<std::uint64_t> leaders;
+      };
+
+      /*
+            Calls sink(term, pc) for every term of `p` (not its children), a term can repeat at one pc.
+            Hashed terms (constant, global, call) can collide in principle, 60 bits keep it out of reach in practice.
+      */
+      template <typename Sink>
+      void extract(const chunk::proto &p, extract_scratch &scratch, Sink &&sink) {
+            auto &code = scratch.code;
+            p.code.decode(code);
+            const auto count = static_cast<std::uint32_t>(code.size());
+
+            const auto constant_count = p.constants.size();
+            scratch.constants.resize(constant_count);
+            scratch.strings.resize(constant_count);
+            for (auto i = std::size_t{0u}; i < constant_count; ++i) {
+                  const auto k = p.constants[i];
+                  scratch.constants[i] = detail::constant_payload(k);
+                  scratch.strings[i] = k.is_string() ? 1u : 0u;
+            }
+            const auto constant = [&](const std::uint32_t index, const std::uint32_t pc, const bool load) {
+                  if (index >= constant_count)
+                        return;
+                  sink(make_term(term_kind::constant, scratch.constants[index]), pc);
+                  if (load)
+                        sink(make_term(term_kind::load, scratch.constants[index]), pc);
+            };
+            /* Upvalue `index` is _ENV, or there is no debug info to tell. */
+            const auto environment = [&](const std::uint32_t index) {
+                  return index >= p.upvalue_names.size() || p.upvalue_names[index] == "_ENV";
+            };
+
+            /* Leaders, so n-grams and register tracking stay inside one block. */
+            scratch.leaders.assign((count + 64u) / 64u, 0u);
+            const auto mark = [&](const std::int64_t pc) {
+                  if (pc >= 0 && pc < count)
+                        scratch.leaders[static_cast<std::size_t>(pc) >> 6u] |= 1ull << (pc & 63);
+            };
+            for (auto pc = 0u; pc < count; ++pc) {
+                  const auto op = static_cast<opcodes>(code.op[pc]);
+                  if (!opcode_valid(op))
+                        continue;
+                  switch (cfg::flow_of(op)) {
+                        case cfg::flow::jump:
+                        case cfg::flow::loop:
+                              mark(static_cast<std::int64_t>(pc) + 1 + code.sbx[pc]);
+                              mark(pc + 1);
+                              break;
+                        case cfg::flow::skip:
+                        case cfg::flow::skip_if_c:
+                              mark(pc + 1);
+                              mark(pc + 2);
+                              break;
+                        case cfg::flow::exit:
+                              mark(pc + 1);
+                              break;
+                        default:
+                              break;
+                  }
+            }
+
+            const auto frame = (p.max_stack_size != 0u) ? p.max_stack_size : dataflow::register_max;
+            std::uint16_t loaded[dataflow::register_max]; /* Register -> string constant index + 1 of the global it holds. */
+            std::uint8_t window[ngram_max];
+            auto run = std::size_t{0u};
+            dataflow::access access;
+
+            for (auto pc = 0u; pc < count; ++pc) {
+                  if (scratch.leaders[pc >> 6u] & (1ull << (pc & 63u))) {
+                        run = 0u;
+                        std::memset(loaded, 0, sizeof(loaded));
+                  }
+                  const auto raw = code.op[pc];
+                  const auto op = static_cast<opcodes>(raw);
+                  if (!opcode_valid(op)) {
+                        run = 0u;
+                        std::memset(loaded, 0, sizeof(loaded));
+                        continue;
+                  }
+                  const auto a = code.a[pc];
+                  const auto b = code.b[pc];
+                  const auto c = code.c[pc];
+                  const auto rk = code.rk[pc];
+
+                  /* N-grams ending here, the window keeps the last ngram_max opcodes. */
+                  std::memmove(window, window + 1, ngram_max - 1u);
+                  window[ngram_max - 1u] = raw;
+                  run = std::min(run + 1u, ngram_max);
+                  for (auto n = std::size_t{1u}; n <= run; ++n)
+                        sink(ngram_term(window + ngram_max - n, n), pc);
+
+                  /* Constants */
+                  if (rk & decoder::rk_b)
+                        constant(b & ~decoder::rk_bit, pc, false);
+                  if (rk & decoder::rk_c)
+                        constant(c & ~decoder::rk_bit, pc, false);
+                  if (op == opcodes::OP_LOADK)
+                        constant(code.bx[pc], pc, true);
+                  else if (op == opcodes::OP_LOADKX && pc + 1u < count && static_cast<opcodes>(code.op[pc + 1u]) == opcodes::OP_EXTRAARG)
+                        constant(code.ax[pc + 1u], pc, true);
+
+                  /* Globals */
+                  auto global = 0u;
+                  if (op == opcodes::OP_GETTABUP && (rk & decoder::rk_c) && environment(b)) {
+                        const auto key = c & ~decoder::rk_bit;
+                        if (key < constant_count && scratch.strings[key]) {
+                              sink(make_term(term_kind::global, scratch.constants[key]), pc);
+                              global = key + 1u;
+                        }
+                  } else if (op == opcodes::OP_SETTABUP && (rk & decoder::rk_b) && environment(a)) {
+                        const auto key = b & ~decoder::rk_bit;
+                        if (key < constant_count && scratch.strings[key])
+                              sink(make_term(term_kind::global, scratch.constants[key]), pc);
+                  } else if (op == opcodes::OP_CALL || op == opcodes::OP_TAILCALL) {
+                        if (a < dataflow::register_max && loaded[a] != 0u)
+                              sink(make_term(term_kind::call, scratch.constants[loaded[a] - 1u]), pc);
+                  }
+
+                  /* Forget every register this instruction writes, open result counts clobber the rest of the frame. */
+                  dataflow::effect(raw, a, b, c, rk, frame, access);
+                  for (auto w = 0u; w < 4u; ++w) {
+                        for (auto set = access.def.words[w]; set != 0u; set &= set - 1u)
+                              loaded[w * 64u + bits::countr_zero(set)] = 0u;
+                  }
+                  if ((op == opcodes::OP_CALL || op == opcodes::OP_VARARG || op == opcodes::OP_TFORCALL) && a < dataflow::register_max)
+                        std::memset(loaded + a, 0, (dataflow::register_max - a) * sizeof(loaded[0]));
+                  /* Writes that only happen on one edge are no kill for liveness, but the register may still change. */
+                  if (op == opcodes::OP_TESTSET && a < dataflow::register_max)
+                        loaded[a] = 0u;
+                  if (op == opcodes::OP_FORLOOP && a + 3u < dataflow::register_max)
+                        loaded[a + 3u] = 0u;
+                  if (global != 0u && a < dataflow::register_max)
+                        loaded[a] = static_cast<std::uint16_t>(global);
+
+                  /* The OP_EXTRAARG of OP_LOADKX is data, not an instruction. */
+                  if (op == opcodes::OP_LOADKX && pc + 1u < count && static_cast<opcodes>(code.op[pc + 1u]) == opcodes::OP_EXTRAARG) {
+                        ++pc;
+                        run = 0u;
+                  }
+            }
+      }
+
+      /* Segments */
+
+      constexpr char magic[] = "LIDX";
+      constexpr std::uint16_t version = 1u;
+      constexpr std::size_t header_size = 64u;
+      constexpr std::size_t dictionary_record_size = 24u;
+
+      struct posting {
+            std::uint32_t file;
+            std::uint32_t proto; /* Preorder index, 0 is the main function. */
+            std::uint32_t pc;
+
+            friend bool operator==(const posting &l, const posting &r) {
+                  return l.file == r.file && l.proto == r.proto && l.pc == r.pc;
+            }
+      };
+
+      namespace detail {
+
+            template <typename T>
+            inline T load(const std::uint8_t *const bytes) {
+                  T value;
+                  std::memcpy(&value, bytes, sizeof(T));
+                  return value;
+            }
+
+            template <typename T>
+            inline void store(std::uint8_t *const bytes, const T value) {
+                  std::memcpy(bytes, &value, sizeof(T));
+            }
+
+            template <typename T>
+            inline void append(std::vector<std::uint8_t> &out, const T value) {
+                  const auto at = out.size();
+                  out.resize(at + sizeof(T));
+                  store(out.data() + at, value);
+            }
+
+            inline void varint(std::vector<std::uint8_t> &out, std::uint64_t value) {
+                  while (value >= 0x80u) {
+                        out.push_back(static_cast<std::uint8_t>(value | 0x80u));
+                        value >>= 7u;
+                  }
+                  out.push_back(static_cast<std::uint8_t>(value));
+            }
+
+            inline std::uint64_t varint(const std::uint8_t *&at, const std::uint8_t *const end) {
+                  std::uint64_t value = 0u;
+                  for (auto shift = 0u; shift < 64u; shift += 7u) {
+                        if (at == end)
+                              throw index_error("truncated postings");
+                        const auto byte = *at++;
+                        value |= static_cast<std::uint64_t>(byte & 0x7fu) << shift;
+                        if ((byte & 0x80u) == 0u)
+                              return value;
+                  }
+                  throw index_error("overlong varint in postings");
+            }
+
+            inline void write_file(const std::string &path, const void *const data, const std::size_t size) {
+                  const auto temporary = path + ".tmp";
+                  {
+                        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+                        out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+                        if (!out.flush())
+                              throw index_error("cannot write " + temporary);
+                  }
+                  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+                        throw index_error("cannot rename " + temporary);
+            }
+
+            /* Builds a segment from terms in ascending order, each with its postings in (file, proto, pc) order. */
+            class segment_encoder {
+                public:
+                  void begin(const term t) {
+                        key = t;
+                        start = postings.size();
+                        previous = posting{0u, 0u, 0u};
+                        count = 0u;
+                  }
+
+                  /* Runs inside one function, the common case, take a byte per posting. */
+                  void add(const posting &current) {
+                        if (count != 0u && current.file == previous.file && current.proto == previous.proto) {
+                              varint(postings, static_cast<std::uint64_t>(current.pc - previous.pc) << 1u);
+                        } else {
+                              const auto file_delta = current.file - previous.file;
+                              varint(postings, (static_cast<std::uint64_t>(file_delta) << 1u) | 1u);
+                              varint(postings, (file_delta != 0u) ? current.proto : current.proto - previous.proto);
+                              varint(postings, current.pc);
+                        }
+                        previous = current;
+                        ++count;
+                  }
+
+                  /* A term left without postings gets no dictionary record. */
+                  void end() {
+                        if (count == 0u)
+                              return;
+                        append(dictionary, key);
+                        append(dictionary, static_cast<std::uint64_t>(start));
+                        append(dictionary, static_cast<std::uint32_t>(count));
+                        append(dictionary, static_cast<std::uint32_t>(postings.size() - start));
+                        ++term_count;
+                        total += count;
+                  }
+
+                  std::vector<std::uint8_t> finish(const std::vector<std::string> &paths) const {
+                        std::vector<std::uint8_t> files;
+                        std::uint64_t offset = 0u;
+                        for (const auto &path : paths) {
+                              append(files, offset);
+                              offset += path.size();
+                        }
+                        append(files, offset);
+                        for (const auto &path : paths)
+                              files.insert(files.end(), path.begin(), path.end());
+
+                        std::vector<std::uint8_t> out;
+                        out.reserve(header_size + files.size() + dictionary.size() + postings.size());
+                        out.resize(header_size);
+                        std::memcpy(out.data(), magic, 4u);
+                        store(out.data() + 4u, version);
+                        store(out.data() + 6u, static_cast<std::uint16_t>(header_size));
+                        store(out.data() + 8u, static_cast<std::uint32_t>(paths.size()));
+                        store(out.data() + 16u, term_count);
+                        store(out.data() + 24u, static_cast<std::uint64_t>(header_size));
+                        store(out.data() + 32u, static_cast<std::uint64_t>(header_size + files.size()));
+                        store(out.data() + 40u, static_cast<std::uint64_t>(header_size + files.size() + dictionary.size()));
+                        store(out.data() + 48u, static_cast<std::uint64_t>(postings.size()));
+                        store(out.data() + 56u, total);
+                        out.insert(out.end(), files.begin(), files.end());
+                        out.insert(out.end(), dictionary.begin(), dictionary.end());
+                        out.insert(out.end(), postings.begin(), postings.end());
+                        return out;
+                  }
+
+                private:
+                  std::vector<std::uint8_t> dictionary;
+                  std::vector<std::uint8_t> postings;
+                  term key = 0u;
+                  std::size_t start = 0u;
+                  posting previous{0u, 0u, 0u};
+                  std::uint32_t count = 0u;
+                  std::uint64_t term_count = 0u;
+                  std::uint64_t total = 0u;
+            };
+
+      } // namespace detail
+
+      /* Collects postings in memory, serialize() sorts them into one segment. */
+      class segment_builder {
+          public:
+            /* Walks every proto of `file` in preorder, returns the file id inside this segment. */
+            std::uint32_t add(const std::string &path, const chunk::file &file) {
+                  const auto id = static_cast<std::uint32_t>(paths.size());
+                  paths.push_back(path);
+                  auto proto = 0u;
+                  walk(file.main(), id, proto);
+                  return id;
+            }
+
+            std::size_t file_count() const {
+                  return paths.size();
+            }
+
+            /* Before duplicates are dropped. */
+            std::size_t posting_count() const {
+                  return entries.size();
+            }
+
+            bool empty() const {
+                  return paths.empty();
+            }
+
+            void clear() {
+                  paths.clear();
+                  entries.clear();
+            }
+
+            std::vector<std::uint8_t> serialize() {
+                  std::sort(entries.begin(), entries.end(), [](const entry &l, const entry &r) {
+                        if (l.key != r.key)
+                              return l.key < r.key;
+                        if (l.file != r.file)
+                              return l.file < r.file;
+                        if (l.proto != r.proto)
+                              return l.proto < r.proto;
+                        return l.pc < r.pc;
+                  });
+                  entries.erase(std::unique(entries.begin(), entries.end(), [](const entry &l, const entry &r) {
+                        return l.key == r.key && l.file == r.file && l.proto == r.proto && l.pc == r.pc;
+                  }), entries.end());
+
+                  detail::segment_encoder encoder;
+                  for (auto i = std::size_t{0u}; i < entries.size();) {
+                        const auto t = entries[i].key;
+                        encoder.begin(t);
+                        for (; i < entries.size() && entries[i].key == t; ++i)
+                              encoder.add(posting{entries[i].file, entries[i].proto, entries[i].pc});
+                        encoder.end();
+                  }
+                  return encoder.finish(paths);
+            }
+
+          private:
+            struct entry {
+                  term key;
+                  std::uint32_t file;
+                  std::uint32_t proto;
+                  std::uint32_t pc;
+            };
+
+            std::vector<std::string> paths;
+            std::vector<entry> entries;
+            extract_scratch scratch;
+
+            void walk(const chunk::proto &p, const std::uint32_t file, std::uint32_t &proto) {
+                  const auto id = proto++;
+                  extract(p, scratch, [&](const term t, const std::uint32_t pc) {
+                        entries.push_back(entry{t, file, id, pc});
+                  });
+                  for (auto i = std::size_t{0u}; i < p.proto_count(); ++i)
+                        walk(p.child(i), file, proto);
+            }
+      };
+
+      /* One mapped segment, lookups binary search the dictionary in place. */
+      class segment {
+          public:
+            /* Postings of one term, decoded on the fly. */
+            class cursor {
+                public:
+                  cursor() = default;
+                  cursor(const std::uint8_t *const begin, const std::uint8_t *const end, const std::uint32_t count) : at(begin), end(end), remaining(count) {}
+
+                  std::uint32_t size() const {
+                        return remaining;
+                  }
+
+                  bool next(posting &out) {
+                        if (remaining == 0u)
+                              return false;
+                        --remaining;
+                        const auto head = detail::varint(at, end);
+                        if ((head & 1u) == 0u) {
+                              current.pc += static_cast<std::uint32_t>(head >> 1u);
+                        } else {
+                              const auto file_delta = static_cast<std::uint32_t>(head >> 1u);
+                              const auto proto = static_cast<std::uint32_t>(detail::varint(at, end));
+                              current.file += file_delta;
+                              current.proto = (file_delta != 0u) ? proto : current.proto + proto;
+                              current.pc = static_cast<std::uint32_t>(detail::varint(at, end));
+                        }
+                        out = current;
+                        return true;
+                  }
+
+                private:
+                  const std::uint8_t *at = nullptr;
+                  const std::uint8_t *end = nullptr;
+                  std::uint32_t remaining = 0u;
+                  posting current{0u, 0u, 0u};
+            };
+
+            static std::unique_ptr<segment> open(const std::string &path) {
+                  auto result = std::unique_ptr<segment>(new segment());
+                  result->mapping = io::mapped_file(path);
+                  result->load(result->mapping.data(), result->mapping.size());
+                  return result;
+            }
+
+            /* Segment already in memory, `bytes` must outlive the segment. */
+            static std::unique_ptr<segment> view(const void *const bytes, const std::size_t size) {
+                  auto result = std::unique_ptr<segment>(new segment());
+                  result->load(static_cast<const std::uint8_t *>(bytes), size);
+                  return result;
+            }
+
+            cursor find(const term t) const {
+                  auto low = std::uint64_t{0u};
+                  auto high = term_count;
+                  while (low < high) {
+                        const auto middle = low + (high - low) / 2u;
+                        if (term_at(middle) < t)
+                              low = middle + 1u;
+                        else
+                              high = middle;
+                  }
+                  if (low == term_count || term_at(low) != t)
+                        return {};
+                  return postings_at(low);
+            }
+
+            /* Dictionary order, i < terms(). */
+            term term_at(const std::uint64_t i) const {
+                  return detail::load<term>(dictionary + i * dictionary_record_size);
+            }
+
+            cursor postings_at(const std::uint64_t i) const {
+                  const auto record = dictionary + i * dictionary_record_size;
+                  const auto offset = detail::load<std::uint64_t>(record + 8u);
+                  const auto count = detail::load<std::uint32_t>(record + 16u);
+                  const auto bytes = detail::load<std::uint32_t>(record + 20u);
+                  if (offset > postings_size || bytes > postings_size - offset)
+                        throw index_error("postings out of range");
+                  /* At least a byte per posting, so callers can size buffers by the count. */
+                  if (count > bytes)
+                        throw index_error("posting count exceeds its bytes");
+                  return cursor(postings + offset, postings + offset + bytes, count);
+            }
+
+            std::uint32_t file_count() const {
+                  return files;
+            }
+
+            std::string_view path(const std::uint32_t file) const {
+                  const auto begin = detail::load<std::uint64_t>(file_offsets + file * 8u);
+                  const auto end = detail::load<std::uint64_t>(file_offsets + file * 8u + 8u);
+                  return {reinterpret_cast<const char *>(path_bytes + begin), static_cast<std::size_t>(end - begin)};
+            }
+
+            std::uint64_t terms() const {
+                  return term_count;
+            }
+
+            std::uint64_t postings_count() const {
+                  return posting_total;
+            }
+
+          private:
+            io::mapped_file mapping;
+            const std::uint8_t *dictionary = nullptr;
+            const std::uint8_t *postings = nullptr;
+            const std::uint8_t *file_offsets = nullptr;
+            const std::uint8_t *path_bytes = nullptr;
+            std::uint64_t term_count = 0u;
+            std::uint64_t postings_size = 0u;
+            std::uint64_t posting_total = 0u;
+            std::uint32_t files = 0u;
+
+            segment() = default;
+
+            void load(const std::uint8_t *const bytes, const std::size_t size) {
+                  if (size < header_size || std::memcmp(bytes, magic, 4u) != 0)
+                        throw index_error("not an index segment");
+                  if (detail::load<std::uint16_t>(bytes + 4u) != version)
+                        throw index_error("unsupported index segment version");
+                  files = detail::load<std::uint32_t>(bytes + 8u);
+                  term_count = detail::load<std::uint64_t>(bytes + 16u);
+                  const auto files_offset = detail::load<std::uint64_t>(bytes + 24u);
+                  const auto dictionary_offset = detail::load<std::uint64_t>(bytes + 32u);
+                  const auto postings_offset = detail::load<std::uint64_t>(bytes + 40u);
+                  postings_size = detail::load<std::uint64_t>(bytes + 48u);
+                  posting_total = detail::load<std::uint64_t>(bytes + 56u);
+
+                  const auto table = (static_cast<std::uint64_t>(files) + 1u) * 8u;
+                  if (files_offset < header_size || files_offset > size || table > size - files_offset)
+                        throw index_error("file table out of range");
+                  file_offsets = bytes + files_offset;
+                  path_bytes = file_offsets + table;
+                  const auto path_total = detail::load<std::uint64_t>(file_offsets + files * 8ull);
+                  if (path_total > size - files_offset - table || files_offset + table + path_total > dictionary_offset)
+                        throw index_error("paths out of range");
+                  for (auto i = 0u; i < files; ++i) {
+                        if (detail::load<std::uint64_t>(file_offsets + i * 8u) > detail::load<std::uint64_t>(file_offsets + i * 8u + 8u))
+                              throw index_error("file table not ascending");
+                  }
+                  if (dictionary_offset > size || term_count > (size - dictionary_offset) / dictionary_record_size || dictionary_offset + term_count * dictionary_record_size > postings_offset)
+                        throw index_error("dictionary out of range");
+                  if (postings_offset > size || postings_size > size - postings_offset)
+                        throw index_error("postings out of range");
+                  dictionary = bytes + dictionary_offset;
+                  postings = bytes + postings_offset;
+            }
+      };
+
+      /* Index directories */
+
+      namespace detail {
+
+            /* Per segment and file, 0 when a later add has the path: the last add wins, in a newer segment or again in the same one. */
+            inline std::vector<std::vector<std::uint8_t>> live_files(const std::vector<std::unique_ptr<segment>> &segments) {
+                  std::unordered_map<std::string_view, std::pair<std::uint32_t, std::uint32_t>> newest;
+                  for (auto s = 0u; s < segments.size(); ++s) {
+                        for (auto f = 0u; f < segments[s]->file_count(); ++f)
+                              newest[segments[s]->path(f)] = {s, f};
+                  }
+                  std::vector<std::vector<std::uint8_t>> live(segments.size());
+                  for (auto s = 0u; s < segments.size(); ++s) {
+                        live[s].resize(segments[s]->file_count());
+                        for (auto f = 0u; f < segments[s]->file_count(); ++f)
+                              live[s][f] = (newest[segments[s]->path(f)] == std::make_pair(s, f)) ? 1u : 0u;
+                  }
+                  return live;
+            }
+
+            /* "seg_" eight digits ".lidx", anything else in a MANIFEST is corrupt. */
+            inline std::size_t segment_number(const std::string &name) {
+                  auto number = std::size_t{0u};
+                  auto valid = name.size() == 17u && name.compare(0u, 4u, "seg_") == 0 && name.compare(12u, 5u, ".lidx") == 0;
+                  for (auto i = 4u; valid && i < 12u; ++i) {
+                        valid = name[i] >= '0' && name[i] <= '9';
+                        number = number * 10u + static_cast<std::size_t>(name[i] - '0');
+                  }
+                  if (!valid)
+                        throw index_error("bad segment name in MANIFEST: " + name);
+                  return number;
+            }
+
+      } // namespace detail
+
+      /*
+            Appends segments to an index directory, nothing is visible to readers before commit().
+            Segments replaced by a merge are deleted once the MANIFEST no longer lists them, readers already open keep their mappings on POSIX.
+      */
+      class writer {
+          public:
+            /* Segments below this size share the lowest merge tier. */
+            static constexpr std::uintmax_t tier_base = 1u << 20u;
+
+            /*
+                  Flushes a segment once this many postings are buffered, so memory stays bounded on big corpora.
+                  commit() merges the newest `merge_factor` segments whenever they share a size tier (0 never merges).
+            */
+            explicit writer(const std::string &directory, const std::size_t flush_postings = 1u << 22u, const std::size_t merge_factor = 8u)
+                : root(directory), threshold(flush_postings), factor(merge_factor) {
+                  std::filesystem::create_directories(root);
+                  segments = read_manifest(root);
+                  for (const auto &name : segments)
+                        next = std::max(next, detail::segment_number(name) + 1u);
+            }
+
+            void add(const std::string &path) {
+                  const auto file = chunk::file::open(path, chunk::load_mode::lazy);
+                  add(path, *file);
+            }
+
+            /* `path` is only the name postings are filed under, re-adding it shadows the earlier add. */
+            void add(const std::string &path, const chunk::file &file) {
+                  pending.add(path, file);
+                  if (pending.posting_count() >= threshold)
+                        flush();
+            }
+
+            /* Writes buffered postings and publishes every segment written since the last commit. */
+            void commit() {
+                  flush();
+                  /* Each merge lands one tier up at most, so it can complete a run of the next tier. */
+                  while (factor > 1u && segments.size() >= factor) {
+                        const auto first = segments.size() - factor;
+                        const auto level = tier(segments[first]);
+                        auto same = true;
+                        for (auto i = first + 1u; same && i < segments.size(); ++i)
+                              same = tier(segments[i]) == level;
+                        if (!same)
+                              break;
+                        merge(first, segments.size());
+                  }
+                  publish();
+            }
+
+            /* Commits with every live posting rewritten into one segment, shadowed files and duplicate dictionary records are gone. */
+            void merge() {
+                  flush();
+                  if (!segments.empty())
+                        merge(0u, segments.size());
+                  publish();
+            }
+
+            std::size_t segment_count() const {
+                  return segments.size();
+            }
+
+            static std::vector<std::string> read_manifest(const std::string &directory) {
+                  std::vector<std::string> names;
+                  std::ifstream in(directory + "/MANIFEST");
+                  for (std::string line; std::getline(in, line);) {
+                        if (line.empty())
+                              continue;
+                        detail::segment_number(line);
+                        names.push_back(line);
+                  }
+                  return names;
+            }
+
+          private:
+            std::string root;
+            std::size_t threshold;
+            std::size_t factor;
+            std::size_t next = 0u;
+            std::vector<std::string> segments;
+            std::vector<std::string> obsolete; /* Merged away, deleted after the next publish(). */
+            segment_builder pending;
+
+            std::size_t tier(const std::string &name) const {
+                  auto level = std::size_t{0u};
+                  for (auto size = std::filesystem::file_size(root + "/" + name) / tier_base; size >= factor; size /= factor)
+                        ++level;
+                  return level;
+            }
+
+            std::string make_name() {
+                  char name[32];
+                  std::snprintf(name, sizeof(name), "seg_%08zu.lidx", next++);
+                  return name;
+            }
+
+            /*
+                  Replaces segments [first, last) by one, shadowing inside the range drops files for good.
+                  Files get new ids in (segment, file) order, so each term's postings stay sorted by concatenating the segments.
+            */
+            void merge(const std::size_t first, const std::size_t last) {
+                  std::vector<std::unique_ptr<segment>> inputs;
+                  for (auto i = first; i < last; ++i)
+                        inputs.push_back(segment::open(root + "/" + segments[i]));
+                  const auto live = detail::live_files(inputs);
+
+                  std::vector<std::string> paths;
+                  std::vector<std::vector<std::uint32_t>> ids(inputs.size());
+                  for (auto s = std::size_t{0u}; s < inputs.size(); ++s) {
+                        ids[s].resize(inputs[s]->file_count());
+                        for (auto f = 0u; f < inputs[s]->file_count(); ++f) {
+                              if (!live[s][f])
+                                    continue;
+                              ids[s][f] = static_cast<std::uint32_t>(paths.size());
+                              paths.emplace_back(inputs[s]->path(f));
+                        }
+                  }
+
+                  /* K-way merge of the dictionaries, the smallest head term goes next. */
+                  detail::segment_encoder encoder;
+                  std::vector<std::uint64_t> heads(inputs.size(), 0u);
+                  for (;;) {
+                        auto has_term = false;
+                        term t = 0u;
+                        for (auto s = std::size_t{0u}; s < inputs.size(); ++s) {
+                              if (heads[s] < inputs[s]->terms() && (!has_term || inputs[s]->term_at(heads[s]) < t)) {
+                                    t = inputs[s]->term_at(heads[s]);
+                                    has_term = true;
+                              }
+                        }
+                        if (!has_term)
+                              break;
+                        encoder.begin(t);
+                        for (auto s = std::size_t{0u}; s < inputs.size(); ++s) {
+                              if (heads[s] == inputs[s]->terms() || inputs[s]->term_at(heads[s]) != t)
+                                    continue;
+                              auto postings = inputs[s]->postings_at(heads[s]++);
+                              for (posting p; postings.next(p);) {
+                                    if (p.file >= live[s].size())
+                                          throw index_error("posting names a file outside its segment");
+                                    if (live[s][p.file])
+                                          encoder.add(posting{ids[s][p.file], p.proto, p.pc});
+                              }
+                        }
+                        encoder.end();
+                  }
+                  inputs.clear();
+
+                  const auto name = make_name();
+                  const auto bytes = encoder.finish(paths);
+                  detail::write_file(root + "/" + name, bytes.data(), bytes.size());
+                  obsolete.insert(obsolete.end(), segments.begin() + static_cast<std::ptrdiff_t>(first), segments.begin() + static_cast<std::ptrdiff_t>(last));
+                  segments.erase(segments.begin() + static_cast<std::ptrdiff_t>(first), segments.begin() + static_cast<std::ptrdiff_t>(last));
+                  segments.insert(segments.begin() + static_cast<std::ptrdiff_t>(first), name);
+            }
+
+            void publish() {
+                  std::string manifest;
+                  for (const auto &name : segments)
+                        manifest += name + "\n";
+                  detail::write_file(root + "/MANIFEST", manifest.data(), manifest.size());
+                  for (const auto &name : obsolete) {
+                        std::error_code ignored;
+                        std::filesystem::remove(root + "/" + name, ignored);
+                  }
+                  obsolete.clear();
+            }
+
+            void flush() {
+                  if (pending.empty())
+                        return;
+                  const auto name = make_name();
+                  const auto bytes = pending.serialize();
+                  detail::write_file(root + "/" + name, bytes.data(), bytes.size());
+                  segments.push_back(name);
+                  pending.clear();
+            }
+      };
+
+      /* Queries */
+
+      struct hit {
+            std::uint32_t segment;
+            std::uint32_t file;
+            std::uint32_t proto;
+            std::uint32_t pc;
+
+            /* Same function, pc aside. */
+            bool same_function(const hit &other) const {
+                  return segment == other.segment && file == other.file && proto == other.proto;
+            }
+
+            friend bool operator<(const hit &l, const hit &r) {
+                  if (l.segment != r.segment)
+                        return l.segment < r.segment;
+                  if (l.file != r.file)
+                        return l.file < r.file;
+                  if (l.proto != r.proto)
+                        return l.proto < r.proto;
+                  return l.pc < r.pc;
+            }
+
+            friend bool operator==(const hit &l, const hit &r) {
+                  return l.same_function(r) && l.pc == r.pc;
+            }
+      };
+
+      /* Every hit list below is sorted by (segment, file, proto, pc), which is how find() returns them. */
+
+      /* Hits of `a` at a pc that also has a hit in `b`. */
+      inline std::vector<hit> same_pc(const std::vector<hit> &a, const std::vector<hit> &b) {
+            std::vector<hit> out;
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+      }
+
+      inline std::vector<hit> either(const std::vector<hit> &a, const std::vector<hit> &b) {
+            std::vector<hit> out;
+            std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+      }
+
+      /* Hits of `b` with some hit of `a` earlier in the same function. */
+      inline std::vector<hit> followed_by(const std::vector<hit> &a, const std::vector<hit> &b) {
+            std::vector<hit> out;
+            auto i = std::size_t{0u};
+            for (auto j = std::size_t{0u}; j < b.size(); ++j) {
+                  const auto function = hit{b[j].segment, b[j].file, b[j].proto, 0u};
+                  while (i < a.size() && a[i] < function && !a[i].same_function(function))
+                        ++i;
+                  if (i < a.size() && a[i].same_function(b[j]) && a[i].pc < b[j].pc)
+                        out.push_back(b[j]);
+            }
+            return out;
+      }
+
+      /* First hit of every function. */
+      inline std::vector<hit> functions(const std::vector<hit> &hits) {
+            std::vector<hit> out;
+            for (const auto &h : hits) {
+                  if (out.empty() || !out.back().same_function(h))
+                        out.push_back(h);
+            }
+            return out;
+      }
+
+      /* Opens every segment in the MANIFEST, a reader is a snapshot and never sees later commits. */
+      class reader {
+          public:
+            explicit reader(const std::string &directory) {
+                  for (const auto &name : writer::read_manifest(directory))
+                        segments.push_back(segment::open(directory + "/" + name));
+                  live = detail::live_files(segments);
+            }
+
+            /* Segments already in memory, oldest first. */
+            explicit reader(std::vector<std::unique_ptr<segment>> loaded) : segments(std::move(loaded)), live(detail::live_files(segments)) {}
+
+            std::vector<hit> find(const term t) const {
+                  std::vector<hit> out;
+                  for (auto s = 0u; s < segments.size(); ++s) {
+                        auto postings = segments[s]->find(t);
+                        const auto &alive = live[s];
+                        out.reserve(out.size() + postings.size());
+                        for (posting p; postings.next(p);) {
+                              if (p.file >= alive.size())
+                                    throw index_error("posting names a file outside its segment");
+                              if (alive[p.file])
+                                    out.push_back(hit{s, p.file, p.proto, p.pc});
+                        }
+                  }
+                  return out;
+            }
+
+            /* Calls to global `name` made after a load of string constant `s` in the same function. */
+            std::vector<hit> calls_after_load(const std::string_view name, const std::string_view s) const {
+                  return followed_by(find(load_term(string_term(s))), find(call_term(name)));
+            }
+
+            std::string_view path(const hit &h) const {
+                  return segments[h.segment]->path(h.file);
+            }
+
+            std::size_t segment_count() const {
+                  return segments.size();
+            }
+
+            const segment &at(const std::size_t i) const {
+                  return *segments[i];
+            }
+
+          private:
+            std::vector<std::unique_ptr<segment>> segments;
+            std::vector<std::vector<std::uint8_t>> live; /* Per segment and file, 0 when a later add has the path. */
+      };
+
+} // namespace search
@@ -0,0 +1,58 @@
+#include "../isa_binary.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <string>
+
+/*
+      isconv <in> <out>        JSON -> binary, or binary -> JSON when <in> is a binary set
+      isconv --check <bin> [json]   verifies the checksum, and that <bin> was built from [json]
+*/
+namespace {
+
+      void save(const std::string &path, const void *const data, const std::size_t size) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(static_cast<const char *>(data), static_cast<std::streamsize>(size));
+            if (!out)
+                  throw std::runtime_error("cannot write " + path);
+      }
+
+      std::string text_of(const io::mapped_file &file) {
+            return {reinterpret_cast<const char *>(file.data()), file.size()};
+      }
+
+} // namespace
+
+std::int32_t main(const std::int32_t argc, const char *const argv[]) {
+
+      try {
+            if (argc >= 3 && std::strcmp(argv[1], "--check") == 0) {
+                  const auto set = isa::binary::file::open(argv[2]);
+                  if (argc >= 4 && set->stale(text_of(io::mapped_file(argv[3])))) {
+                        std::fprintf(stderr, "%s is stale, rebuild it from %s\n", argv[2], argv[3]);
+                        return 2;
+                  }
+                  std::printf("%s: %zu opcodes, ok\n", argv[2], set->size());
+                  return 0;
+            }
+            if (argc != 3) {
+                  std::fprintf(stderr, "usage: %s <in> <out>\n       %s --check <bin> [json]\n", argv[0], argv[0]);
+                  return 1;
+            }
+
+            const io::mapped_file in(argv[1]);
+            if (in.size() >= 4u && std::memcmp(in.data(), isa::binary::magic, 4u) == 0) {
+                  const auto json = isa::binary::to_json(*isa::binary::file::view(in.data(), in.size()));
+                  save(argv[2], json.data(), json.size());
+            } else {
+                  const auto bytes = isa::binary::from_json(text_of(in));
+                  save(argv[2], bytes.data(), bytes.size());
+            }
+      } catch (const std::exception &e) {
+            std::fprintf(stderr, "%s\n", e.what());
+            return 1;
+      }
+      return 0;
+}